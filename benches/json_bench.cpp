@@ -0,0 +1,94 @@
+// json::Document benchmarks: indexing multi-MB inputs and on-demand
+// navigation with field, at, pointer, members and get_str.
+//
+// Without arguments the input is a generated ~8 MB document of user records
+// with nested objects, escaped strings and a 10000-key index object. Every
+// path given on the command line is parsed as well.
+//
+// Usage: json_bench [file.json ...]
+// Set RUSTIC_BENCH_SAVE / RUSTIC_BENCH_BASELINE to record or compare runs.
+#include "rustic.hpp"
+
+#include <cstdio>
+
+namespace {
+
+String generate(usize records) {
+    String s;
+    s.reserve(records * 330 + 200000);
+    s += "{\"meta\":{\"version\":3,\"source\":\"json_bench\"},\"records\":[";
+    for (usize i = 0; i < records; ++i) {
+        if (i) s += ',';
+        const String n = std::to_string(i);
+        s += "{\"id\":" + n + ",\"name\":\"user " + n + "\",\"email\":\"user" + n + "@example.com\"";
+        s += ",\"score\":" + std::to_string(static_cast<f64>(i % 1000) / 8.0);
+        s += ",\"active\":" + String(i % 3 ? "true" : "false");
+        s += ",\"tags\":[\"alpha\",\"beta\",\"gamma\"]";
+        s += ",\"bio\":\"line one\\nline \\\"two\\\" \\u00e9t\\u00e9 \\ud83d\\ude00\"";
+        s += ",\"nested\":{\"x\":" + n + ",\"y\":[1,2,3,4],\"z\":{\"deep\":null}}}";
+    }
+    s += "],\"index\":{";
+    for (usize i = 0; i < 10000; ++i) {
+        if (i) s += ',';
+        s += "\"k" + std::to_string(i) + "\":" + std::to_string(i);
+    }
+    s += "},\"escaped\":{\"tab\\tkey\":1,\"quote\\\"key\":2,\"plain\":3}}";
+    return s;
+}
+
+void throughput(const BenchResult& r, usize bytes) {
+    std::printf("%-24s %.0f MB/s\n", "", static_cast<f64>(bytes) / r.median() * 1e3);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const String text = generate(33000);
+    std::printf("generated document: %.1f MB\n", static_cast<f64>(text.size()) / 1e6);
+
+    throughput(bench("json/parse/generated", [&] { return json::Document::parse(black_box(text)).is_ok(); }),
+               text.size());
+    for (int i = 1; i < argc; ++i) {
+        auto file = fs::read_to_string(argv[i]);
+        if (file.is_err()) {
+            std::fprintf(stderr, "%s: %s\n", argv[i], file.unwrap_err().to_string().c_str());
+            return 1;
+        }
+        const String& body = *file;
+        throughput(bench(String("json/parse/") + argv[i],
+                         [&] { return json::Document::parse(black_box(body)).is_ok(); }),
+                   body.size());
+    }
+
+    auto parsed = json::Document::parse(text);
+    const json::Document& doc = *parsed;
+    const json::Value root = doc.root();
+    const json::Value index = *root.field("index");
+    const json::Value records = *root.field("records");
+    const json::Value escaped = *root.field("escaped");
+
+    // field() walks the members in order, skipping nested values in O(1).
+    bench("json/field/top-level", [&] { return root.field(black_box(std::string_view("escaped"))).is_some(); });
+    bench("json/field/index-first", [&] { return index.field(black_box(std::string_view("k0"))).is_some(); });
+    bench("json/field/index-last", [&] { return index.field(black_box(std::string_view("k9999"))).is_some(); });
+    bench("json/field/escaped-key", [&] { return escaped.field(black_box(std::string_view("quote\"key"))).is_some(); });
+    bench("json/at/records-12500", [&] { return records.at(black_box(usize{12500})).is_some(); });
+    bench("json/pointer/deep", [&] { return root.pointer(black_box(std::string_view("/records/12500/nested/y/3"))).is_some(); });
+    bench("json/members/index", [&] {
+        usize n = 0;
+        for (const auto& m : index.members()) n += m.key.len();
+        return n;
+    });
+    bench("json/get/score-sum-1k", [&] {
+        f64 sum = 0;
+        usize i = 0;
+        for (const auto v : records.elements()) {
+            if (i++ == 1000) break;
+            if (auto x = v.field("score")->get<f64>()) sum += *x;
+        }
+        return sum;
+    });
+    // Escaped strings are decoded on the first read and cached after that.
+    const json::Value bio = *records.at(0)->field("bio");
+    bench("json/get_str/escaped", [&] { return bio.get_str().is_ok(); });
+}
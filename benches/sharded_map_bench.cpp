@@ -0,0 +1,120 @@
+// ShardedHashMap against a std::mutex-guarded std::unordered_map, over a grid
+// of reader and writer thread counts.
+//
+// Both maps start with 100k scrambled u64 keys. In each iteration every
+// reader does 20k lookups of random keys and every writer does 5k updates of
+// random keys (half through entry().or_insert, half through insert), with
+// thread start-up included. The report's per-iteration time is the wall time for
+// the whole batch; lower is better, and the "Mops/s" line divides the total
+// operation count by it.
+//
+// Usage: sharded_map_bench [max threads]   (default: 2 x hardware threads, at least 4)
+// With fewer cores than threads, the numbers mostly show lock hold times
+// and scheduling rather than parallel speed-up.
+#include "rustic.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+constexpr u64 KEYS = 100000;
+constexpr u32 READS = 20000;
+constexpr u32 WRITES = 5000;
+
+// The i-th key. std::hash<u64> is the identity in libstdc++, so dense keys
+// 0..N-1 would land one per bucket in a single big table but collide in the
+// smaller per-shard tables; scrambling them (an odd multiplier is a
+// bijection) compares the maps on realistic, hash-like keys instead.
+constexpr u64 key(u64 i) { return i * 0x9E3779B97F4A7C15ull; }
+
+struct Rng {
+    u64 s;
+    u64 next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+class LockedMap {
+    std::mutex mu;
+    std::unordered_map<u64, u64> map;
+
+public:
+    Option<u64> get(u64 k) {
+        std::lock_guard<std::mutex> g(mu);
+        const auto it = map.find(k);
+        if (it == map.end()) return None();
+        return Some(it->second);
+    }
+    void insert(u64 k, u64 v) {
+        std::lock_guard<std::mutex> g(mu);
+        map.insert_or_assign(k, v);
+    }
+    void add(u64 k, u64 v) {
+        std::lock_guard<std::mutex> g(mu);
+        map[k] += v;
+    }
+};
+
+struct Sharded {
+    ShardedHashMap<u64, u64> map;
+
+    Option<u64> get(u64 k) { return map.get(k); }
+    void insert(u64 k, u64 v) { map.insert(k, v); }
+    void add(u64 k, u64 v) { *map.entry(k).or_insert(0) += v; }
+};
+
+template<typename M>
+void run_grid(const char* name, M& m, u32 readers, u32 writers) {
+    for (u64 i = 0; i < KEYS; ++i) m.insert(key(i), i);
+    const u64 ops = u64{readers} * READS + u64{writers} * WRITES;
+    const String label = String("map/") + std::to_string(readers) + "r" + std::to_string(writers) + "w/" + name;
+    const auto r = bench(label, [&] {
+        u64 hits = 0;
+        std::atomic<u64> total{0};
+        thread_scope([&](auto& s) {
+            for (u32 t = 0; t < readers + writers; ++t) {
+                s.spawn([&, t] {
+                    Rng rng{0x9e3779b97f4a7c15ull * (t + 1)};
+                    u64 local = 0;
+                    if (t < readers) {
+                        for (u32 i = 0; i < READS; ++i)
+                            if (let v = m.get(key(rng.next() % KEYS))) local += *v;
+                    } else {
+                        for (u32 i = 0; i < WRITES; ++i) {
+                            const u64 k = key(rng.next() % KEYS);
+                            if (i & 1) m.add(k, 1);
+                            else m.insert(k, i);
+                        }
+                    }
+                    total.fetch_add(local, std::memory_order_relaxed);
+                });
+            }
+        });
+        hits += total.load();
+        return hits;
+    });
+    std::printf("%-24s %.2f Mops/s\n", "", static_cast<f64>(ops) / r.median() * 1e3);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const u32 max_threads = argc > 1 ? static_cast<u32>(std::strtoul(argv[1], nullptr, 10))
+                                     : std::max(4u, 2 * std::thread::hardware_concurrency());
+    std::printf("max threads: %u (hardware: %u)\n", max_threads, std::thread::hardware_concurrency());
+    for (u32 writers : {0u, 1u, 2u}) {
+        for (u32 readers = 1; readers + writers <= max_threads; readers *= 2) {
+            Sharded sharded;
+            run_grid("sharded", sharded, readers, writers);
+            LockedMap locked;
+            run_grid("mutex", locked, readers, writers);
+        }
+    }
+}
@@ -0,0 +1,76 @@
+// sort_unstable, radix_sort and par_sort against std::sort, over several
+// input distributions of u32 keys:
+// - random: uniform over the full u32 range;
+// - sorted: already ascending;
+// - few-unique: 16 distinct values in random order;
+// - organ-pipe: ascending to the midpoint, then descending.
+//
+// Each iteration copies the input into a reused buffer and sorts that, so
+// every run sees the same distribution. The "copy" line times the copy
+// alone; subtract it when comparing the fast cases, such as sort_unstable on
+// sorted input.
+//
+// Usage: sort_bench [elements]   (default: 1000000)
+// par_sort's parallel split only pays off with more than one core.
+#include "rustic.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+struct Rng {
+    u64 s;
+    u64 next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+Vec<u32> make_input(const String& dist, usize n) {
+    Rng rng{0x2545f4914f6cdd1dull};
+    Vec<u32> v(n);
+    for (usize i = 0; i < n; ++i) {
+        if (dist == "random") v[i] = static_cast<u32>(rng.next());
+        else if (dist == "sorted") v[i] = static_cast<u32>(i);
+        else if (dist == "few-unique") v[i] = static_cast<u32>(rng.next() % 16);
+        else v[i] = static_cast<u32>(i < n / 2 ? i : n - i);
+    }
+    return v;
+}
+
+template<typename Sort>
+void run(const String& name, const Vec<u32>& input, Vec<u32>& work, Sort sort) {
+    bench(name, [&] {
+        std::copy(input.begin(), input.end(), work.begin());
+        sort(work);
+        return work[work.size() / 2];
+    });
+    if (!std::is_sorted(work.begin(), work.end())) {
+        std::fprintf(stderr, "%s: output not sorted\n", name.c_str());
+        std::exit(1);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const usize n = argc > 1 ? static_cast<usize>(std::strtoull(argv[1], nullptr, 10)) : 1000000;
+    std::printf("elements: %zu\n", n);
+    Vec<u32> work(n);
+    for (const String dist : {"random", "sorted", "few-unique", "organ-pipe"}) {
+        const Vec<u32> input = make_input(dist, n);
+        const String prefix = "sort/" + dist + "/";
+        bench(prefix + "copy", [&] {
+            std::copy(input.begin(), input.end(), work.begin());
+            return work[work.size() / 2];
+        });
+        run(prefix + "std::sort", input, work, [](Vec<u32>& v) { std::sort(v.begin(), v.end()); });
+        run(prefix + "sort_unstable", input, work, [](Vec<u32>& v) { sort_unstable(v); });
+        run(prefix + "radix_sort", input, work, [](Vec<u32>& v) { radix_sort(v); });
+        run(prefix + "par_sort", input, work, [](Vec<u32>& v) { par_sort(v); });
+    }
+}
@@ -0,0 +1,233 @@
+// Mutex, Semaphore, Latch, Barrier and Condvar against their std::
+// counterparts (std::mutex, std::counting_semaphore, std::latch,
+// std::barrier, std::condition_variable).
+//
+// Each pair runs the same workload:
+// - uncontended: one thread, one operation per iteration, with an idle
+//   second thread alive (glibc skips atomics in std::mutex while a process
+//   has only one thread, which no real user of a lock sees);
+// - contended: `threads` workers each doing a batch of locked increments or
+//   acquire/release pairs (thread start-up is included in each iteration);
+// - hand-off: two threads ping-ponging through a condition variable or a
+//   pair of semaphores, 1000 round trips per iteration;
+// - rendezvous: `threads` workers meeting at a barrier 1000 times, or
+//   counting down a latch the main thread waits on.
+//
+// Usage: sync_bench [threads]   (default: hardware threads, at least 2)
+// Contended numbers mostly measure the scheduler when there are fewer cores
+// than threads.
+#include "rustic.hpp"
+
+#include <barrier>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <latch>
+#include <mutex>
+#include <semaphore>
+#include <thread>
+
+namespace {
+
+constexpr u32 BATCH = 10000;
+constexpr u32 ROUNDS = 1000;
+
+template<typename Body>
+void spawn_n(u32 threads, Body body) {
+    thread_scope([&](auto& s) {
+        for (u32 t = 0; t < threads; ++t) s.spawn([&, t] { body(t); });
+    });
+}
+
+void uncontended() {
+    Mutex<u64> m;
+    bench("mutex/uncontended/rustic", [&] { return ++*m.lock(); });
+    std::mutex sm;
+    u64 sv = 0;
+    bench("mutex/uncontended/std", [&] {
+        std::lock_guard<std::mutex> g(sm);
+        return ++sv;
+    });
+
+    Semaphore sem(1);
+    bench("semaphore/uncontended/rustic", [&] {
+        sem.acquire();
+        sem.release();
+    });
+    std::counting_semaphore<> ssem(1);
+    bench("semaphore/uncontended/std", [&] {
+        ssem.acquire();
+        ssem.release();
+    });
+
+    bench("latch/uncontended/rustic", [&] {
+        Latch l(1);
+        l.count_down();
+        l.wait();
+    });
+    bench("latch/uncontended/std", [&] {
+        std::latch l(1);
+        l.count_down();
+        l.wait();
+    });
+
+    Barrier b(1);
+    bench("barrier/uncontended/rustic", [&] { return b.wait().is_leader(); });
+    std::barrier<> sb(1);
+    bench("barrier/uncontended/std", [&] { sb.arrive_and_wait(); });
+
+    Condvar cv;
+    bench("condvar/notify-idle/rustic", [&] { cv.notify_one(); });
+    std::condition_variable scv;
+    bench("condvar/notify-idle/std", [&] { scv.notify_one(); });
+}
+
+void contended(u32 threads) {
+    const String n = std::to_string(threads);
+    Mutex<u64> m;
+    bench("mutex/" + n + "x10k/rustic", [&] {
+        spawn_n(threads, [&](u32) {
+            for (u32 i = 0; i < BATCH; ++i) ++*m.lock();
+        });
+    });
+    std::mutex sm;
+    u64 sv = 0;
+    bench("mutex/" + n + "x10k/std", [&] {
+        spawn_n(threads, [&](u32) {
+            for (u32 i = 0; i < BATCH; ++i) {
+                std::lock_guard<std::mutex> g(sm);
+                ++sv;
+            }
+        });
+    });
+
+    // Two permits shared by all workers.
+    Semaphore sem(2);
+    bench("semaphore/" + n + "x10k/rustic", [&] {
+        spawn_n(threads, [&](u32) {
+            for (u32 i = 0; i < BATCH; ++i) {
+                sem.acquire();
+                sem.release();
+            }
+        });
+    });
+    std::counting_semaphore<> ssem(2);
+    bench("semaphore/" + n + "x10k/std", [&] {
+        spawn_n(threads, [&](u32) {
+            for (u32 i = 0; i < BATCH; ++i) {
+                ssem.acquire();
+                ssem.release();
+            }
+        });
+    });
+}
+
+void handoff() {
+    // Condvar ping-pong: `turn` says whose move it is.
+    {
+        Mutex<u32> turn(0);
+        Condvar cv;
+        bench("condvar/pingpong-1k/rustic", [&] {
+            spawn_n(2, [&](u32 me) {
+                for (u32 r = 0; r < ROUNDS; ++r) {
+                    auto g = turn.lock();
+                    cv.wait_while(g, [&](u32& t) { return t != me; });
+                    *g = 1 - me;
+                    cv.notify_one();
+                }
+            });
+        });
+    }
+    {
+        std::mutex mu;
+        std::condition_variable cv;
+        u32 turn = 0;
+        bench("condvar/pingpong-1k/std", [&] {
+            spawn_n(2, [&](u32 me) {
+                for (u32 r = 0; r < ROUNDS; ++r) {
+                    std::unique_lock<std::mutex> g(mu);
+                    cv.wait(g, [&] { return turn == me; });
+                    turn = 1 - me;
+                    cv.notify_one();
+                }
+            });
+        });
+    }
+    {
+        Semaphore ping(0), pong(0);
+        bench("semaphore/pingpong-1k/rustic", [&] {
+            spawn_n(2, [&](u32 me) {
+                for (u32 r = 0; r < ROUNDS; ++r) {
+                    if (me == 0) {
+                        ping.release();
+                        pong.acquire();
+                    } else {
+                        ping.acquire();
+                        pong.release();
+                    }
+                }
+            });
+        });
+    }
+    {
+        std::counting_semaphore<> ping(0), pong(0);
+        bench("semaphore/pingpong-1k/std", [&] {
+            spawn_n(2, [&](u32 me) {
+                for (u32 r = 0; r < ROUNDS; ++r) {
+                    if (me == 0) {
+                        ping.release();
+                        pong.acquire();
+                    } else {
+                        ping.acquire();
+                        pong.release();
+                    }
+                }
+            });
+        });
+    }
+}
+
+void rendezvous(u32 threads) {
+    const String n = std::to_string(threads);
+    Barrier b(threads);
+    bench("barrier/" + n + "x1k/rustic", [&] {
+        spawn_n(threads, [&](u32) {
+            for (u32 r = 0; r < ROUNDS; ++r) b.wait();
+        });
+    });
+    std::barrier<> sb(threads);
+    bench("barrier/" + n + "x1k/std", [&] {
+        spawn_n(threads, [&](u32) {
+            for (u32 r = 0; r < ROUNDS; ++r) sb.arrive_and_wait();
+        });
+    });
+
+    bench("latch/" + n + "-workers/rustic", [&] {
+        Latch l(threads);
+        spawn_n(threads, [&](u32) { l.count_down(); });
+        l.wait();
+    });
+    bench("latch/" + n + "-workers/std", [&] {
+        std::latch l(threads);
+        spawn_n(threads, [&](u32) { l.count_down(); });
+        l.wait();
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const u32 threads = argc > 1 ? static_cast<u32>(std::strtoul(argv[1], nullptr, 10))
+                                 : std::max(2u, std::thread::hardware_concurrency());
+    std::printf("threads: %u (hardware: %u)\n", threads, std::thread::hardware_concurrency());
+    {
+        Latch done(1);
+        std::thread idle([&] { done.wait(); });
+        uncontended();
+        done.count_down();
+        idle.join();
+    }
+    contended(threads);
+    handoff();
+    rendezvous(threads);
+}
@@ -33,6 +33,29 @@
 // 2. Error handling: Option/Result with bool and pointer semantics plus match
 //    helpers (Case/DefaultCase).
 // 3. Object model: trait/impl macros, from/datafrom/inner, pub for public surface.
+// 5. Text: validated UTF-8 (Str, from_utf8) with SIMD validation, parse<T>,
+//    and an on-demand JSON reader (json::Document).
+// 6. I/O: IoError, fs::read/read_to_string, read-only Mmap with zero-copy views,
+//    Read/Write/BufRead traits with File, Pipe, BufReader, BufWriter, and
+//    refcounted Bytes/BytesMut buffers, endian-aware BinReader/BinWriter.
+// 7. Serialization: aggregate reflection, Serialize/Deserialize, bincode and
+//    JSON backends.
+// 8. Numerics: checked/overflowing/wrapping/saturating arithmetic, Wrapping<T>
+//    and Saturating<T>, overflow-exact slice sums, try_from/try_into.
+// 9. Slices: pdqsort, radix sort, sort_by_cached_key, parallel merge sort,
+//    branchless binary_search -> Result<usize, usize>, retain, dedup, SIMD
+//    sum/min/max/dot/argmax/map.
+// 10. Cells: OnceCell and LazyLock for one-time initialization, Cell and
+//     RefCell (borrow tracking in debug builds only).
+// 11. Concurrency: thread_scope for borrowing workers, ThreadPool, joins that
+//     return Result<T, JoinError>; futex-based Mutex<T>, RwLock<T>, Condvar,
+//     Semaphore, Latch, Barrier; ArcSwap for read-mostly shared values;
+//     epoch-based reclamation for lock-free structures; AtomicOption<Box<T>>;
+//     ShardedHashMap.
+// 12. Performance instrumentation: ShardedCounter and lock-free log-linear
+//     Histogram for hot-path metrics; TSC-backed Instant, Duration and
+//     ScopedTimer; rs_span scope markers with Chrome trace export; a bench()
+//     harness with baselines and black_box.
 //
 // =============================================================================
 // 0. Configuration
@@ -43,6 +66,27 @@
 //    - `ENABLE_RS_KEYWORD`: fn, let, let_mut.
 //    - `ENABLE_RS_ERROR`  : Option, Result, panic, and Case/DefaultCase helpers.
 //    - `ENABLE_RS_OBJECT` : trait, impl, from, datafrom, inner, pub macros.
+//    - `ENABLE_RS_TEXT`   : Str, Utf8Error, from_utf8, parse<T>, json::Document
+//                           (needs ENABLE_RS_ERROR).
+//    - `ENABLE_RS_IO`     : IoError, fs::read, Mmap, Bytes (needs ENABLE_RS_TEXT;
+//                           files and Mmap need POSIX);
+//                           Read/Write/BufRead also need ENABLE_RS_OBJECT.
+//    - `ENABLE_RS_SERDE`  : fields_of, bincode::, json:: (needs ENABLE_RS_ERROR).
+//    - `ENABLE_RS_NUM`    : checked_add, saturating_sum, Wrapping<T>, try_from
+//                           (needs ENABLE_RS_ERROR).
+//    - `ENABLE_RS_SLICE`  : sort_unstable, radix_sort, par_sort, binary_search,
+//                           retain, dedup, simd::sum/dot/argmax
+//                           (needs ENABLE_RS_ERROR).
+//    - `ENABLE_RS_CELL`   : OnceCell, LazyLock, Cell, RefCell
+//                           (needs ENABLE_RS_ERROR).
+//    - `ENABLE_RS_SYNC`   : thread_scope, ThreadPool, JoinError, Mutex,
+//                           RwLock, Condvar, Semaphore, Latch, Barrier,
+//                           ArcSwap, epoch, AtomicOption, ShardedHashMap
+//                           (needs ENABLE_RS_ERROR).
+//    - `ENABLE_RS_PERF`   : ShardedCounter, Histogram, Instant, Duration,
+//                           ScopedTimer, rs_span, trace::, bench, black_box
+//                           (needs ENABLE_RS_ERROR; bench baselines also
+//                           need ENABLE_RS_TEXT).
 // Tip: modules are independent; you can keep Result without syntax sugar, or use
 // trait macros alone.
 //
@@ -64,6 +108,7 @@
 // | usize      | size_t             |       |
 // | String     | std::string        | Alias only, not Rust's memory model |
 // | Vec<T>     | std::vector<T>     |       |
+// | Slice<T>   | std::span<const T> | Borrowed view, like Rust's &[T] |
 //
 // =============================================================================
 // 2. Keywords & Syntax Sugar
@@ -96,13 +141,20 @@
 //      - `expect(msg)`: same as unwrap with a custom panic message.
 //      - Pointer semantics: `opt->method()` and `*opt` behave like unwrap; check
 //        before dereferencing if you need safety.
+//    - `Option<T&>` holds a borrowed reference (Rust's Option<&T>); build it
+//      from an lvalue, and use `cloned()` to get an owned Option<T>.
 //
 // B. Result<T, E> - success or failure
 //    - Replacement for exceptions or error codes.
 //    - Construction: `Ok(val)` or `Err(err)`. Use `Ok()` when T is `Unit`.
+//      When T and E are the same type, a bare value converts to Ok only.
 //    - Access:
 //      - `unwrap()`: panics if Err.
 //      - `unwrap_err()`: panics if Ok.
+//    - `Result<T&, E>` borrows its Ok value, like `Option<T&>`.
+//    - A failed unwrap/expect calls rs_panic, which aborts the process. On
+//      thread_scope and ThreadPool workers it ends only that job, and the
+//      panic comes back from join() as a JoinError.
 //
 // C. Match
 //    - Syntax: `obj.match( Case(val){...}, Case(err){...} )`
@@ -174,6 +226,39 @@
 #define ENABLE_RS_KEYWORD
 #define ENABLE_RS_ERROR
 #define ENABLE_RS_OBJECT
+#define ENABLE_RS_TEXT
+#define ENABLE_RS_IO
+#define ENABLE_RS_SERDE
+#define ENABLE_RS_NUM
+#define ENABLE_RS_SLICE
+#define ENABLE_RS_CELL
+#define ENABLE_RS_SYNC
+#define ENABLE_RS_PERF
+#endif
+
+#if defined(ENABLE_RS_TEXT) && !defined(ENABLE_RS_ERROR)
+#error "ENABLE_RS_TEXT requires ENABLE_RS_ERROR"
+#endif
+#if defined(ENABLE_RS_IO) && !defined(ENABLE_RS_TEXT)
+#error "ENABLE_RS_IO requires ENABLE_RS_TEXT"
+#endif
+#if defined(ENABLE_RS_SERDE) && !defined(ENABLE_RS_ERROR)
+#error "ENABLE_RS_SERDE requires ENABLE_RS_ERROR"
+#endif
+#if defined(ENABLE_RS_NUM) && !defined(ENABLE_RS_ERROR)
+#error "ENABLE_RS_NUM requires ENABLE_RS_ERROR"
+#endif
+#if defined(ENABLE_RS_SLICE) && !defined(ENABLE_RS_ERROR)
+#error "ENABLE_RS_SLICE requires ENABLE_RS_ERROR"
+#endif
+#if defined(ENABLE_RS_CELL) && !defined(ENABLE_RS_ERROR)
+#error "ENABLE_RS_CELL requires ENABLE_RS_ERROR"
+#endif
+#if defined(ENABLE_RS_SYNC) && !defined(ENABLE_RS_ERROR)
+#error "ENABLE_RS_SYNC requires ENABLE_RS_ERROR"
+#endif
+#if defined(ENABLE_RS_PERF) && !defined(ENABLE_RS_ERROR)
+#error "ENABLE_RS_PERF requires ENABLE_RS_ERROR"
 #endif
 
 #include <cstdlib>
@@ -186,8 +271,225 @@
 #include <utility>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <span>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <iterator>
+#include <atomic>
+#include <new>
+#include <bit>
+#include <array>
+#include <tuple>
+#include <limits>
+#include <charconv>
+#include <memory>
+#include <ranges>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+#include <exception>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <format> // C++20
 
+// POSIX system headers for the I/O module (files, mmap).
+#if defined(__unix__) || defined(__APPLE__)
+#define RS_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// Raw futex syscalls for the blocking primitives in the concurrency module.
+#if defined(__linux__)
+#define RS_LINUX_FUTEX 1
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+// Platform helpers for the SIMD kernels. x86 kernels are compiled with
+// per-function target attributes and picked at runtime, so the header does not
+// need -mavx2 and the binary still runs on older CPUs.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define RS_X86_SIMD 1
+#include <immintrin.h>
+#include <cpuid.h>
+#define RS_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define RS_TARGET_AVX2 __attribute__((target("avx2")))
+#define RS_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl")))
+// Names an x86-only kernel variant in a best_kernel() call; other targets
+// see nullptr and never reference the symbol.
+#define RS_X86_KERNEL(k) (k)
+#else
+#define RS_X86_KERNEL(k) nullptr
+#endif
+
+// CPU feature detection, shared by every SIMD kernel in the header.
+// - `cpu::features()` reports the instruction sets this host supports
+//   (detected once; all false on non-x86 targets).
+// - `cpu::level()` is the highest kernel tier the dispatchers will use. Set
+//   RUSTIC_CPU_LEVEL=generic|ssse3|avx2|avx512 in the environment to cap it,
+//   e.g. to exercise fallback kernels on a newer machine.
+// - Each dispatcher calls `rs_detail::best_kernel` once, on first use, and
+//   keeps the chosen function pointer in a function-local static.
+namespace cpu {
+
+struct Features {
+    bool ssse3 = false;
+    bool avx2 = false;
+    bool avx512f = false;
+    bool avx512bw = false;
+    bool avx512vl = false;
+    bool invariant_tsc = false; // TSC ticks at a constant rate, also in sleep states
+};
+
+enum class Level : uint8_t { Generic, Ssse3, Avx2, Avx512 };
+
+inline const char* level_name(Level l) {
+    switch (l) {
+    case Level::Ssse3: return "ssse3";
+    case Level::Avx2: return "avx2";
+    case Level::Avx512: return "avx512";
+    default: return "generic";
+    }
+}
+
+inline const Features& features() {
+    static const Features f = [] {
+        Features out;
+#ifdef RS_X86_SIMD
+        __builtin_cpu_init(); // may run from a static constructor before libgcc's
+        out.ssse3 = __builtin_cpu_supports("ssse3");
+        out.avx2 = __builtin_cpu_supports("avx2");
+        out.avx512f = __builtin_cpu_supports("avx512f");
+        out.avx512bw = __builtin_cpu_supports("avx512bw");
+        out.avx512vl = __builtin_cpu_supports("avx512vl");
+        unsigned a, b, c, d;
+        if (__get_cpuid(0x80000007, &a, &b, &c, &d)) out.invariant_tsc = (d >> 8) & 1;
+#endif
+        return out;
+    }();
+    return f;
+}
+
+inline Level level() {
+    static const Level l = [] {
+        const Features& f = features();
+        Level best = f.avx512f && f.avx512bw && f.avx512vl ? Level::Avx512
+                   : f.avx2                                  ? Level::Avx2
+                   : f.ssse3                                 ? Level::Ssse3
+                                                             : Level::Generic;
+        if (const char* cap = std::getenv("RUSTIC_CPU_LEVEL")) {
+            for (Level c : {Level::Generic, Level::Ssse3, Level::Avx2, Level::Avx512}) {
+                if (std::string_view(cap) == level_name(c) && c < best) best = c;
+            }
+        }
+        return best;
+    }();
+    return l;
+}
+
+} // namespace cpu
+
+namespace rs_detail {
+
+// The best non-null variant at or below cpu::level(), else `generic` (which
+// may itself be null when the caller has an inline scalar path).
+template<typename Kernel>
+inline Kernel best_kernel(Kernel generic, Kernel ssse3, Kernel avx2, Kernel avx512) {
+    switch (cpu::level()) {
+    case cpu::Level::Avx512: if (avx512) return avx512; [[fallthrough]];
+    case cpu::Level::Avx2: if (avx2) return avx2; [[fallthrough]];
+    case cpu::Level::Ssse3: if (ssse3) return ssse3; [[fallthrough]];
+    default: return generic;
+    }
+}
+
+// Scalar UTF-8 validator following Rust's core::str::from_utf8. Returns the
+// offset of the first invalid byte (or n) and writes the bad sequence length
+// to err_len. The Text module's SIMD kernels finish with it, and the serde
+// JSON reader checks strings with it.
+inline size_t utf8_scalar(const uint8_t* s, size_t n, size_t i, uint8_t& err_len) {
+    while (i < n) {
+        // ASCII fast path, 8 bytes at a time.
+        while (i + 8 <= n) {
+            uint64_t word;
+            std::memcpy(&word, s + i, 8);
+            if (word & 0x8080808080808080ull) break;
+            i += 8;
+        }
+        if (i >= n) break;
+        const uint8_t first = s[i];
+        if (first < 0x80) { ++i; continue; }
+
+        auto cont = [&](size_t k) { return (s[i + k] & 0xC0) == 0x80; };
+        if (first >= 0xC2 && first <= 0xDF) {
+            if (i + 1 >= n) { err_len = 0; return i; }
+            if (!cont(1)) { err_len = 1; return i; }
+            i += 2;
+        } else if (first >= 0xE0 && first <= 0xEF) {
+            if (i + 1 >= n) { err_len = 0; return i; }
+            const uint8_t b = s[i + 1];
+            const bool ok = (first == 0xE0) ? (b >= 0xA0 && b <= 0xBF)
+                          : (first == 0xED) ? (b >= 0x80 && b <= 0x9F)
+                          : (b >= 0x80 && b <= 0xBF);
+            if (!ok) { err_len = 1; return i; }
+            if (i + 2 >= n) { err_len = 0; return i; }
+            if (!cont(2)) { err_len = 2; return i; }
+            i += 3;
+        } else if (first >= 0xF0 && first <= 0xF4) {
+            if (i + 1 >= n) { err_len = 0; return i; }
+            const uint8_t b = s[i + 1];
+            const bool ok = (first == 0xF0) ? (b >= 0x90 && b <= 0xBF)
+                          : (first == 0xF4) ? (b >= 0x80 && b <= 0x8F)
+                          : (b >= 0x80 && b <= 0xBF);
+            if (!ok) { err_len = 1; return i; }
+            if (i + 2 >= n) { err_len = 0; return i; }
+            if (!cont(2)) { err_len = 2; return i; }
+            if (i + 3 >= n) { err_len = 0; return i; }
+            if (!cont(3)) { err_len = 3; return i; }
+            i += 4;
+        } else {
+            err_len = 1;
+            return i;
+        }
+    }
+    return n;
+}
+
+// RFC 8259 number grammar: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+// Shared by json::Document and the serde JSON reader.
+inline bool json_number_ok(std::string_view s) {
+    size_t i = 0;
+    auto digits = [&] {
+        const size_t start = i;
+        while (i < s.size() && s[i] >= '0' && s[i] <= '9') ++i;
+        return i > start;
+    };
+    if (i < s.size() && s[i] == '-') ++i;
+    if (i < s.size() && s[i] == '0') ++i;
+    else if (!digits()) return false;
+    if (i < s.size() && s[i] == '.') {
+        ++i;
+        if (!digits()) return false;
+    }
+    if (i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+        ++i;
+        if (i < s.size() && (s[i] == '+' || s[i] == '-')) ++i;
+        if (!digits()) return false;
+    }
+    return i == s.size();
+}
+
+} // namespace rs_detail
+
 // ==========================================
 // 1. Syntax Sugar (Type aliases + bindings)
 // ==========================================
@@ -202,6 +504,7 @@
 // | usize      | size_t             |       |
 // | String     | std::string        | Alias only, not Rust's memory model |
 // | Vec<T>     | std::vector<T>     |       |
+// | Slice<T>   | std::span<const T> | Borrowed view, like Rust's &[T] |
 //
 // Functions and variables:
 // - `fn`      -> `auto`       : return type deduction (C++14+).
@@ -230,6 +533,8 @@ using String = std::string;
 
 template<typename T>
 using Vec = std::vector<T>;
+template<typename T>
+using Slice = std::span<const T>;
 
 #define fn auto
 #define let const auto
@@ -254,9 +559,21 @@ struct Unit {
 template<typename T> class Option;
 template<typename T, typename E> class Result;
 
+namespace rs_detail {
+// Set on worker threads whose join reports panics (thread_scope, ThreadPool).
+// There a panic unwinds the worker like Rust's; everywhere else it aborts.
+inline thread_local bool panic_unwinds = false;
+struct PanicPayload {
+    std::string msg;
+};
+} // namespace rs_detail
+
 inline void rs_panic(const std::string& msg) {
     std::cerr << "[Panic] " << msg << std::endl;
-    std::abort(); // Hard abort; intentionally not catchable ("Let it crash")
+#ifdef __cpp_exceptions
+    if (rs_detail::panic_unwinds) throw rs_detail::PanicPayload{msg};
+#endif
+    std::abort(); // Hard abort ("Let it crash"); only panic_unwinds threads throw
 }
 inline void panic(const std::string& msg){
     rs_panic(msg);
@@ -317,6 +634,54 @@ public:
     }
 };
 
+// --- Option<T&> ---
+// A borrowed, nullable reference (Rust's Option<&T>): stores a pointer and
+// never copies the referent. Build it from an lvalue or None().
+template<typename T>
+class Option<T&> {
+    T* ptr = nullptr;
+public:
+    Option() = default;
+    Option(std::monostate) {}
+    Option(T& ref) : ptr(std::addressof(ref)) {}
+    Option(std::remove_const_t<T>&&) = delete; // would dangle
+
+    bool is_some() const { return ptr != nullptr; }
+    bool is_none() const { return ptr == nullptr; }
+    explicit operator bool() const { return is_some(); }
+
+    T& unwrap() const {
+        if (is_none()) rs_panic("called `Option::unwrap()` on a `None` value");
+        return *ptr;
+    }
+    T& expect(const char* msg) const {
+        if (is_none()) rs_panic(msg);
+        return *ptr;
+    }
+    T& unwrap_or(T& def) const { return is_some() ? *ptr : def; }
+    // Copies the referent out (Rust's `.cloned()`).
+    Option<std::remove_const_t<T>> cloned() const {
+        if (is_none()) return Option<std::remove_const_t<T>>();
+        return Option<std::remove_const_t<T>>(*ptr);
+    }
+
+    T* operator->() const { return &unwrap(); }
+    T& operator*() const { return unwrap(); }
+
+    template<typename F1, typename F2>
+    auto match(F1&& f_some, F2&& f_none) const {
+        if (is_some()) {
+            if constexpr (std::is_invocable_v<F1, T&>) {
+                return f_some(*ptr);
+            } else {
+                return f_some();
+            }
+        } else {
+            return f_none();
+        }
+    }
+};
+
 // --- Result ---
 template<typename T> struct OkValue { T value; };
 template<typename E> struct ErrValue { E error; };
@@ -327,8 +692,12 @@ class Result {
 public:
     Result(const T& val) : value(std::in_place_index<0>, val) {}
     Result(T&& val) : value(std::in_place_index<0>, std::move(val)) {}
-    Result(const E& err) : value(std::in_place_index<1>, err) {}
-    Result(E&& err) : value(std::in_place_index<1>, std::move(err)) {}
+    // Disabled when T and E are the same type (e.g. Result<usize, usize>);
+    // use Err(e) to build the error side there.
+    template<typename U = E>
+    Result(const std::enable_if_t<!std::is_same_v<T, U>, U>& err) : value(std::in_place_index<1>, err) {}
+    template<typename U = E>
+    Result(std::enable_if_t<!std::is_same_v<T, U>, U>&& err) : value(std::in_place_index<1>, std::move(err)) {}
 
     // Implicit Conversion
     template<typename U>
@@ -358,6 +727,10 @@ public:
         if (is_ok()) rs_panic("called `Result::unwrap_err()` on an `Ok` value");
         return std::get<1>(value);
     }
+    const E& unwrap_err() const {
+        if (is_ok()) rs_panic("called `Result::unwrap_err()` on an `Ok` value");
+        return std::get<1>(value);
+    }
 
     // Pointer semantics
     T* operator->() { return &unwrap(); }
@@ -376,6 +749,52 @@ public:
     }
 };
 
+// --- Result<T&, E> ---
+// Ok side borrows (Rust's Result<&T, E>). Build Ok from an lvalue of T; Err
+// works as for Result<T, E>.
+template<typename T, typename E>
+class Result<T&, E> {
+    std::variant<T*, E> value;
+public:
+    Result(T& ref) : value(std::in_place_index<0>, std::addressof(ref)) {}
+    Result(std::remove_const_t<T>&&) = delete; // would dangle
+    template<typename U>
+    Result(ErrValue<U>&& err) : value(std::in_place_index<1>, std::move(err.error)) {}
+
+    bool is_ok() const { return value.index() == 0; }
+    bool is_err() const { return value.index() == 1; }
+    explicit operator bool() const { return is_ok(); }
+
+    T& unwrap() const {
+        if (is_err()) rs_panic("called `Result::unwrap()` on an `Err` value");
+        return *std::get<0>(value);
+    }
+    T& expect(const char* msg) const {
+        if (is_err()) rs_panic(msg);
+        return *std::get<0>(value);
+    }
+    E& unwrap_err() {
+        if (is_ok()) rs_panic("called `Result::unwrap_err()` on an `Ok` value");
+        return std::get<1>(value);
+    }
+    const E& unwrap_err() const {
+        if (is_ok()) rs_panic("called `Result::unwrap_err()` on an `Ok` value");
+        return std::get<1>(value);
+    }
+
+    T* operator->() const { return &unwrap(); }
+    T& operator*() const { return unwrap(); }
+
+    template<typename F1, typename F2>
+    auto match(F1&& f_ok, F2&& f_err) const {
+        if (is_ok()) {
+            return f_ok(*std::get<0>(value));
+        } else {
+            return f_err(std::get<1>(value));
+        }
+    }
+};
+
 // Factories
 template<typename T> auto Some(T&& v) { return Option<std::decay_t<T>>(std::forward<T>(v)); }
 inline auto None() { return std::monostate{}; }
@@ -422,4 +841,7174 @@ struct Name : public Interface { \
 #endif // ENABLE_RS_OBJECT
 
 
+// ==========================================
+// 5. Text (UTF-8)
+// ==========================================
+// Requires: ENABLE_RS_TEXT (+ ENABLE_RS_ERROR)
+//
+// `String` is only an alias of std::string, so nothing guarantees its bytes are
+// UTF-8. Validate once at the boundary and carry the proof in the type:
+// - `from_utf8(bytes)`         -> Result<String, Utf8Error>, moves the buffer.
+// - `from_utf8_unchecked(b)`   -> String, caller promises validity.
+// - `Str::from_utf8(view)`     -> Result<Str, Utf8Error>, borrowed view.
+// - `is_utf8(view)`            -> bool.
+// - `parse<T>(view)`           -> Result<T, ParseError> for integers and floats.
+// - `json::Document::parse(v)` -> Result<Document, JsonError>, on-demand JSON.
+// Utf8Error mirrors Rust: `valid_up_to()` is the offset of the first invalid
+// byte, `error_len()` is None when the input ends in the middle of a sequence.
+//
+// Validation runs 32 (AVX2) or 16 (SSSE3) bytes per step with the lookup-table
+// algorithm from simdjson, with a scalar fallback for other targets. The SIMD
+// pass only answers "is this block valid"; the scalar pass locates the exact
+// error offset and handles the tail.
+//
+// Example:
+//   from_utf8(read_input()).match(
+//       Case(text){ use(text); },
+//       Case(err){ std::cerr << "bad byte at " << err.valid_up_to(); }
+//   );
+#ifdef ENABLE_RS_TEXT
+
+class Utf8Error {
+    size_t valid_up_to_;
+    uint8_t error_len_; // 0 means "unexpected end of input"
+public:
+    Utf8Error(size_t valid_up_to, uint8_t error_len)
+        : valid_up_to_(valid_up_to), error_len_(error_len) {}
+
+    size_t valid_up_to() const { return valid_up_to_; }
+    Option<size_t> error_len() const {
+        if (error_len_ == 0) return None();
+        return Some(static_cast<size_t>(error_len_));
+    }
+    std::string to_string() const {
+        if (error_len_ == 0)
+            return "incomplete utf-8 byte sequence from index " + std::to_string(valid_up_to_);
+        return "invalid utf-8 sequence of " + std::to_string(error_len_) +
+               " bytes from index " + std::to_string(valid_up_to_);
+    }
+    friend std::ostream& operator<<(std::ostream& os, const Utf8Error& e) {
+        return os << e.to_string();
+    }
+};
+
+namespace rs_detail {
+
+#ifdef RS_X86_SIMD
+// Error classes for the three nibble lookups (Keiser & Lemire, "Validating
+// UTF-8 In Less Than One Instruction Per Byte").
+namespace utf8_tables {
+constexpr uint8_t TOO_SHORT = 1 << 0;
+constexpr uint8_t TOO_LONG = 1 << 1;
+constexpr uint8_t OVERLONG_3 = 1 << 2;
+constexpr uint8_t TOO_LARGE = 1 << 3;
+constexpr uint8_t SURROGATE = 1 << 4;
+constexpr uint8_t OVERLONG_2 = 1 << 5;
+constexpr uint8_t TOO_LARGE_1000 = 1 << 6;
+constexpr uint8_t OVERLONG_4 = 1 << 6;
+constexpr uint8_t TWO_CONTS = 1 << 7;
+constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+alignas(16) inline constexpr uint8_t byte_1_high[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+alignas(16) inline constexpr uint8_t byte_1_low[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+alignas(16) inline constexpr uint8_t byte_2_high[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+// Saturating-subtract thresholds: a lead byte in the last 1-3 positions of a
+// block leaves a sequence open across the block boundary.
+alignas(16) inline constexpr uint8_t incomplete_tail[16] = {
+    255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 0xEF, 0xDF, 0xBF,
+};
+} // namespace utf8_tables
+
+// Both kernels return the offset of the first block that failed (or the end of
+// the last full block). Everything before the returned offset is valid except
+// possibly a sequence straddling it, which the scalar pass re-checks.
+RS_TARGET_SSSE3 inline size_t utf8_blocks_ssse3(const uint8_t* s, size_t n) {
+    using namespace utf8_tables;
+    const __m128i t1 = _mm_load_si128(reinterpret_cast<const __m128i*>(byte_1_high));
+    const __m128i t2 = _mm_load_si128(reinterpret_cast<const __m128i*>(byte_1_low));
+    const __m128i t3 = _mm_load_si128(reinterpret_cast<const __m128i*>(byte_2_high));
+    const __m128i tail = _mm_load_si128(reinterpret_cast<const __m128i*>(incomplete_tail));
+    const __m128i nib = _mm_set1_epi8(0x0F);
+    __m128i prev_input = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        __m128i error;
+        if (_mm_movemask_epi8(input) == 0) {
+            error = prev_incomplete;
+        } else {
+            const __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+            const __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+            const __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+            const __m128i sc = _mm_and_si128(
+                _mm_and_si128(
+                    _mm_shuffle_epi8(t1, _mm_and_si128(_mm_srli_epi16(prev1, 4), nib)),
+                    _mm_shuffle_epi8(t2, _mm_and_si128(prev1, nib))),
+                _mm_shuffle_epi8(t3, _mm_and_si128(_mm_srli_epi16(input, 4), nib)));
+            const __m128i must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(0x60)),
+                                                _mm_subs_epu8(prev3, _mm_set1_epi8(0x70)));
+            const __m128i must23_80 = _mm_and_si128(must23, _mm_set1_epi8(static_cast<char>(0x80)));
+            error = _mm_xor_si128(must23_80, sc);
+            prev_incomplete = _mm_subs_epu8(input, tail);
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) != 0xFFFF) break;
+        prev_input = input;
+    }
+    return i;
+}
+
+RS_TARGET_AVX2 inline size_t utf8_blocks_avx2(const uint8_t* s, size_t n) {
+    using namespace utf8_tables;
+    const __m256i t1 = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(byte_1_high)));
+    const __m256i t2 = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(byte_1_low)));
+    const __m256i t3 = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(byte_2_high)));
+    const __m256i tail = _mm256_inserti128_si256(
+        _mm256_set1_epi8(static_cast<char>(0xFF)),
+        _mm_load_si128(reinterpret_cast<const __m128i*>(incomplete_tail)), 1);
+    const __m256i nib = _mm256_set1_epi8(0x0F);
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+        __m256i error;
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = prev_incomplete;
+        } else {
+            // [prev.hi, input.lo] so alignr can shift across the lane boundary.
+            const __m256i carry = _mm256_permute2x128_si256(prev_input, input, 0x21);
+            const __m256i prev1 = _mm256_alignr_epi8(input, carry, 15);
+            const __m256i prev2 = _mm256_alignr_epi8(input, carry, 14);
+            const __m256i prev3 = _mm256_alignr_epi8(input, carry, 13);
+            const __m256i sc = _mm256_and_si256(
+                _mm256_and_si256(
+                    _mm256_shuffle_epi8(t1, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nib)),
+                    _mm256_shuffle_epi8(t2, _mm256_and_si256(prev1, nib))),
+                _mm256_shuffle_epi8(t3, _mm256_and_si256(_mm256_srli_epi16(input, 4), nib)));
+            const __m256i must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(0x60)),
+                                                   _mm256_subs_epu8(prev3, _mm256_set1_epi8(0x70)));
+            const __m256i must23_80 = _mm256_and_si256(must23, _mm256_set1_epi8(static_cast<char>(0x80)));
+            error = _mm256_xor_si256(must23_80, sc);
+            prev_incomplete = _mm256_subs_epu8(input, tail);
+        }
+        if (!_mm256_testz_si256(error, error)) break;
+        prev_input = input;
+    }
+    return i;
+}
+#endif // RS_X86_SIMD
+
+// Returns the offset of the first invalid byte, or n when the input is valid.
+inline size_t utf8_validate(const uint8_t* s, size_t n, uint8_t& err_len) {
+    size_t start = 0;
+#ifdef RS_X86_SIMD
+    using Kernel = size_t (*)(const uint8_t*, size_t);
+    static const Kernel kernel = best_kernel<Kernel>(nullptr, &utf8_blocks_ssse3, &utf8_blocks_avx2, nullptr);
+    if (kernel && n >= 16) {
+        const size_t block = kernel(s, n);
+        // Resume at the lead byte of a sequence that may straddle the block edge.
+        start = block;
+        for (size_t k = 1; k <= 3 && k <= block; ++k) {
+            if ((s[block - k] & 0xC0) != 0x80) { start = block - k; break; }
+        }
+    }
+#endif
+    return utf8_scalar(s, n, start, err_len);
+}
+
+} // namespace rs_detail
+
+inline bool is_utf8(std::string_view bytes) {
+    uint8_t err_len = 0;
+    const auto* p = reinterpret_cast<const uint8_t*>(bytes.data());
+    return rs_detail::utf8_validate(p, bytes.size(), err_len) == bytes.size();
+}
+
+// --- Str ---
+// Borrowed, validated UTF-8 view (Rust's &str). Only the factories below can
+// build one, so holding a Str is proof the bytes were checked.
+class Str {
+    std::string_view view;
+    explicit Str(std::string_view v) : view(v) {}
+public:
+    Str() = default;
+
+    static Result<Str, Utf8Error> from_utf8(std::string_view bytes) {
+        uint8_t err_len = 0;
+        const auto* p = reinterpret_cast<const uint8_t*>(bytes.data());
+        const size_t at = rs_detail::utf8_validate(p, bytes.size(), err_len);
+        if (at != bytes.size()) return Err(Utf8Error(at, err_len));
+        return Ok(Str(bytes));
+    }
+    static Result<Str, Utf8Error> from_utf8(std::span<const uint8_t> bytes) {
+        return from_utf8(std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+    }
+    static Str from_utf8_unchecked(std::string_view bytes) { return Str(bytes); }
+
+    size_t len() const { return view.size(); }
+    bool is_empty() const { return view.empty(); }
+    const char* data() const { return view.data(); }
+    std::string_view as_str() const { return view; }
+    std::span<const uint8_t> as_bytes() const {
+        return {reinterpret_cast<const uint8_t*>(view.data()), view.size()};
+    }
+    std::string to_string() const { return std::string(view); }
+    operator std::string_view() const { return view; }
+
+    bool operator==(const Str& o) const { return view == o.view; }
+    bool operator!=(const Str& o) const { return view != o.view; }
+    friend std::ostream& operator<<(std::ostream& os, const Str& s) { return os << s.view; }
+};
+
+// --- String factories ---
+// The buffer is moved through on success, so validation costs no copy.
+inline Result<std::string, Utf8Error> from_utf8(std::string bytes) {
+    uint8_t err_len = 0;
+    const auto* p = reinterpret_cast<const uint8_t*>(bytes.data());
+    const size_t at = rs_detail::utf8_validate(p, bytes.size(), err_len);
+    if (at != bytes.size()) return Err(Utf8Error(at, err_len));
+    return Ok(std::move(bytes));
+}
+inline Result<std::string, Utf8Error> from_utf8(const std::vector<uint8_t>& bytes) {
+    return from_utf8(std::string(bytes.begin(), bytes.end()));
+}
+inline std::string from_utf8_unchecked(std::string bytes) { return bytes; }
+
+// --- parse<T> ---
+// Numeric parsing through std::from_chars: no locale, no allocation, no
+// exceptions. The whole input must be consumed.
+//   parse<i32>("42")      -> Ok(42)
+//   parse<f64>("1e-3")    -> Ok(0.001)
+//   parse<u8>("300")      -> Err(ParseError::OutOfRange)
+enum class ParseError { Empty, Invalid, OutOfRange };
+
+inline std::ostream& operator<<(std::ostream& os, ParseError e) {
+    switch (e) {
+        case ParseError::Empty: return os << "cannot parse from empty string";
+        case ParseError::Invalid: return os << "invalid digit found in string";
+        default: return os << "number too large or too small to fit in target type";
+    }
+}
+
+template<typename T>
+inline Result<T, ParseError> parse(std::string_view s) {
+    static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "parse<T> supports integers and floats");
+    if (s.empty()) return Err(ParseError::Empty);
+    const char* first = s.data();
+    const char* last = first + s.size();
+    // from_chars rejects a leading '+'; skip it, but not in front of a '-'.
+    if (*first == '+' && s.size() > 1 && first[1] != '-') ++first;
+    T value{};
+    const auto res = std::from_chars(first, last, value);
+    if (res.ec == std::errc::result_out_of_range) return Err(ParseError::OutOfRange);
+    if (res.ec != std::errc{} || res.ptr != last) return Err(ParseError::Invalid);
+    return Ok(value);
+}
+
+// --- json::Document (on-demand) ---
+// Two-stage parser in the style of simdjson:
+// 1. Structural indexing. 64-byte blocks are classified with AVX2 (or a
+//    scalar table), and escapes and in-string regions are resolved with bit
+//    arithmetic. The result is the offset of every bracket, colon, comma,
+//    string start and scalar start. A linear pass over that index checks the
+//    grammar and the object keys, and records where each bracket closes.
+// 2. On-demand navigation. A `json::Value` is one index position.
+//    `field(key)` and `at(i)` jump over unrelated subtrees in O(1), strings
+//    come back as Str views into the input, and numbers are checked and decoded
+//    only when asked for, through parse<T>.
+// Lookups return Option<Value>; typed reads return Result<T, JsonError>.
+//
+// The Document borrows the input text, so the text must outlive it. A string
+// with escapes is decoded on its first read and cached in the Document by
+// position, so reading such strings is not thread-safe; everything else is
+// read-only. field() compares escaped keys without caching them.
+//
+// Example:
+//   let doc = json::Document::parse(body);
+//   if (doc.is_err()) return Err(doc.unwrap_err());
+//   let port = doc->root().pointer("/server/port");
+//   if (port) port->get<u16>().match(Case(p){ listen(p); }, Case(e){ log(e); });
+//   for (let m : doc->root().members()) std::cout << m.key << '\n';
+namespace json {
+
+struct JsonError {
+    std::string msg;
+    size_t offset;
+
+    std::string to_string() const { return msg + " at offset " + std::to_string(offset); }
+    friend std::ostream& operator<<(std::ostream& os, const JsonError& e) { return os << e.to_string(); }
+};
+
+enum class JsonType { Object, Array, String, Number, Bool, Null };
+
+class Value;
+class Document;
+struct Member;
+
+} // namespace json
+
+namespace rs_detail {
+
+// Per-block bitmasks; bit i describes byte i of the 64-byte block.
+struct JsonMasks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;
+    uint64_t ws;
+};
+
+inline void json_classify_scalar(const uint8_t* p, size_t blocks, JsonMasks* out) {
+    for (size_t b = 0; b < blocks; ++b, p += 64) {
+        JsonMasks m{0, 0, 0, 0};
+        for (size_t i = 0; i < 64; ++i) {
+            const uint64_t bit = uint64_t{1} << i;
+            switch (p[i]) {
+                case '"': m.quote |= bit; break;
+                case '\\': m.backslash |= bit; break;
+                case '{': case '}': case '[': case ']': case ':': case ',': m.op |= bit; break;
+                case ' ': case '\t': case '\n': case '\r': m.ws |= bit; break;
+                default: break;
+            }
+        }
+        out[b] = m;
+    }
+}
+
+#ifdef RS_X86_SIMD
+RS_TARGET_AVX2 inline __m256i json_eq_avx2(__m256i v, char c) { return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)); }
+
+RS_TARGET_AVX2 inline void json_classify_avx2(const uint8_t* p, size_t blocks, JsonMasks* out) {
+    constexpr auto eq = &json_eq_avx2;
+    for (size_t b = 0; b < blocks; ++b, p += 64) {
+        uint64_t q[2], bs[2], op[2], ws[2];
+        for (int h = 0; h < 2; ++h) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32 * h));
+            const __m256i o = _mm256_or_si256(
+                _mm256_or_si256(_mm256_or_si256(eq(v, '{'), eq(v, '}')), _mm256_or_si256(eq(v, '['), eq(v, ']'))),
+                _mm256_or_si256(eq(v, ':'), eq(v, ',')));
+            const __m256i w = _mm256_or_si256(_mm256_or_si256(eq(v, ' '), eq(v, '\t')),
+                                              _mm256_or_si256(eq(v, '\n'), eq(v, '\r')));
+            q[h] = static_cast<uint32_t>(_mm256_movemask_epi8(eq(v, '"')));
+            bs[h] = static_cast<uint32_t>(_mm256_movemask_epi8(eq(v, '\\')));
+            op[h] = static_cast<uint32_t>(_mm256_movemask_epi8(o));
+            ws[h] = static_cast<uint32_t>(_mm256_movemask_epi8(w));
+        }
+        out[b] = JsonMasks{q[0] | (q[1] << 32), bs[0] | (bs[1] << 32), op[0] | (op[1] << 32), ws[0] | (ws[1] << 32)};
+    }
+}
+#endif
+
+inline uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// Stage 1: offsets of all structural characters and scalar starts. Returns
+// false if the input ends inside a string.
+inline bool json_index(const uint8_t* s, size_t n, std::vector<uint32_t>& out) {
+    using Classify = void (*)(const uint8_t*, size_t, JsonMasks*);
+    static const Classify classify =
+        best_kernel<Classify>(&json_classify_scalar, nullptr, RS_X86_KERNEL(&json_classify_avx2), nullptr);
+    constexpr size_t batch = 64; // blocks per classify call (4 KiB)
+    JsonMasks masks[batch];
+    uint64_t prev_escaped = 0, prev_in_string = 0, prev_scalar = 0;
+    out.clear();
+    out.reserve(n / 6 + 16);
+
+    for (size_t base = 0; base < n; base += 64 * batch) {
+        const size_t full = std::min(batch, (n - base) / 64);
+        size_t blocks = full;
+        if (full) classify(s + base, full, masks);
+        if (full < batch && base + full * 64 < n) {
+            // Tail block, padded with spaces.
+            alignas(32) uint8_t tail[64];
+            std::memset(tail, ' ', sizeof(tail));
+            std::memcpy(tail, s + base + full * 64, n - base - full * 64);
+            classify(tail, 1, masks + full);
+            ++blocks;
+        }
+        for (size_t b = 0; b < blocks; ++b) {
+            const JsonMasks& m = masks[b];
+            // Backslashes are rare; walk them to find escaped bytes.
+            uint64_t escaped = prev_escaped;
+            prev_escaped = 0;
+            uint64_t bs = m.backslash & ~escaped;
+            while (bs) {
+                const int i = __builtin_ctzll(bs);
+                if (i == 63) prev_escaped = 1;
+                else escaped |= uint64_t{2} << i;
+                bs &= ~(uint64_t{1} << i);
+                bs &= ~escaped;
+            }
+            const uint64_t quote = m.quote & ~escaped;
+            const uint64_t in_string = prefix_xor(quote) ^ prev_in_string;
+            prev_in_string = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+            const uint64_t scalar = ~(m.op | m.ws | quote) & ~in_string;
+            const uint64_t scalar_start = scalar & ~((scalar << 1) | prev_scalar);
+            prev_scalar = scalar >> 63;
+            uint64_t structural = (m.op & ~in_string) | (quote & in_string) | scalar_start;
+            const uint32_t at = static_cast<uint32_t>(base + b * 64);
+            while (structural) {
+                out.push_back(at + static_cast<uint32_t>(__builtin_ctzll(structural)));
+                structural &= structural - 1;
+            }
+        }
+    }
+    // Padding spaces never produce structurals, so no trimming is needed.
+    return prev_in_string == 0;
+}
+
+inline bool json_delim(char c) {
+    return c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// true/false/null, exactly, followed by a delimiter or the end of input.
+inline bool json_literal_ok(std::string_view text, size_t at) {
+    const std::string_view want = text[at] == 't' ? "true" : text[at] == 'f' ? "false" : "null";
+    if (text.substr(at, want.size()) != want) return false;
+    return at + want.size() == text.size() || json_delim(text[at + want.size()]);
+}
+
+} // namespace rs_detail
+
+namespace json {
+
+class Document {
+    std::string_view text;
+    std::vector<uint32_t> pos;  // byte offset of each structural
+    std::vector<uint32_t> jump; // for '{' / '[': index of the matching closer
+    mutable std::unordered_map<uint32_t, std::string> unescaped; // by structural index
+
+    friend class Value;
+
+    JsonError error(const char* msg, size_t k) const {
+        return JsonError{msg, k < pos.size() ? pos[k] : text.size()};
+    }
+    Result<Unit, JsonError> check_key(uint32_t k) const;
+
+    // Stage 1.5: grammar check over the structural index plus bracket
+    // matching, so navigation can skip subtrees in O(1). Keys are checked
+    // here too, so members() can always decode them; string values are
+    // checked when read.
+    Result<Unit, JsonError> validate() {
+        enum State { VALUE, ARRAY_FIRST, OBJECT_FIRST, KEY, COLON, AFTER };
+        std::vector<uint32_t> stack;
+        State state = VALUE;
+        jump.assign(pos.size(), 0);
+        for (size_t k = 0; k < pos.size(); ++k) {
+            const char c = text[pos[k]];
+            const bool closer = c == '}' || c == ']';
+            switch (state) {
+                case ARRAY_FIRST:
+                    if (c == ']') break;
+                    [[fallthrough]];
+                case VALUE:
+                    if (c == '{') { stack.push_back(static_cast<uint32_t>(k)); state = OBJECT_FIRST; continue; }
+                    if (c == '[') { stack.push_back(static_cast<uint32_t>(k)); state = ARRAY_FIRST; continue; }
+                    if (c == 't' || c == 'f' || c == 'n') {
+                        if (!rs_detail::json_literal_ok(text, pos[k])) return Err(error("invalid literal", k));
+                        state = AFTER;
+                        continue;
+                    }
+                    if (c == '"' || c == '-' || (c >= '0' && c <= '9')) {
+                        state = AFTER;
+                        continue;
+                    }
+                    return Err(error("expected value", k));
+                case OBJECT_FIRST:
+                    if (c == '}') break;
+                    [[fallthrough]];
+                case KEY: {
+                    if (c != '"') return Err(error("expected string key", k));
+                    auto key = check_key(static_cast<uint32_t>(k));
+                    if (key.is_err()) return key;
+                    state = COLON;
+                    continue;
+                }
+                case COLON:
+                    if (c != ':') return Err(error("expected ':'", k));
+                    state = VALUE;
+                    continue;
+                case AFTER:
+                    if (stack.empty()) return Err(error("trailing characters", k));
+                    if (c == ',') { state = text[pos[stack.back()]] == '{' ? KEY : VALUE; continue; }
+                    if (!closer) return Err(error("expected ',' or closing bracket", k));
+                    break;
+            }
+            // c closes the innermost container.
+            if (stack.empty() || (c == '}') != (text[pos[stack.back()]] == '{'))
+                return Err(error("mismatched closing bracket", k));
+            jump[stack.back()] = static_cast<uint32_t>(k);
+            stack.pop_back();
+            state = AFTER;
+        }
+        if (pos.empty()) return Err(error("empty document", 0));
+        if (state != AFTER || !stack.empty()) return Err(error("unexpected end of input", pos.size()));
+        return Ok();
+    }
+
+    Document() = default;
+public:
+    Document(Document&&) = default;
+    Document& operator=(Document&&) = default;
+
+    // Indexes and validates `input`. The Document borrows `input`.
+    static Result<Document, JsonError> parse(std::string_view input) {
+        Document doc;
+        doc.text = input;
+        if (input.size() >= UINT32_MAX) return Err(JsonError{"document too large", 0});
+        uint8_t err_len = 0;
+        const auto* bytes = reinterpret_cast<const uint8_t*>(input.data());
+        const size_t bad = rs_detail::utf8_validate(bytes, input.size(), err_len);
+        if (bad != input.size()) return Err(JsonError{"invalid utf-8", bad});
+        if (!rs_detail::json_index(bytes, input.size(), doc.pos)) {
+            return Err(JsonError{"unterminated string", input.size()});
+        }
+        auto res = doc.validate();
+        if (res.is_err()) return Err(std::move(res.unwrap_err()));
+        return Ok(std::move(doc));
+    }
+
+    Value root() const;
+    size_t structural_count() const { return pos.size(); }
+};
+
+class Value {
+    const Document* doc;
+    uint32_t k; // index into doc->pos
+
+    char lead() const { return doc->text[doc->pos[k]]; }
+    uint32_t next(uint32_t i) const {
+        const char c = doc->text[doc->pos[i]];
+        return (c == '{' || c == '[') ? doc->jump[i] + 1 : i + 1;
+    }
+    JsonError error(const char* msg) const { return JsonError{msg, doc->pos[k]}; }
+
+    // Raw bytes between the quotes of the string starting at structural i.
+    std::string_view raw_string(uint32_t i) const {
+        const size_t open = doc->pos[i];
+        size_t close = open + 1;
+        for (;;) {
+            close = doc->text.find('"', close);
+            size_t slashes = 0;
+            while (doc->text[close - 1 - slashes] == '\\') ++slashes;
+            if (slashes % 2 == 0) break;
+            ++close;
+        }
+        return doc->text.substr(open + 1, close - open - 1);
+    }
+    // Token text of a number or literal.
+    std::string_view scalar() const {
+        const size_t start = doc->pos[k];
+        size_t end = start;
+        const auto& t = doc->text;
+        while (end < t.size() && !rs_detail::json_delim(t[end])) ++end;
+        return t.substr(start, end - start);
+    }
+    Result<Str, JsonError> decode(uint32_t i) const;
+    Result<Unit, JsonError> unescape(uint32_t i, std::string_view raw, std::string& out) const;
+
+    friend class Document;
+public:
+    Value(const Document* d, uint32_t index) : doc(d), k(index) {}
+
+    JsonType type() const {
+        switch (lead()) {
+            case '{': return JsonType::Object;
+            case '[': return JsonType::Array;
+            case '"': return JsonType::String;
+            case 't': case 'f': return JsonType::Bool;
+            case 'n': return JsonType::Null;
+            default: return JsonType::Number;
+        }
+    }
+    bool is_null() const { return scalar() == "null"; }
+
+    // Raw JSON text of this value (the whole subtree for containers).
+    std::string_view raw() const {
+        const char c = lead();
+        if (c == '{' || c == '[') {
+            const size_t start = doc->pos[k];
+            return doc->text.substr(start, doc->pos[doc->jump[k]] - start + 1);
+        }
+        if (c == '"') {
+            const auto body = raw_string(k);
+            return doc->text.substr(doc->pos[k], body.size() + 2);
+        }
+        return scalar();
+    }
+
+    Result<Str, JsonError> get_str() const {
+        if (lead() != '"') return Err(error("expected string"));
+        return decode(k);
+    }
+    Result<bool, JsonError> get_bool() const {
+        const auto tok = scalar();
+        if (tok == "true") return Ok(true);
+        if (tok == "false") return Ok(false);
+        return Err(error("expected bool"));
+    }
+    template<typename T>
+    Result<T, JsonError> get() const {
+        if constexpr (std::is_same_v<T, bool>) {
+            return get_bool();
+        } else {
+            const auto tok = scalar();
+            if (type() != JsonType::Number) return Err(error("expected number"));
+            if (!rs_detail::json_number_ok(tok)) return Err(error("invalid number"));
+            auto res = parse<T>(tok);
+            if (res.is_err()) {
+                return Err(error(res.unwrap_err() == ParseError::OutOfRange ? "number out of range" : "invalid number"));
+            }
+            return Ok(*res);
+        }
+    }
+
+    // Object member by key; None if absent or if this is not an object.
+    Option<Value> field(std::string_view key) const {
+        if (lead() != '{') return None();
+        uint32_t i = k + 1;
+        const uint32_t end = doc->jump[k];
+        std::string scratch; // escaped keys decode here, not into the cache
+        while (i < end) {
+            const auto raw = raw_string(i);
+            bool hit;
+            if (raw.find('\\') == std::string_view::npos) {
+                hit = raw == key;
+            } else {
+                // Decoding never lengthens a string.
+                scratch.clear();
+                hit = key.size() <= raw.size() && unescape(i, raw, scratch).is_ok() && scratch == key;
+            }
+            if (hit) return Some(Value(doc, i + 2));
+            i = next(i + 2);
+            if (i < end) ++i; // skip ','
+        }
+        return None();
+    }
+    Option<Value> operator[](std::string_view key) const { return field(key); }
+
+    // Array element by position; None if out of range or not an array.
+    Option<Value> at(size_t index) const {
+        if (lead() != '[') return None();
+        uint32_t i = k + 1;
+        const uint32_t end = doc->jump[k];
+        for (size_t n = 0; i < end; ++n) {
+            if (n == index) return Some(Value(doc, i));
+            i = next(i);
+            if (i < end) ++i;
+        }
+        return None();
+    }
+
+    // RFC 6901 JSON Pointer, e.g. "/servers/0/port".
+    Option<Value> pointer(std::string_view path) const {
+        Value cur = *this;
+        while (!path.empty()) {
+            if (path.front() != '/') return None();
+            path.remove_prefix(1);
+            const size_t slash = path.find('/');
+            std::string token(path.substr(0, slash));
+            path = slash == std::string_view::npos ? std::string_view() : path.substr(slash);
+            for (size_t p = 0; (p = token.find('~', p)) != std::string::npos; ++p) {
+                if (p + 1 < token.size() && token[p + 1] == '1') token.replace(p, 2, "/");
+                else if (p + 1 < token.size() && token[p + 1] == '0') token.replace(p, 2, "~");
+            }
+            Option<Value> step = None();
+            if (cur.lead() == '{') {
+                step = cur.field(token);
+            } else if (cur.lead() == '[') {
+                // Only "0" or [1-9][0-9]*: no sign, no leading zero.
+                if (token.empty() || (token[0] == '0' && token.size() > 1)) return None();
+                for (const char c : token)
+                    if (c < '0' || c > '9') return None();
+                auto idx = parse<size_t>(token);
+                if (idx.is_err()) return None();
+                step = cur.at(*idx);
+            }
+            if (step.is_none()) return None();
+            cur = *step;
+        }
+        return Some(cur);
+    }
+
+    // Number of elements or members; 0 for scalars.
+    size_t size() const {
+        const char c = lead();
+        if (c != '{' && c != '[') return 0;
+        size_t n = 0;
+        for (uint32_t i = k + 1; i < doc->jump[k]; ++n) {
+            i = (c == '{') ? next(i + 2) : next(i);
+            if (i < doc->jump[k]) ++i;
+        }
+        return n;
+    }
+
+    // Forward iteration over array elements (`Value`) or object members
+    // (`Member`). Both skip nested containers through the bracket table.
+    template<bool IsObject>
+    class Range {
+        const Document* doc;
+        uint32_t first, last;
+    public:
+        Range(const Document* d, uint32_t f, uint32_t l) : doc(d), first(f), last(l) {}
+        class iterator {
+            const Document* doc;
+            uint32_t i, last;
+        public:
+            iterator(const Document* d, uint32_t idx, uint32_t l) : doc(d), i(idx), last(l) {}
+            auto operator*() const {
+                if constexpr (IsObject) {
+                    const Value key(doc, i);
+                    return Member{key.decode(i).expect("object keys are checked by Document::parse"),
+                                  Value(doc, i + 2)};
+                } else {
+                    return Value(doc, i);
+                }
+            }
+            iterator& operator++() {
+                i = Value(doc, i).next(IsObject ? i + 2 : i);
+                if (i < last) ++i; // skip ','
+                return *this;
+            }
+            bool operator==(const iterator& o) const { return i == o.i; }
+            bool operator!=(const iterator& o) const { return i != o.i; }
+        };
+        iterator begin() const { return iterator(doc, first, last); }
+        iterator end() const { return iterator(doc, last, last); }
+    };
+    // Empty ranges for values of the wrong type.
+    Range<false> elements() const {
+        if (lead() != '[') return Range<false>(doc, 0, 0);
+        return Range<false>(doc, k + 1, doc->jump[k]);
+    }
+    Range<true> members() const {
+        if (lead() != '{') return Range<true>(doc, 0, 0);
+        return Range<true>(doc, k + 1, doc->jump[k]);
+    }
+};
+
+struct Member {
+    Str key;
+    Value value;
+};
+
+inline Value Document::root() const { return Value(this, 0); }
+
+// Rejects a key that decode() would: raw control characters, bad escapes
+// and unpaired surrogates.
+inline Result<Unit, JsonError> Document::check_key(uint32_t k) const {
+    // Plain keys take one pass; a backslash hands over to unescape().
+    for (size_t j = pos[k] + 1;; ++j) {
+        const auto c = static_cast<unsigned char>(text[j]);
+        if (c == '"') return Ok();
+        if (c < 0x20) return Err(JsonError{"control character in string", pos[k]});
+        if (c == '\\') break;
+    }
+    const Value v(this, k);
+    std::string scratch;
+    return v.unescape(k, v.raw_string(k), scratch);
+}
+
+// Borrowed view when the string has no escapes; otherwise decoded on first
+// use and cached under structural index i, so repeated reads of the same
+// string share one copy.
+inline Result<Str, JsonError> Value::decode(uint32_t i) const {
+    const auto raw = raw_string(i);
+    if (raw.find('\\') == std::string_view::npos) {
+        for (char c : raw) {
+            if (static_cast<unsigned char>(c) < 0x20) return Err(JsonError{"control character in string", doc->pos[i]});
+        }
+        return Ok(Str::from_utf8_unchecked(raw));
+    }
+    if (auto hit = doc->unescaped.find(i); hit != doc->unescaped.end()) return Ok(Str::from_utf8_unchecked(hit->second));
+    std::string out;
+    auto res = unescape(i, raw, out);
+    if (res.is_err()) return Err(std::move(res.unwrap_err()));
+    // unordered_map nodes are stable, so earlier views stay valid on rehash.
+    const auto& stored = doc->unescaped.emplace(i, std::move(out)).first->second;
+    return Ok(Str::from_utf8_unchecked(stored));
+}
+
+// Appends the decoded form of `raw`, the body of the string at structural i.
+inline Result<Unit, JsonError> Value::unescape(uint32_t i, std::string_view raw, std::string& out) const {
+    out.reserve(out.size() + raw.size());
+    auto hex4 = [](std::string_view h, uint32_t& cp) {
+        if (h.size() < 4) return false;
+        cp = 0;
+        for (size_t j = 0; j < 4; ++j) {
+            const char c = h[j];
+            cp <<= 4;
+            if (c >= '0' && c <= '9') cp |= static_cast<uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f') cp |= static_cast<uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') cp |= static_cast<uint32_t>(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    };
+    const JsonError bad{"invalid escape", doc->pos[i]};
+    for (size_t j = 0; j < raw.size(); ++j) {
+        const char c = raw[j];
+        if (static_cast<unsigned char>(c) < 0x20) return Err(JsonError{"control character in string", doc->pos[i]});
+        if (c != '\\') { out.push_back(c); continue; }
+        if (++j >= raw.size()) return Err(bad);
+        switch (raw[j]) {
+            case '"': out.push_back('"'); break;
+            case '\\': out.push_back('\\'); break;
+            case '/': out.push_back('/'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': {
+                uint32_t cp;
+                if (!hex4(raw.substr(j + 1), cp)) return Err(bad);
+                j += 4;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    uint32_t lo;
+                    if (raw.substr(j + 1, 2) != "\\u" || !hex4(raw.substr(j + 3), lo) || lo < 0xDC00 || lo > 0xDFFF)
+                        return Err(bad);
+                    j += 6;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                    return Err(bad);
+                }
+                char buf[4];
+                size_t len;
+                if (cp < 0x80) { buf[0] = static_cast<char>(cp); len = 1; }
+                else if (cp < 0x800) {
+                    buf[0] = static_cast<char>(0xC0 | (cp >> 6));
+                    buf[1] = static_cast<char>(0x80 | (cp & 0x3F));
+                    len = 2;
+                } else if (cp < 0x10000) {
+                    buf[0] = static_cast<char>(0xE0 | (cp >> 12));
+                    buf[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                    buf[2] = static_cast<char>(0x80 | (cp & 0x3F));
+                    len = 3;
+                } else {
+                    buf[0] = static_cast<char>(0xF0 | (cp >> 18));
+                    buf[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                    buf[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                    buf[3] = static_cast<char>(0x80 | (cp & 0x3F));
+                    len = 4;
+                }
+                out.append(buf, len);
+                break;
+            }
+            default: return Err(bad);
+        }
+    }
+    return Ok();
+}
+
+} // namespace json
+
+#endif // ENABLE_RS_TEXT
+
+// ==========================================
+// 6. I/O (files, mmap)
+// ==========================================
+// Requires: ENABLE_RS_IO (+ ENABLE_RS_TEXT, POSIX)
+//
+// File access without iostreams and without exceptions:
+// - `fs::read(path)`           -> Result<Vec<u8>, IoError>, one allocation
+//   sized from fstat, read(2) straight into it.
+// - `fs::read_to_string(path)` -> Result<String, IoError>; invalid UTF-8 is
+//   reported as IoErrorKind::InvalidData.
+// - `Mmap::open(path, advice)` -> Result<Mmap, IoError>, a read-only mapping
+//   with madvise hints. `as_slice()` / `as_str()` return borrowed views.
+//
+// Lifetimes: views from an Mmap borrow the mapping exactly like Rust's &[u8];
+// they dangle once the Mmap is destroyed. The view accessors are deleted on
+// rvalue Mmaps, which rejects `make_map().as_slice()`. That does not cover
+// every temporary: `Mmap::open(p).unwrap().as_slice()` compiles (unwrap()
+// returns an lvalue into the temporary Result) and still dangles. Keep the
+// Mmap in a named variable for as long as its views are used.
+//
+// Example:
+//   let map = Mmap::open("big.log");
+//   if (map) {
+//       for (u8 b : map->as_slice()) { ... }   // zero-copy
+//   }
+#if defined(ENABLE_RS_IO) && defined(RS_POSIX)
+
+enum class IoErrorKind {
+    NotFound,
+    PermissionDenied,
+    AlreadyExists,
+    InvalidInput,
+    InvalidData,
+    UnexpectedEof,
+    WriteZero,
+    Interrupted,
+    WouldBlock,
+    BrokenPipe,
+    Other,
+};
+
+class IoError {
+    IoErrorKind kind_;
+    int code_; // errno, 0 for errors raised by rustic itself
+    std::string msg;
+
+    static IoErrorKind kind_of(int code) {
+        switch (code) {
+            case ENOENT: return IoErrorKind::NotFound;
+            case EACCES: case EPERM: return IoErrorKind::PermissionDenied;
+            case EEXIST: return IoErrorKind::AlreadyExists;
+            case EINVAL: return IoErrorKind::InvalidInput;
+            case EINTR: return IoErrorKind::Interrupted;
+            case EAGAIN: return IoErrorKind::WouldBlock;
+            case EPIPE: return IoErrorKind::BrokenPipe;
+            default: return IoErrorKind::Other;
+        }
+    }
+public:
+    explicit IoError(int os_code) : kind_(kind_of(os_code)), code_(os_code) {}
+    IoError(IoErrorKind kind, std::string message) : kind_(kind), code_(0), msg(std::move(message)) {}
+
+    static IoError last_os_error() { return IoError(errno); }
+
+    IoErrorKind kind() const { return kind_; }
+    Option<int> raw_os_error() const {
+        if (code_ == 0) return None();
+        return Some(code_);
+    }
+    std::string to_string() const {
+        if (code_ != 0) return std::string(std::strerror(code_)) + " (os error " + std::to_string(code_) + ")";
+        return msg;
+    }
+    friend std::ostream& operator<<(std::ostream& os, const IoError& e) { return os << e.to_string(); }
+};
+
+namespace rs_detail {
+
+// Owns a file descriptor for the duration of a call.
+struct FdGuard {
+    int fd;
+    explicit FdGuard(int f) : fd(f) {}
+    FdGuard(const FdGuard&) = delete;
+    FdGuard& operator=(const FdGuard&) = delete;
+    ~FdGuard() { if (fd >= 0) ::close(fd); }
+};
+
+// Reads the whole file into `buf` (std::string or std::vector<uint8_t>). The
+// buffer is sized once from fstat; files that report size 0 (procfs, pipes)
+// fall back to doubling.
+template<typename Buf>
+inline Result<Unit, IoError> read_all(const std::string& path, Buf& buf) {
+    FdGuard file(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (file.fd < 0) return Err(IoError::last_os_error());
+    struct stat st{};
+    if (::fstat(file.fd, &st) != 0) return Err(IoError::last_os_error());
+
+    size_t cap = st.st_size > 0 ? static_cast<size_t>(st.st_size) : 4096;
+    buf.resize(cap);
+    size_t len = 0;
+    for (;;) {
+        // A full buffer usually means EOF; probe through a small stack buffer
+        // so exactly-sized files never pay for a grown allocation.
+        uint8_t probe[512];
+        const bool full = len == cap;
+        auto* dst = full ? probe : reinterpret_cast<uint8_t*>(buf.data()) + len;
+        const ssize_t got = ::read(file.fd, dst, full ? sizeof(probe) : cap - len);
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            return Err(IoError::last_os_error());
+        }
+        if (got == 0) break;
+        if (full) {
+            cap *= 2;
+            buf.resize(cap);
+            std::memcpy(buf.data() + len, probe, static_cast<size_t>(got));
+        }
+        len += static_cast<size_t>(got);
+    }
+    buf.resize(len);
+    return Ok();
+}
+
+} // namespace rs_detail
+
+namespace fs {
+
+inline Result<std::vector<uint8_t>, IoError> read(const std::string& path) {
+    std::vector<uint8_t> buf;
+    auto res = rs_detail::read_all(path, buf);
+    if (res.is_err()) return Err(std::move(res.unwrap_err()));
+    return Ok(std::move(buf));
+}
+
+inline Result<std::string, IoError> read_to_string(const std::string& path) {
+    std::string buf;
+    auto res = rs_detail::read_all(path, buf);
+    if (res.is_err()) return Err(std::move(res.unwrap_err()));
+    if (!is_utf8(buf)) return Err(IoError(IoErrorKind::InvalidData, "stream did not contain valid UTF-8"));
+    return Ok(std::move(buf));
+}
+
+} // namespace fs
+
+// --- Mmap ---
+enum class Advice { Normal, Sequential, Random, WillNeed, DontNeed };
+
+class Mmap {
+    const uint8_t* ptr = nullptr;
+    size_t size = 0;
+
+    Mmap(const uint8_t* p, size_t n) : ptr(p), size(n) {}
+
+    static int advice_flag(Advice a) {
+        switch (a) {
+            case Advice::Sequential: return MADV_SEQUENTIAL;
+            case Advice::Random: return MADV_RANDOM;
+            case Advice::WillNeed: return MADV_WILLNEED;
+            case Advice::DontNeed: return MADV_DONTNEED;
+            default: return MADV_NORMAL;
+        }
+    }
+public:
+    Mmap() = default;
+    Mmap(const Mmap&) = delete;
+    Mmap& operator=(const Mmap&) = delete;
+    Mmap(Mmap&& o) noexcept : ptr(std::exchange(o.ptr, nullptr)), size(std::exchange(o.size, 0)) {}
+    Mmap& operator=(Mmap&& o) noexcept {
+        if (this != &o) {
+            unmap();
+            ptr = std::exchange(o.ptr, nullptr);
+            size = std::exchange(o.size, 0);
+        }
+        return *this;
+    }
+    ~Mmap() { unmap(); }
+
+    // Maps the whole file read-only. Empty files yield an empty mapping.
+    // Files that report size 0 but have content (procfs, sysfs) cannot be
+    // mapped and give InvalidInput; read them with fs::read instead.
+    static Result<Mmap, IoError> open(const std::string& path, Advice advice = Advice::Sequential) {
+        rs_detail::FdGuard file(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        if (file.fd < 0) return Err(IoError::last_os_error());
+        struct stat st{};
+        if (::fstat(file.fd, &st) != 0) return Err(IoError::last_os_error());
+        if (st.st_size == 0) {
+            uint8_t probe;
+            ssize_t got;
+            while ((got = ::read(file.fd, &probe, 1)) < 0 && errno == EINTR) {}
+            if (got < 0) return Err(IoError::last_os_error());
+            if (got > 0) return Err(IoError(IoErrorKind::InvalidInput, "file reports size 0 but has content; use fs::read"));
+            return Ok(Mmap());
+        }
+
+        const size_t n = static_cast<size_t>(st.st_size);
+        void* p = ::mmap(nullptr, n, PROT_READ, MAP_PRIVATE, file.fd, 0);
+        if (p == MAP_FAILED) return Err(IoError::last_os_error());
+        Mmap map(static_cast<const uint8_t*>(p), n);
+        if (advice != Advice::Normal) map.advise(advice);
+        return Ok(std::move(map));
+    }
+
+    // Re-hints the kernel for a byte range (whole mapping by default).
+    Result<Unit, IoError> advise(Advice advice, size_t offset = 0, size_t len = SIZE_MAX) {
+        if (!ptr || offset >= size) return Ok();
+        // madvise wants a page-aligned start.
+        const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        const size_t start = offset - offset % page;
+        const size_t end = (len >= size - offset) ? size : offset + len;
+        void* addr = const_cast<uint8_t*>(ptr + start);
+        if (::madvise(addr, end - start, advice_flag(advice)) != 0) return Err(IoError::last_os_error());
+        return Ok();
+    }
+
+    size_t len() const { return size; }
+    bool is_empty() const { return size == 0; }
+    const uint8_t* data() const { return ptr; }
+
+    std::span<const uint8_t> as_slice() const& { return {ptr, size}; }
+    std::span<const uint8_t> as_slice() const&& = delete;
+    Result<Str, Utf8Error> as_str() const& {
+        return Str::from_utf8(std::string_view(reinterpret_cast<const char*>(ptr), size));
+    }
+    Result<Str, Utf8Error> as_str() const&& = delete;
+
+private:
+    void unmap() {
+        if (ptr) ::munmap(const_cast<uint8_t*>(ptr), size);
+        ptr = nullptr;
+        size = 0;
+    }
+};
+
+#endif // ENABLE_RS_IO
+
+// --- Read / Write / BufRead ---
+// Rust's std::io traits expressed with the object-model macros, so they need
+// ENABLE_RS_OBJECT as well. Every call returns Result<usize, IoError>-style
+// values; nothing throws.
+//
+// Implementations:
+// - `File`        : an owned file descriptor (open/create/from_raw_fd).
+// - `Pipe`        : `Pipe::create()` gives a connected reader/writer File pair.
+// - `SliceReader` : reads from a borrowed Slice<u8> (Rust's `&[u8]`).
+// - `VecWriter`   : appends to an owned Vec<u8> (Rust's `Vec<u8>`).
+// - `BufReader<R>`/`BufWriter<W>`: buffering adapters over any of the above.
+//
+// BufRead::read_line appends to a caller-owned String, so a loop that clears
+// and reuses one String never allocates per line. `lines()` does the same
+// internally and yields Result<Str, IoError> views that stay valid until the
+// next iteration. BufWriter hands large writes to the inner writer together
+// with its pending buffer in one write_vectored call (writev for files).
+//
+// Example:
+//   let_mut file = File::open("access.log");
+//   if (file.is_err()) return Err(file.unwrap_err());
+//   BufReader reader(std::move(*file));
+//   for (const auto& line : reader.lines()) {
+//       if (line.is_err()) break;
+//       handle(*line);
+//   }
+#if defined(ENABLE_RS_IO) && defined(RS_POSIX) && defined(ENABLE_RS_OBJECT)
+
+trait(Read,
+    must(read(std::span<uint8_t> buf) -> Result<size_t, IoError>);
+
+    // Fills the whole buffer or fails with UnexpectedEof.
+    def(read_exact(std::span<uint8_t> buf) -> Result<Unit, IoError>) {
+        while (!buf.empty()) {
+            auto res = read(buf);
+            if (res.is_err()) {
+                if (res.unwrap_err().kind() == IoErrorKind::Interrupted) continue;
+                return Err(std::move(res.unwrap_err()));
+            }
+            if (*res == 0) return Err(IoError(IoErrorKind::UnexpectedEof, "failed to fill whole buffer"));
+            buf = buf.subspan(*res);
+        }
+        return Ok();
+    }
+
+    // Appends everything up to EOF and returns the number of bytes read.
+    def(read_to_end(std::vector<uint8_t>& out) -> Result<size_t, IoError>) {
+        const size_t start = out.size();
+        size_t len = start;
+        for (;;) {
+            if (out.size() - len < 4096) out.resize(len + std::max<size_t>(8192, len - start));
+            auto res = read(std::span<uint8_t>(out.data() + len, out.size() - len));
+            if (res.is_err()) {
+                if (res.unwrap_err().kind() == IoErrorKind::Interrupted) continue;
+                out.resize(len);
+                return Err(std::move(res.unwrap_err()));
+            }
+            if (*res == 0) break;
+            len += *res;
+        }
+        out.resize(len);
+        return Ok(len - start);
+    }
+);
+
+trait(Write,
+    must(write(std::span<const uint8_t> buf) -> Result<size_t, IoError>);
+
+    // Default: write the first non-empty buffer. File overrides with writev.
+    def(write_vectored(std::span<const std::span<const uint8_t>> bufs) -> Result<size_t, IoError>) {
+        for (const auto& b : bufs) {
+            if (!b.empty()) return write(b);
+        }
+        return Ok(size_t{0});
+    }
+
+    def(flush() -> Result<Unit, IoError>) { return Ok(); }
+
+    def(write_all(std::span<const uint8_t> buf) -> Result<Unit, IoError>) {
+        while (!buf.empty()) {
+            auto res = write(buf);
+            if (res.is_err()) {
+                if (res.unwrap_err().kind() == IoErrorKind::Interrupted) continue;
+                return Err(std::move(res.unwrap_err()));
+            }
+            if (*res == 0) return Err(IoError(IoErrorKind::WriteZero, "failed to write whole buffer"));
+            buf = buf.subspan(*res);
+        }
+        return Ok();
+    }
+
+    // Writes every buffer, advancing `bufs` in place across partial writes.
+    def(write_all_vectored(std::span<std::span<const uint8_t>> bufs) -> Result<Unit, IoError>) {
+        while (!bufs.empty() && bufs.front().empty()) bufs = bufs.subspan(1);
+        while (!bufs.empty()) {
+            auto res = write_vectored(bufs);
+            if (res.is_err()) {
+                if (res.unwrap_err().kind() == IoErrorKind::Interrupted) continue;
+                return Err(std::move(res.unwrap_err()));
+            }
+            size_t n = *res;
+            if (n == 0) return Err(IoError(IoErrorKind::WriteZero, "failed to write whole buffer"));
+            while (!bufs.empty() && n >= bufs.front().size()) {
+                n -= bufs.front().size();
+                bufs = bufs.subspan(1);
+            }
+            if (!bufs.empty()) bufs.front() = bufs.front().subspan(n);
+            while (!bufs.empty() && bufs.front().empty()) bufs = bufs.subspan(1);
+        }
+        return Ok();
+    }
+
+    def(write_str(std::string_view s) -> Result<Unit, IoError>) {
+        return write_all(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(s.data()), s.size()));
+    }
+);
+
+class Lines;
+
+trait(BufRead,
+    // Returns the buffered bytes, refilling from the source when empty. An
+    // empty span means EOF.
+    must(fill_buf() -> Result<std::span<const uint8_t>, IoError>);
+    must(consume(size_t amt) -> void);
+
+    // Appends bytes up to and including `delim`; returns the count appended.
+    def(read_until(uint8_t delim, std::vector<uint8_t>& out) -> Result<size_t, IoError>) {
+        return append_until(delim, out);
+    }
+
+    // Appends one line (including the '\n') to `out`. Invalid UTF-8 is rolled
+    // back and reported as InvalidData.
+    def(read_line(std::string& out) -> Result<size_t, IoError>) {
+        const size_t start = out.size();
+        auto res = append_until('\n', out);
+        if (res.is_ok() && !is_utf8(std::string_view(out).substr(start))) {
+            out.resize(start);
+            return Err(IoError(IoErrorKind::InvalidData, "stream did not contain valid UTF-8"));
+        }
+        return res;
+    }
+
+    Lines lines();
+
+    inner:
+    template<typename Buf>
+    auto append_until(uint8_t delim, Buf& out) -> Result<size_t, IoError> {
+        size_t total = 0;
+        for (;;) {
+            auto avail = fill_buf();
+            if (avail.is_err()) {
+                if (avail.unwrap_err().kind() == IoErrorKind::Interrupted) continue;
+                return Err(std::move(avail.unwrap_err()));
+            }
+            const auto chunk = *avail;
+            if (chunk.empty()) return Ok(total);
+            const void* hit = std::memchr(chunk.data(), delim, chunk.size());
+            const size_t take = hit ? static_cast<size_t>(static_cast<const uint8_t*>(hit) - chunk.data()) + 1
+                                    : chunk.size();
+            out.insert(out.end(), chunk.data(), chunk.data() + take);
+            consume(take);
+            total += take;
+            if (hit) return Ok(total);
+        }
+    }
+);
+
+// Iterates lines through one reused String. Each item borrows that String and
+// is valid until the iterator advances; trailing "\n" / "\r\n" is stripped.
+class Lines {
+    BufRead* src;
+    std::string line;
+    Result<Str, IoError> current = Ok(Str());
+    bool done = false;
+    bool failed = false;
+
+    void advance() {
+        if (failed) { done = true; return; }
+        line.clear();
+        auto res = src->read_line(line);
+        if (res.is_err()) {
+            current = Err(std::move(res.unwrap_err()));
+            failed = true;
+            return;
+        }
+        if (*res == 0) { done = true; return; }
+        if (!line.empty() && line.back() == '\n') line.pop_back();
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        current = Ok(Str::from_utf8_unchecked(line));
+    }
+public:
+    explicit Lines(BufRead& r) : src(&r) {}
+
+    class iterator {
+        Lines* owner;
+    public:
+        explicit iterator(Lines* o) : owner(o) {}
+        const Result<Str, IoError>& operator*() const { return owner->current; }
+        iterator& operator++() { owner->advance(); return *this; }
+        bool operator==(std::default_sentinel_t) const { return owner->done; }
+        bool operator!=(std::default_sentinel_t) const { return !owner->done; }
+    };
+    iterator begin() { advance(); return iterator(this); }
+    std::default_sentinel_t end() { return {}; }
+};
+
+inline Lines BufRead::lines() { return Lines(*this); }
+
+// --- File / Pipe ---
+class File : from Read, from Write {
+    int fd = -1;
+
+    static Result<File, IoError> open_with(const std::string& path, int flags) {
+        const int f = ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+        if (f < 0) return Err(IoError::last_os_error());
+        return Ok(File(f));
+    }
+public:
+    // Takes ownership of `owned_fd`; it is closed on destruction.
+    explicit File(int owned_fd) : fd(owned_fd) {}
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+    File(File&& o) noexcept : fd(std::exchange(o.fd, -1)) {}
+    File& operator=(File&& o) noexcept {
+        if (this != &o) {
+            if (fd >= 0) ::close(fd);
+            fd = std::exchange(o.fd, -1);
+        }
+        return *this;
+    }
+    ~File() override { if (fd >= 0) ::close(fd); }
+
+    static Result<File, IoError> open(const std::string& path) { return open_with(path, O_RDONLY); }
+    static Result<File, IoError> create(const std::string& path) {
+        return open_with(path, O_WRONLY | O_CREAT | O_TRUNC);
+    }
+    static Result<File, IoError> append(const std::string& path) {
+        return open_with(path, O_WRONLY | O_CREAT | O_APPEND);
+    }
+    static File from_raw_fd(int owned_fd) { return File(owned_fd); }
+    int as_raw_fd() const { return fd; }
+
+    impl(read(std::span<uint8_t> buf) -> Result<size_t, IoError>) {
+        const ssize_t n = ::read(fd, buf.data(), buf.size());
+        if (n < 0) return Err(IoError::last_os_error());
+        return Ok(static_cast<size_t>(n));
+    }
+    impl(write(std::span<const uint8_t> buf) -> Result<size_t, IoError>) {
+        const ssize_t n = ::write(fd, buf.data(), buf.size());
+        if (n < 0) return Err(IoError::last_os_error());
+        return Ok(static_cast<size_t>(n));
+    }
+    impl(write_vectored(std::span<const std::span<const uint8_t>> bufs) -> Result<size_t, IoError>) {
+        constexpr size_t max_iov = 64;
+        iovec iov[max_iov];
+        const size_t cnt = std::min(bufs.size(), max_iov);
+        for (size_t i = 0; i < cnt; ++i) {
+            iov[i].iov_base = const_cast<uint8_t*>(bufs[i].data());
+            iov[i].iov_len = bufs[i].size();
+        }
+        const ssize_t n = ::writev(fd, iov, static_cast<int>(cnt));
+        if (n < 0) return Err(IoError::last_os_error());
+        return Ok(static_cast<size_t>(n));
+    }
+    impl(flush() -> Result<Unit, IoError>) { return Ok(); } // unbuffered
+};
+
+struct Pipe {
+    File reader;
+    File writer;
+
+    static Result<Pipe, IoError> create() {
+        int fds[2];
+#ifdef __linux__
+        // Atomic close-on-exec: a fork+exec in another thread cannot inherit them.
+        if (::pipe2(fds, O_CLOEXEC) != 0) return Err(IoError::last_os_error());
+#else
+        if (::pipe(fds) != 0) return Err(IoError::last_os_error());
+        ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+        return Ok(Pipe{File(fds[0]), File(fds[1])});
+    }
+};
+
+// --- In-memory ---
+class SliceReader : from Read, from BufRead {
+    std::span<const uint8_t> rest;
+public:
+    explicit SliceReader(std::span<const uint8_t> data) : rest(data) {}
+    explicit SliceReader(std::string_view data)
+        : rest(reinterpret_cast<const uint8_t*>(data.data()), data.size()) {}
+
+    std::span<const uint8_t> remaining() const { return rest; }
+
+    impl(read(std::span<uint8_t> buf) -> Result<size_t, IoError>) {
+        const size_t n = std::min(buf.size(), rest.size());
+        if (n) std::memcpy(buf.data(), rest.data(), n);
+        rest = rest.subspan(n);
+        return Ok(n);
+    }
+    impl(fill_buf() -> Result<std::span<const uint8_t>, IoError>) { return Ok(rest); }
+    impl(consume(size_t amt) -> void) { rest = rest.subspan(std::min(amt, rest.size())); }
+};
+
+class VecWriter : from Write {
+    std::vector<uint8_t> buf;
+public:
+    VecWriter() = default;
+    explicit VecWriter(std::vector<uint8_t> initial) : buf(std::move(initial)) {}
+
+    std::span<const uint8_t> as_slice() const { return buf; }
+    std::vector<uint8_t> into_inner() && { return std::move(buf); }
+
+    impl(write(std::span<const uint8_t> data) -> Result<size_t, IoError>) {
+        buf.insert(buf.end(), data.begin(), data.end());
+        return Ok(data.size());
+    }
+    impl(write_vectored(std::span<const std::span<const uint8_t>> bufs) -> Result<size_t, IoError>) {
+        size_t total = 0;
+        for (const auto& b : bufs) total += b.size();
+        buf.reserve(buf.size() + total);
+        for (const auto& b : bufs) buf.insert(buf.end(), b.begin(), b.end());
+        return Ok(total);
+    }
+};
+
+// --- BufReader / BufWriter ---
+template<typename R>
+class BufReader : from Read, from BufRead {
+    R src;
+    std::vector<uint8_t> buf;
+    size_t pos = 0;
+    size_t filled = 0;
+public:
+    explicit BufReader(R reader, size_t capacity = 8192) : src(std::move(reader)), buf(capacity) {}
+
+    R& get_ref() { return src; }
+    R into_inner() && { return std::move(src); }
+    std::span<const uint8_t> buffer() const { return {buf.data() + pos, filled - pos}; }
+
+    impl(read(std::span<uint8_t> out) -> Result<size_t, IoError>) {
+        // Large reads into an empty buffer skip the copy entirely.
+        if (pos == filled && out.size() >= buf.size()) return src.read(out);
+        auto avail = fill_buf();
+        if (avail.is_err()) return Err(std::move(avail.unwrap_err()));
+        const size_t n = std::min(out.size(), avail->size());
+        if (n) std::memcpy(out.data(), avail->data(), n);
+        consume(n);
+        return Ok(n);
+    }
+    impl(fill_buf() -> Result<std::span<const uint8_t>, IoError>) {
+        if (pos == filled) {
+            auto res = src.read(std::span<uint8_t>(buf));
+            if (res.is_err()) return Err(std::move(res.unwrap_err()));
+            pos = 0;
+            filled = *res;
+        }
+        return Ok(std::span<const uint8_t>(buf.data() + pos, filled - pos));
+    }
+    impl(consume(size_t amt) -> void) { pos = std::min(pos + amt, filled); }
+};
+
+template<typename W>
+class BufWriter : from Write {
+    W dst;
+    std::vector<uint8_t> buf;
+    size_t cap;
+
+    // Writes the pending bytes. On error the unwritten tail stays buffered, so
+    // a later flush() retries it instead of losing it.
+    Result<Unit, IoError> flush_buf() {
+        size_t done = 0;
+        Result<Unit, IoError> res = Ok();
+        while (done < buf.size()) {
+            auto n = dst.write(std::span<const uint8_t>(buf).subspan(done));
+            if (n.is_err()) {
+                if (n.unwrap_err().kind() == IoErrorKind::Interrupted) continue;
+                res = Err(std::move(n.unwrap_err()));
+                break;
+            }
+            if (*n == 0) {
+                res = Err(IoError(IoErrorKind::WriteZero, "failed to write the buffered data"));
+                break;
+            }
+            done += *n;
+        }
+        buf.erase(buf.begin(), buf.begin() + static_cast<std::ptrdiff_t>(done));
+        return res;
+    }
+public:
+    explicit BufWriter(W writer, size_t capacity = 8192) : dst(std::move(writer)), cap(capacity) {
+        buf.reserve(capacity);
+    }
+    BufWriter(BufWriter&&) = default;
+    // Errors during the final flush are ignored, as in Rust; call flush() to
+    // observe them.
+    ~BufWriter() override { (void)flush_buf(); }
+
+    W& get_ref() { return dst; }
+    std::span<const uint8_t> buffer() const { return buf; }
+
+    impl(write(std::span<const uint8_t> data) -> Result<size_t, IoError>) {
+        if (buf.size() + data.size() <= cap) {
+            buf.insert(buf.end(), data.begin(), data.end());
+            return Ok(data.size());
+        }
+        if (data.size() >= cap) {
+            // Pending bytes and the large payload leave in one vectored call.
+            // Returns how much of `data` went out; a failure before any of it
+            // did is an Err, with the unwritten pending bytes kept.
+            size_t pending_done = 0, data_done = 0;
+            while (data_done < data.size()) {
+                std::span<const uint8_t> parts[2] = {std::span<const uint8_t>(buf).subspan(pending_done),
+                                                     data.subspan(data_done)};
+                auto n = dst.write_vectored(parts);
+                Option<IoError> failed = None();
+                if (n.is_err()) {
+                    if (n.unwrap_err().kind() == IoErrorKind::Interrupted) continue;
+                    failed = Option<IoError>(std::move(n.unwrap_err()));
+                } else if (*n == 0) {
+                    failed = Option<IoError>(IoError(IoErrorKind::WriteZero, "failed to write whole buffer"));
+                }
+                if (failed) {
+                    buf.erase(buf.begin(), buf.begin() + static_cast<std::ptrdiff_t>(pending_done));
+                    if (data_done > 0) return Ok(data_done);
+                    return Err(std::move(*failed));
+                }
+                const size_t from_buf = std::min(*n, buf.size() - pending_done);
+                pending_done += from_buf;
+                data_done += *n - from_buf;
+            }
+            buf.clear();
+            return Ok(data.size());
+        }
+        auto res = flush_buf();
+        if (res.is_err()) return Err(std::move(res.unwrap_err()));
+        buf.insert(buf.end(), data.begin(), data.end());
+        return Ok(data.size());
+    }
+    impl(flush() -> Result<Unit, IoError>) {
+        auto res = flush_buf();
+        if (res.is_err()) return res;
+        return dst.flush();
+    }
+};
+
+#endif // ENABLE_RS_IO && ENABLE_RS_OBJECT
+
+// --- Bytes / BytesMut ---
+// Reference-counted byte buffers in the style of Rust's `bytes` crate.
+// - `Bytes`: immutable view into shared storage. Copying bumps an atomic
+//   refcount; `slice()`, `split_to()` and `split_off()` are O(1) and never copy.
+// - `BytesMut`: uniquely owned, growable builder. `freeze()` turns it into
+//   Bytes by handing over the storage, and `split_to()`/`split()` carve off
+//   filled prefixes while the remaining capacity stays writable.
+// Out-of-range indices panic, matching Vec/slice indexing in Rust.
+//
+// Example:
+//   BytesMut buf = BytesMut::with_capacity(4096);
+//   buf.put(header); buf.put(body);
+//   Bytes frame = buf.split().freeze();     // no copy
+//   Bytes head = frame.slice(0, 16);        // shares frame's storage
+#ifdef ENABLE_RS_IO
+
+namespace rs_detail {
+
+// Storage header shared by every Bytes/BytesMut that points into it.
+struct BytesShared {
+    std::atomic<size_t> refs{1};
+    void (*drop)(BytesShared*);
+
+    void retain() { refs.fetch_add(1, std::memory_order_relaxed); }
+    void release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) drop(this);
+    }
+};
+
+// Header and bytes in one allocation.
+inline BytesShared* bytes_alloc(size_t cap, uint8_t*& data) {
+    void* raw = ::operator new(sizeof(BytesShared) + cap);
+    auto* hdr = new (raw) BytesShared{};
+    hdr->drop = [](BytesShared* h) {
+        h->~BytesShared();
+        ::operator delete(static_cast<void*>(h));
+    };
+    data = reinterpret_cast<uint8_t*>(hdr + 1);
+    return hdr;
+}
+
+// Adopts an existing vector without copying its contents.
+struct VecShared : BytesShared {
+    std::vector<uint8_t> vec;
+};
+
+} // namespace rs_detail
+
+class Bytes {
+    const uint8_t* ptr = nullptr;
+    size_t size = 0;
+    rs_detail::BytesShared* shared = nullptr; // null for static data
+
+    Bytes(const uint8_t* p, size_t n, rs_detail::BytesShared* s) : ptr(p), size(n), shared(s) {}
+    friend class BytesMut;
+public:
+    Bytes() = default;
+    Bytes(const Bytes& o) : ptr(o.ptr), size(o.size), shared(o.shared) {
+        if (shared) shared->retain();
+    }
+    Bytes(Bytes&& o) noexcept
+        : ptr(std::exchange(o.ptr, nullptr)), size(std::exchange(o.size, 0)),
+          shared(std::exchange(o.shared, nullptr)) {}
+    Bytes& operator=(Bytes o) noexcept {
+        std::swap(ptr, o.ptr);
+        std::swap(size, o.size);
+        std::swap(shared, o.shared);
+        return *this;
+    }
+    ~Bytes() { if (shared) shared->release(); }
+
+    // Borrows data that outlives every Bytes made from it (string literals).
+    static Bytes from_static(std::string_view s) {
+        return Bytes(reinterpret_cast<const uint8_t*>(s.data()), s.size(), nullptr);
+    }
+    static Bytes copy_from_slice(std::span<const uint8_t> s) {
+        uint8_t* data = nullptr;
+        auto* hdr = rs_detail::bytes_alloc(s.size(), data);
+        if (!s.empty()) std::memcpy(data, s.data(), s.size());
+        return Bytes(data, s.size(), hdr);
+    }
+    // Takes ownership of the vector's buffer.
+    static Bytes from_vec(std::vector<uint8_t>&& v) {
+        auto* hdr = new rs_detail::VecShared{};
+        hdr->drop = [](rs_detail::BytesShared* h) { delete static_cast<rs_detail::VecShared*>(h); };
+        hdr->vec = std::move(v);
+        return Bytes(hdr->vec.data(), hdr->vec.size(), hdr);
+    }
+
+    size_t len() const { return size; }
+    bool is_empty() const { return size == 0; }
+    const uint8_t* data() const { return ptr; }
+    const uint8_t* begin() const { return ptr; }
+    const uint8_t* end() const { return ptr + size; }
+    std::span<const uint8_t> as_slice() const { return {ptr, size}; }
+    operator std::span<const uint8_t>() const { return as_slice(); }
+    uint8_t operator[](size_t i) const {
+        if (i >= size) rs_panic("Bytes index out of range");
+        return ptr[i];
+    }
+
+    // [begin, end) of this view, sharing storage.
+    Bytes slice(size_t begin, size_t end) const {
+        if (begin > end || end > size) rs_panic("Bytes::slice range out of bounds");
+        if (shared) shared->retain();
+        return Bytes(ptr + begin, end - begin, shared);
+    }
+    // Returns [0, at) and keeps [at, len) in self.
+    Bytes split_to(size_t at) {
+        if (at > size) rs_panic("Bytes::split_to out of bounds");
+        if (shared) shared->retain();
+        Bytes head(ptr, at, shared);
+        ptr += at;
+        size -= at;
+        return head;
+    }
+    // Returns [at, len) and keeps [0, at) in self.
+    Bytes split_off(size_t at) {
+        if (at > size) rs_panic("Bytes::split_off out of bounds");
+        if (shared) shared->retain();
+        Bytes tail(ptr + at, size - at, shared);
+        size = at;
+        return tail;
+    }
+    void truncate(size_t n) { if (n < size) size = n; }
+    void clear() { size = 0; }
+
+    std::vector<uint8_t> to_vec() const { return {ptr, ptr + size}; }
+
+    bool operator==(const Bytes& o) const {
+        return size == o.size && (size == 0 || std::memcmp(ptr, o.ptr, size) == 0);
+    }
+    bool operator!=(const Bytes& o) const { return !(*this == o); }
+};
+
+class BytesMut {
+    uint8_t* ptr = nullptr;
+    size_t size = 0;
+    size_t cap = 0;
+    rs_detail::BytesShared* shared = nullptr;
+
+    BytesMut(uint8_t* p, size_t n, size_t c, rs_detail::BytesShared* s) : ptr(p), size(n), cap(c), shared(s) {}
+public:
+    BytesMut() = default;
+    BytesMut(const BytesMut&) = delete;
+    BytesMut& operator=(const BytesMut&) = delete;
+    BytesMut(BytesMut&& o) noexcept
+        : ptr(std::exchange(o.ptr, nullptr)), size(std::exchange(o.size, 0)),
+          cap(std::exchange(o.cap, 0)), shared(std::exchange(o.shared, nullptr)) {}
+    BytesMut& operator=(BytesMut&& o) noexcept {
+        if (this != &o) {
+            if (shared) shared->release();
+            ptr = std::exchange(o.ptr, nullptr);
+            size = std::exchange(o.size, 0);
+            cap = std::exchange(o.cap, 0);
+            shared = std::exchange(o.shared, nullptr);
+        }
+        return *this;
+    }
+    ~BytesMut() { if (shared) shared->release(); }
+
+    static BytesMut with_capacity(size_t n) {
+        BytesMut b;
+        b.reserve(n);
+        return b;
+    }
+
+    size_t len() const { return size; }
+    size_t capacity() const { return cap; }
+    bool is_empty() const { return size == 0; }
+    uint8_t* data() { return ptr; }
+    const uint8_t* data() const { return ptr; }
+    std::span<const uint8_t> as_slice() const { return {ptr, size}; }
+    std::span<uint8_t> as_mut_slice() { return {ptr, size}; }
+    uint8_t& operator[](size_t i) {
+        if (i >= size) rs_panic("BytesMut index out of range");
+        return ptr[i];
+    }
+
+    // Ensures room for `additional` more bytes. Other views into the old
+    // storage keep it alive; this buffer moves to a fresh allocation.
+    void reserve(size_t additional) {
+        if (cap - size >= additional) return;
+        const size_t new_cap = std::max(size + additional, cap * 2);
+        uint8_t* data = nullptr;
+        auto* hdr = rs_detail::bytes_alloc(new_cap, data);
+        if (size) std::memcpy(data, ptr, size);
+        if (shared) shared->release();
+        ptr = data;
+        cap = new_cap;
+        shared = hdr;
+    }
+    void put(std::span<const uint8_t> s) {
+        reserve(s.size());
+        if (!s.empty()) std::memcpy(ptr + size, s.data(), s.size());
+        size += s.size();
+    }
+    void put(std::string_view s) {
+        put(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(s.data()), s.size()));
+    }
+    void put_u8(uint8_t b) {
+        reserve(1);
+        ptr[size++] = b;
+    }
+    // Grows (zero-filled) or shrinks the visible length.
+    void resize(size_t n) {
+        if (n > size) {
+            reserve(n - size);
+            std::memset(ptr + size, 0, n - size);
+        }
+        size = n;
+    }
+    void truncate(size_t n) { if (n < size) size = n; }
+    void clear() { size = 0; }
+
+    // Returns [0, at) as its own BytesMut; self keeps [at, len) plus the
+    // remaining capacity. Both halves share one allocation.
+    BytesMut split_to(size_t at) {
+        if (at > size) rs_panic("BytesMut::split_to out of bounds");
+        if (shared) shared->retain();
+        BytesMut head(ptr, at, at, shared);
+        ptr += at;
+        size -= at;
+        cap -= at;
+        return head;
+    }
+    // Takes every filled byte, leaving self empty with the spare capacity.
+    BytesMut split() { return split_to(size); }
+
+    Bytes freeze() && {
+        Bytes out(ptr, size, shared);
+        ptr = nullptr;
+        size = cap = 0;
+        shared = nullptr;
+        return out;
+    }
+};
+
+#endif // ENABLE_RS_IO
+
+// --- BinReader / BinWriter ---
+// Endian-aware binary decoding over Slice<u8> and encoding into Vec<u8>.
+// - `BinReader::read_u32_le()` etc. check bounds per call and return
+//   Result<T, Eof>.
+// - `BinReader::record(n)` checks once that n bytes remain, advances past
+//   them, and returns a `BinRecord` whose reads are plain loads. Decoding a
+//   fixed-size record therefore costs one compare instead of one per field.
+//   Reading past the end of a record is caught only in debug builds.
+// - `BinWriter` appends to a Vec<u8>; `record(n)` grows the buffer once and
+//   returns a `BinRecordMut` for unchecked stores.
+// Naming: `read_<type>_le/be` for every integer and float width, `read_u8`
+// / `read_i8` without a suffix. Writers use `write_` the same way.
+//
+// Example:
+//   BinReader r(packet);
+//   auto hdr = r.record(12);                // one bounds check
+//   if (hdr.is_err()) return Err(hdr.unwrap_err());
+//   let magic = hdr->read_u32_be();
+//   let len   = hdr->read_u64_le();
+#ifdef ENABLE_RS_IO
+
+struct Eof {
+    size_t needed;
+    size_t remaining;
+
+    std::string to_string() const {
+        return "unexpected end of input: needed " + std::to_string(needed) +
+               " bytes, " + std::to_string(remaining) + " remaining";
+    }
+    friend std::ostream& operator<<(std::ostream& os, const Eof& e) { return os << e.to_string(); }
+};
+
+namespace rs_detail {
+
+template<typename U>
+inline U byteswap(U v) {
+#if defined(__GNUC__)
+    if constexpr (sizeof(U) == 1) {
+        return v;
+    } else if constexpr (sizeof(U) == 2) {
+        return static_cast<U>(__builtin_bswap16(v));
+    } else if constexpr (sizeof(U) == 4) {
+        return static_cast<U>(__builtin_bswap32(v));
+    } else {
+        return static_cast<U>(__builtin_bswap64(v));
+    }
+#else
+    U out = 0;
+    for (size_t i = 0; i < sizeof(U); ++i) out = static_cast<U>((out << 8) | ((v >> (8 * i)) & 0xFF));
+    return out;
+#endif
+}
+
+template<size_t N> struct uint_of_size;
+template<> struct uint_of_size<1> { using type = uint8_t; };
+template<> struct uint_of_size<2> { using type = uint16_t; };
+template<> struct uint_of_size<4> { using type = uint32_t; };
+template<> struct uint_of_size<8> { using type = uint64_t; };
+
+// memcpy + optional bswap; compilers lower this to a single (movbe) load.
+template<typename T, std::endian E>
+inline T load(const uint8_t* p) {
+    using U = typename uint_of_size<sizeof(T)>::type;
+    U raw;
+    std::memcpy(&raw, p, sizeof(U));
+    if constexpr (E != std::endian::native) raw = byteswap(raw);
+    return std::bit_cast<T>(raw);
+}
+
+template<typename T, std::endian E>
+inline void store(uint8_t* p, T v) {
+    using U = typename uint_of_size<sizeof(T)>::type;
+    U raw = std::bit_cast<U>(v);
+    if constexpr (E != std::endian::native) raw = byteswap(raw);
+    std::memcpy(p, &raw, sizeof(U));
+}
+
+} // namespace rs_detail
+
+// Expands `X(name, type)` for every multi-byte field type.
+#define RS_BIN_FIELDS(X) \
+    X(u16, uint16_t) X(u32, uint32_t) X(u64, uint64_t) \
+    X(i16, int16_t) X(i32, int32_t) X(i64, int64_t) \
+    X(f32, float) X(f64, double)
+
+// Unchecked view over a span whose length was verified up front.
+class BinRecord {
+    const uint8_t* cur;
+    const uint8_t* end_;
+
+    template<typename T, std::endian E>
+    T take() {
+#ifndef NDEBUG
+        if (static_cast<size_t>(end_ - cur) < sizeof(T)) rs_panic("BinRecord read past end of record");
+#endif
+        T v = rs_detail::load<T, E>(cur);
+        cur += sizeof(T);
+        return v;
+    }
+public:
+    BinRecord(const uint8_t* p, size_t n) : cur(p), end_(p + n) {}
+
+    size_t remaining() const { return static_cast<size_t>(end_ - cur); }
+    void skip(size_t n) { cur += n; }
+    std::span<const uint8_t> read_bytes(size_t n) {
+        std::span<const uint8_t> out(cur, n);
+        cur += n;
+        return out;
+    }
+
+    uint8_t read_u8() { return take<uint8_t, std::endian::little>(); }
+    int8_t read_i8() { return take<int8_t, std::endian::little>(); }
+#define RS_BIN_RECORD_READ(name, T) \
+    T read_##name##_le() { return take<T, std::endian::little>(); } \
+    T read_##name##_be() { return take<T, std::endian::big>(); }
+    RS_BIN_FIELDS(RS_BIN_RECORD_READ)
+#undef RS_BIN_RECORD_READ
+};
+
+class BinReader {
+    const uint8_t* start;
+    const uint8_t* cur;
+    const uint8_t* end_;
+
+    template<typename T, std::endian E>
+    Result<T, Eof> take() {
+        if (remaining() < sizeof(T)) return Err(Eof{sizeof(T), remaining()});
+        T v = rs_detail::load<T, E>(cur);
+        cur += sizeof(T);
+        return Ok(v);
+    }
+public:
+    explicit BinReader(std::span<const uint8_t> data)
+        : start(data.data()), cur(data.data()), end_(data.data() + data.size()) {}
+
+    size_t position() const { return static_cast<size_t>(cur - start); }
+    size_t remaining() const { return static_cast<size_t>(end_ - cur); }
+    bool is_empty() const { return cur == end_; }
+    std::span<const uint8_t> rest() const { return {cur, remaining()}; }
+
+    // The hoisted check: verify n bytes once, then decode them unchecked.
+    Result<BinRecord, Eof> record(size_t n) {
+        if (remaining() < n) return Err(Eof{n, remaining()});
+        BinRecord rec(cur, n);
+        cur += n;
+        return Ok(rec);
+    }
+    Result<std::span<const uint8_t>, Eof> read_bytes(size_t n) {
+        if (remaining() < n) return Err(Eof{n, remaining()});
+        std::span<const uint8_t> out(cur, n);
+        cur += n;
+        return Ok(out);
+    }
+    Result<Unit, Eof> skip(size_t n) {
+        if (remaining() < n) return Err(Eof{n, remaining()});
+        cur += n;
+        return Ok();
+    }
+
+    Result<uint8_t, Eof> read_u8() { return take<uint8_t, std::endian::little>(); }
+    Result<int8_t, Eof> read_i8() { return take<int8_t, std::endian::little>(); }
+#define RS_BIN_READER_READ(name, T) \
+    Result<T, Eof> read_##name##_le() { return take<T, std::endian::little>(); } \
+    Result<T, Eof> read_##name##_be() { return take<T, std::endian::big>(); }
+    RS_BIN_FIELDS(RS_BIN_READER_READ)
+#undef RS_BIN_READER_READ
+};
+
+// Unchecked writer over bytes already reserved by BinWriter::record.
+class BinRecordMut {
+    uint8_t* cur;
+    uint8_t* end_;
+
+    template<typename T, std::endian E>
+    void put(T v) {
+#ifndef NDEBUG
+        if (static_cast<size_t>(end_ - cur) < sizeof(T)) rs_panic("BinRecordMut write past end of record");
+#endif
+        rs_detail::store<T, E>(cur, v);
+        cur += sizeof(T);
+    }
+public:
+    BinRecordMut(uint8_t* p, size_t n) : cur(p), end_(p + n) {}
+
+    size_t remaining() const { return static_cast<size_t>(end_ - cur); }
+    void write_bytes(std::span<const uint8_t> b) {
+        if (!b.empty()) std::memcpy(cur, b.data(), b.size());
+        cur += b.size();
+    }
+
+    void write_u8(uint8_t v) { put<uint8_t, std::endian::little>(v); }
+    void write_i8(int8_t v) { put<int8_t, std::endian::little>(v); }
+#define RS_BIN_RECORD_WRITE(name, T) \
+    void write_##name##_le(T v) { put<T, std::endian::little>(v); } \
+    void write_##name##_be(T v) { put<T, std::endian::big>(v); }
+    RS_BIN_FIELDS(RS_BIN_RECORD_WRITE)
+#undef RS_BIN_RECORD_WRITE
+};
+
+class BinWriter {
+    std::vector<uint8_t> buf;
+
+    template<typename T, std::endian E>
+    void put(T v) {
+        const size_t at = buf.size();
+        buf.resize(at + sizeof(T));
+        rs_detail::store<T, E>(buf.data() + at, v);
+    }
+public:
+    BinWriter() = default;
+    explicit BinWriter(std::vector<uint8_t> initial) : buf(std::move(initial)) {}
+
+    size_t len() const { return buf.size(); }
+    std::span<const uint8_t> as_slice() const { return buf; }
+    std::vector<uint8_t> into_inner() && { return std::move(buf); }
+    void reserve(size_t n) { buf.reserve(buf.size() + n); }
+
+    // Grows the buffer once by n bytes and returns an unchecked writer over
+    // them. The record is invalidated by any later write to this BinWriter.
+    BinRecordMut record(size_t n) {
+        const size_t at = buf.size();
+        buf.resize(at + n);
+        return BinRecordMut(buf.data() + at, n);
+    }
+    void write_bytes(std::span<const uint8_t> b) { buf.insert(buf.end(), b.begin(), b.end()); }
+
+    void write_u8(uint8_t v) { buf.push_back(v); }
+    void write_i8(int8_t v) { buf.push_back(static_cast<uint8_t>(v)); }
+#define RS_BIN_WRITER_WRITE(name, T) \
+    void write_##name##_le(T v) { put<T, std::endian::little>(v); } \
+    void write_##name##_be(T v) { put<T, std::endian::big>(v); }
+    RS_BIN_FIELDS(RS_BIN_WRITER_WRITE)
+#undef RS_BIN_WRITER_WRITE
+};
+
+#undef RS_BIN_FIELDS
+
+#endif // ENABLE_RS_IO
+
+// ==========================================
+// 7. Serialization (Serde)
+// ==========================================
+// Requires: ENABLE_RS_SERDE (+ ENABLE_RS_ERROR)
+//
+// Compile-time reflection for aggregates plus two serde-style backends.
+// - Reflection: `field_count<T>()` and `fields_of(obj)` (a tuple of field
+//   references) work on any aggregate with up to 16 fields, no macro needed.
+//   JSON also wants names: register them once with
+//   `rs_field_names(RectData, w, h)` at global scope.
+// - Traits: `Serialize<T>` / `Deserialize<T>` are concepts satisfied by
+//   bool, integers, floats, String, Vec<T>, std::array, Option<T>,
+//   reflected aggregates, and any type with a `Serde<T>` specialization
+//   (convert to and from a serializable `Repr`, like serde's into/try_from).
+// - `bincode::to_vec(v)` / `bincode::from_slice<T>(bytes)`: compact binary,
+//   little-endian fixed-width integers, u64 length prefixes. Runs of packed
+//   trivially copyable data (no padding, no bool) are copied with memcpy.
+//   Vecs of zero-byte elements may hold at most `bincode::max_empty_elements`
+//   in total per decode.
+// - `json::to_string(v)` / `json::from_str<T>(text)`: JSON objects for named
+//   aggregates, arrays otherwise. Parsing writes straight into T, with no
+//   intermediate DOM. Strings must be valid UTF-8 with no raw control
+//   characters, the same rule json::Document applies.
+// Deserialization returns Result<T, DeError>; nothing throws. Missing JSON
+// fields are errors unless the field is an Option.
+//
+// Example:
+//   struct RectData { f32 w; f32 h; };
+//   rs_field_names(RectData, w, h)
+//
+//   let text = json::to_string(RectData{3, 4});          // {"w":3,"h":4}
+//   let back = json::from_str<RectData>(text);           // Result<RectData, DeError>
+//   let bin  = bincode::to_vec(RectData{3, 4});          // 8 bytes, one memcpy
+#ifdef ENABLE_RS_SERDE
+
+struct DeError {
+    std::string msg;
+    size_t offset; // byte offset in the input where decoding failed
+
+    std::string to_string() const { return msg + " at offset " + std::to_string(offset); }
+    friend std::ostream& operator<<(std::ostream& os, const DeError& e) { return os << e.to_string(); }
+};
+
+// Specialize (via rs_field_names) to give JSON field names to an aggregate.
+template<typename T> struct FieldNames {};
+
+// Specialize to serialize T through another type:
+//   template<> struct Serde<Celsius> {
+//       using Repr = f64;
+//       static Repr to_repr(const Celsius& c) { return c.value; }
+//       static Result<Celsius, DeError> from_repr(Repr r) { return Ok(Celsius{r}); }
+//   };
+template<typename T> struct Serde {};
+
+#define rs_field_names(Type, ...) \
+    template<> struct FieldNames<Type> { static constexpr std::string_view list = #__VA_ARGS__; };
+
+namespace rs_detail {
+
+// --- Reflection ---
+struct any_field {
+    template<typename T> constexpr operator T() const noexcept;
+};
+
+template<typename T, size_t... I>
+constexpr bool brace_constructible(std::index_sequence<I...>) {
+    return requires { T{((void)I, any_field{})...}; };
+}
+
+template<typename T, size_t N = 0>
+constexpr size_t count_fields() {
+    if constexpr (N <= 16 && brace_constructible<T>(std::make_index_sequence<N + 1>{})) {
+        return count_fields<T, N + 1>();
+    } else {
+        return N;
+    }
+}
+
+template<typename T>
+constexpr bool reflectable = std::is_aggregate_v<T> && std::is_class_v<T>;
+
+template<typename T> struct is_vector : std::false_type {};
+template<typename T, typename A> struct is_vector<std::vector<T, A>> : std::true_type {};
+template<typename T> struct is_std_array : std::false_type {};
+template<typename T, size_t N> struct is_std_array<std::array<T, N>> : std::true_type {};
+template<typename T> struct is_option : std::false_type {};
+template<typename T> struct is_option<Option<T>> : std::true_type {};
+
+template<typename T>
+constexpr bool has_serde = requires(const T& v) { Serde<T>::to_repr(v); };
+template<typename T>
+constexpr bool has_names = requires { FieldNames<T>::list; };
+
+} // namespace rs_detail
+
+template<typename T>
+constexpr size_t field_count() {
+    static_assert(rs_detail::reflectable<T>, "field reflection needs an aggregate class");
+    return rs_detail::count_fields<T>();
+}
+
+// Tuple of references to the fields of an aggregate, in declaration order.
+template<typename T>
+auto fields_of(T& t) {
+    constexpr size_t n = field_count<std::remove_const_t<T>>();
+    if constexpr (n == 0) {
+        return std::tuple<>();
+    } else if constexpr (n == 1) {
+        auto& [f0] = t;
+        return std::tie(f0);
+    } else if constexpr (n == 2) {
+        auto& [f0, f1] = t;
+        return std::tie(f0, f1);
+    } else if constexpr (n == 3) {
+        auto& [f0, f1, f2] = t;
+        return std::tie(f0, f1, f2);
+    } else if constexpr (n == 4) {
+        auto& [f0, f1, f2, f3] = t;
+        return std::tie(f0, f1, f2, f3);
+    } else if constexpr (n == 5) {
+        auto& [f0, f1, f2, f3, f4] = t;
+        return std::tie(f0, f1, f2, f3, f4);
+    } else if constexpr (n == 6) {
+        auto& [f0, f1, f2, f3, f4, f5] = t;
+        return std::tie(f0, f1, f2, f3, f4, f5);
+    } else if constexpr (n == 7) {
+        auto& [f0, f1, f2, f3, f4, f5, f6] = t;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6);
+    } else if constexpr (n == 8) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7] = t;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7);
+    } else if constexpr (n == 9) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8] = t;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8);
+    } else if constexpr (n == 10) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9] = t;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9);
+    } else if constexpr (n == 11) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10] = t;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10);
+    } else if constexpr (n == 12) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11] = t;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11);
+    } else if constexpr (n == 13) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12] = t;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12);
+    } else if constexpr (n == 14) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13] = t;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13);
+    } else if constexpr (n == 15) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14] = t;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14);
+    } else if constexpr (n == 16) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15] = t;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15);
+    } else {
+        static_assert(n <= 16, "reflection supports aggregates with up to 16 fields");
+        return std::tuple<>();
+    }
+}
+
+namespace rs_detail {
+
+// Field names from rs_field_names, split at compile time.
+template<typename T>
+constexpr std::string_view field_name(size_t index) {
+    std::string_view list = FieldNames<T>::list;
+    for (;;) {
+        while (!list.empty() && list.front() == ' ') list.remove_prefix(1);
+        const size_t comma = list.find(',');
+        std::string_view name = list.substr(0, comma);
+        while (!name.empty() && name.back() == ' ') name.remove_suffix(1);
+        if (index-- == 0 || comma == std::string_view::npos) return name;
+        list.remove_prefix(comma + 1);
+    }
+}
+
+template<typename T>
+constexpr size_t name_count() {
+    size_t n = 1;
+    for (char c : FieldNames<T>::list) n += (c == ',');
+    return n;
+}
+
+// Packed, trivially copyable data whose bincode encoding equals its memory
+// image on a little-endian host.
+template<typename T>
+constexpr bool packed_pod() {
+    if constexpr (std::endian::native != std::endian::little) {
+        return false;
+    } else if constexpr (std::is_arithmetic_v<T>) {
+        return !std::is_same_v<T, bool>;
+    } else if constexpr (is_std_array<T>::value) {
+        return packed_pod<typename T::value_type>();
+    } else if constexpr (reflectable<T> && std::is_trivially_copyable_v<T> && !has_serde<T>) {
+        using Fields = decltype(fields_of(std::declval<T&>()));
+        return []<size_t... I>(std::index_sequence<I...>) {
+            return (packed_pod<std::remove_cvref_t<std::tuple_element_t<I, Fields>>>() && ...) &&
+                   (sizeof(std::remove_cvref_t<std::tuple_element_t<I, Fields>>) + ... + 0) == sizeof(T);
+        }(std::make_index_sequence<std::tuple_size_v<Fields>>{});
+    } else {
+        return false;
+    }
+}
+
+// True when T's bincode encoding is always zero bytes, such as a struct
+// without fields. Vec<T> of these is encoded as its length alone.
+template<typename T>
+constexpr bool encodes_empty() {
+    if constexpr (has_serde<T>) {
+        return encodes_empty<typename Serde<T>::Repr>();
+    } else if constexpr (packed_pod<T>() || std::is_arithmetic_v<T> || std::is_same_v<T, std::string> ||
+                         is_vector<T>::value || is_option<T>::value) {
+        return false;
+    } else if constexpr (is_std_array<T>::value) {
+        return std::tuple_size_v<T> == 0 || encodes_empty<typename T::value_type>();
+    } else if constexpr (reflectable<T>) {
+        using Fields = decltype(fields_of(std::declval<T&>()));
+        return []<size_t... I>(std::index_sequence<I...>) {
+            return (encodes_empty<std::remove_cvref_t<std::tuple_element_t<I, Fields>>>() && ...);
+        }(std::make_index_sequence<std::tuple_size_v<Fields>>{});
+    } else {
+        return false;
+    }
+}
+
+template<typename T>
+using float_bits_t = std::conditional_t<sizeof(T) == 8, uint64_t, uint32_t>;
+
+template<typename T>
+constexpr bool serializable() {
+    if constexpr (has_serde<T>) {
+        return serializable<typename Serde<T>::Repr>();
+    } else if constexpr (std::is_floating_point_v<T>) {
+        return sizeof(T) == 4 || sizeof(T) == 8;
+    } else if constexpr (std::is_arithmetic_v<T> || std::is_same_v<T, std::string>) {
+        return true;
+    } else if constexpr (is_vector<T>::value || is_std_array<T>::value) {
+        return serializable<typename T::value_type>();
+    } else if constexpr (is_option<T>::value) {
+        return serializable<std::remove_cvref_t<decltype(std::declval<T&>().unwrap())>>();
+    } else if constexpr (reflectable<T>) {
+        using Fields = decltype(fields_of(std::declval<T&>()));
+        return []<size_t... I>(std::index_sequence<I...>) {
+            return (serializable<std::remove_cvref_t<std::tuple_element_t<I, Fields>>>() && ...);
+        }(std::make_index_sequence<std::tuple_size_v<Fields>>{});
+    } else {
+        return false;
+    }
+}
+
+} // namespace rs_detail
+
+template<typename T>
+concept Serialize = rs_detail::serializable<T>();
+template<typename T>
+concept Deserialize = Serialize<T> && std::is_default_constructible_v<T>;
+
+// --- bincode ---
+namespace bincode {
+
+// Most elements of zero-byte types (such as field-less structs) one
+// from_slice call will materialize, summed over every Vec in the input.
+// Their lengths are not bounded by the input size, so this is what stops an
+// 8-byte length prefix from asking for 2^60 of them.
+inline constexpr uint64_t max_empty_elements = uint64_t{1} << 20;
+
+namespace detail {
+
+struct Out {
+    std::vector<uint8_t> buf;
+    void put(const void* p, size_t n) {
+        const auto* b = static_cast<const uint8_t*>(p);
+        buf.insert(buf.end(), b, b + n);
+    }
+    template<typename U> void put_le(U v) {
+        if constexpr (std::endian::native != std::endian::little) {
+            uint8_t tmp[sizeof(U)];
+            for (size_t i = 0; i < sizeof(U); ++i) tmp[i] = static_cast<uint8_t>(v >> (8 * i));
+            put(tmp, sizeof(U));
+        } else {
+            put(&v, sizeof(U));
+        }
+    }
+};
+
+struct In {
+    const uint8_t* begin;
+    const uint8_t* cur;
+    const uint8_t* end;
+    uint64_t empty_budget = max_empty_elements;
+
+    DeError error(const char* msg) const { return DeError{msg, static_cast<size_t>(cur - begin)}; }
+    bool take(void* dst, size_t n) {
+        if (static_cast<size_t>(end - cur) < n) return false;
+        if (n) std::memcpy(dst, cur, n);
+        cur += n;
+        return true;
+    }
+    template<typename U> bool take_le(U& v) {
+        uint8_t tmp[sizeof(U)];
+        if (!take(tmp, sizeof(U))) return false;
+        U out = 0;
+        for (size_t i = 0; i < sizeof(U); ++i) out |= static_cast<U>(static_cast<U>(tmp[i]) << (8 * i));
+        v = out;
+        return true;
+    }
+};
+
+template<typename T>
+void write(Out& out, const T& v) {
+    using namespace rs_detail;
+    if constexpr (has_serde<T>) {
+        write(out, Serde<T>::to_repr(v));
+    } else if constexpr (packed_pod<T>()) {
+        out.put(&v, sizeof(T));
+    } else if constexpr (std::is_same_v<T, bool>) {
+        out.buf.push_back(v ? 1 : 0);
+    } else if constexpr (std::is_integral_v<T>) {
+        out.put_le(static_cast<std::make_unsigned_t<T>>(v));
+    } else if constexpr (std::is_floating_point_v<T>) {
+        out.put_le(std::bit_cast<float_bits_t<T>>(v));
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        out.put_le(static_cast<uint64_t>(v.size()));
+        out.put(v.data(), v.size());
+    } else if constexpr (is_vector<T>::value) {
+        out.put_le(static_cast<uint64_t>(v.size()));
+        if constexpr (packed_pod<typename T::value_type>()) {
+            out.put(v.data(), v.size() * sizeof(typename T::value_type));
+        } else {
+            for (const auto& e : v) write(out, e);
+        }
+    } else if constexpr (is_std_array<T>::value) {
+        for (const auto& e : v) write(out, e);
+    } else if constexpr (is_option<T>::value) {
+        out.buf.push_back(v.is_some() ? 1 : 0);
+        if (v.is_some()) write(out, v.unwrap());
+    } else {
+        std::apply([&](const auto&... f) { (write(out, f), ...); }, fields_of(v));
+    }
+}
+
+template<typename T>
+Result<Unit, DeError> read(In& in, T& v) {
+    using namespace rs_detail;
+    if constexpr (has_serde<T>) {
+        typename Serde<T>::Repr repr{};
+        auto res = read(in, repr);
+        if (res.is_err()) return res;
+        auto conv = Serde<T>::from_repr(std::move(repr));
+        if (conv.is_err()) return Err(in.error(conv.unwrap_err().msg.c_str()));
+        v = std::move(conv.unwrap());
+        return Ok();
+    } else if constexpr (packed_pod<T>()) {
+        if (!in.take(&v, sizeof(T))) return Err(in.error("unexpected end of input"));
+        return Ok();
+    } else if constexpr (std::is_same_v<T, bool>) {
+        uint8_t b;
+        if (!in.take(&b, 1)) return Err(in.error("unexpected end of input"));
+        if (b > 1) return Err(in.error("invalid bool"));
+        v = b == 1;
+        return Ok();
+    } else if constexpr (std::is_integral_v<T>) {
+        std::make_unsigned_t<T> raw;
+        if (!in.take_le(raw)) return Err(in.error("unexpected end of input"));
+        v = static_cast<T>(raw);
+        return Ok();
+    } else if constexpr (std::is_floating_point_v<T>) {
+        float_bits_t<T> raw;
+        if (!in.take_le(raw)) return Err(in.error("unexpected end of input"));
+        v = std::bit_cast<T>(raw);
+        return Ok();
+    } else if constexpr (std::is_same_v<T, std::string> || is_vector<T>::value) {
+        uint64_t n;
+        if (!in.take_le(n)) return Err(in.error("unexpected end of input"));
+        using E = typename T::value_type;
+        // Elements with a non-empty encoding take at least one byte each;
+        // reject lengths the input cannot hold before allocating. Zero-byte
+        // elements draw on the per-call max_empty_elements budget instead.
+        if constexpr (encodes_empty<E>()) {
+            if (n > in.empty_budget) return Err(in.error("length exceeds limit"));
+            in.empty_budget -= n;
+        } else {
+            if (n > static_cast<uint64_t>(in.end - in.cur)) return Err(in.error("length exceeds input"));
+        }
+        if constexpr (std::is_same_v<T, std::string> || packed_pod<E>()) {
+            if (n * sizeof(E) > static_cast<uint64_t>(in.end - in.cur)) return Err(in.error("length exceeds input"));
+            v.resize(static_cast<size_t>(n));
+            in.take(v.data(), static_cast<size_t>(n) * sizeof(E));
+        } else {
+            v.clear();
+            v.resize(static_cast<size_t>(n));
+            for (auto& e : v) {
+                auto res = read(in, e);
+                if (res.is_err()) return res;
+            }
+        }
+        return Ok();
+    } else if constexpr (is_std_array<T>::value) {
+        for (auto& e : v) {
+            auto res = read(in, e);
+            if (res.is_err()) return res;
+        }
+        return Ok();
+    } else if constexpr (is_option<T>::value) {
+        uint8_t tag;
+        if (!in.take(&tag, 1)) return Err(in.error("unexpected end of input"));
+        if (tag == 0) { v = T(); return Ok(); }
+        if (tag != 1) return Err(in.error("invalid option tag"));
+        std::remove_cvref_t<decltype(v.unwrap())> inner_value{};
+        auto res = read(in, inner_value);
+        if (res.is_err()) return res;
+        v = T(std::move(inner_value));
+        return Ok();
+    } else {
+        Result<Unit, DeError> res = Ok();
+        std::apply([&](auto&... f) { ((res.is_ok() ? (void)(res = read(in, f)) : void()), ...); }, fields_of(v));
+        return res;
+    }
+}
+
+} // namespace detail
+
+template<Serialize T>
+std::vector<uint8_t> to_vec(const T& v) {
+    detail::Out out;
+    detail::write(out, v);
+    return std::move(out.buf);
+}
+
+template<Deserialize T>
+Result<T, DeError> from_slice(std::span<const uint8_t> bytes) {
+    detail::In in{bytes.data(), bytes.data(), bytes.data() + bytes.size()};
+    T v{};
+    auto res = detail::read(in, v);
+    if (res.is_err()) return Err(std::move(res.unwrap_err()));
+    if (in.cur != in.end) return Err(in.error("trailing bytes"));
+    return Ok(std::move(v));
+}
+
+} // namespace bincode
+
+// --- json ---
+namespace json {
+namespace detail {
+
+inline void write_string(std::string& out, std::string_view s) {
+    static constexpr char hex[] = "0123456789abcdef";
+    out.push_back('"');
+    for (char ch : s) {
+        const auto c = static_cast<unsigned char>(ch);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out.push_back(hex[c >> 4]);
+                    out.push_back(hex[c & 0xF]);
+                } else {
+                    out.push_back(ch);
+                }
+        }
+    }
+    out.push_back('"');
+}
+
+template<typename T>
+void write(std::string& out, const T& v) {
+    using namespace rs_detail;
+    if constexpr (has_serde<T>) {
+        write(out, Serde<T>::to_repr(v));
+    } else if constexpr (std::is_same_v<T, bool>) {
+        out += v ? "true" : "false";
+    } else if constexpr (std::is_arithmetic_v<T>) {
+        if constexpr (std::is_floating_point_v<T>) {
+            if (v != v || v == std::numeric_limits<T>::infinity() || v == -std::numeric_limits<T>::infinity()) {
+                out += "null";
+                return;
+            }
+        }
+        char buf[64];
+        const auto res = std::to_chars(buf, buf + sizeof(buf), v);
+        out.append(buf, res.ptr);
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        write_string(out, v);
+    } else if constexpr (is_vector<T>::value || is_std_array<T>::value) {
+        out.push_back('[');
+        bool first = true;
+        for (const auto& e : v) {
+            if (!first) out.push_back(',');
+            first = false;
+            write(out, e);
+        }
+        out.push_back(']');
+    } else if constexpr (is_option<T>::value) {
+        if (v.is_some()) write(out, v.unwrap());
+        else out += "null";
+    } else if constexpr (has_names<T>) {
+        static_assert(name_count<T>() == field_count<T>(), "rs_field_names must list every field");
+        out.push_back('{');
+        size_t i = 0;
+        std::apply([&](const auto&... f) {
+            ((out += (i ? "," : ""), write_string(out, field_name<T>(i)), out.push_back(':'), write(out, f), ++i), ...);
+        }, fields_of(v));
+        out.push_back('}');
+    } else {
+        out.push_back('[');
+        size_t i = 0;
+        std::apply([&](const auto&... f) { ((out += (i++ ? "," : ""), write(out, f)), ...); }, fields_of(v));
+        out.push_back(']');
+    }
+}
+
+// Pull parser over the input text; reads directly into the target value.
+struct In {
+    const char* begin;
+    const char* cur;
+    const char* end;
+
+    DeError error(const char* msg) const { return DeError{msg, static_cast<size_t>(cur - begin)}; }
+    void ws() {
+        while (cur < end && (*cur == ' ' || *cur == '\n' || *cur == '\r' || *cur == '\t')) ++cur;
+    }
+    bool eat(char c) {
+        ws();
+        if (cur < end && *cur == c) { ++cur; return true; }
+        return false;
+    }
+    bool literal(std::string_view word) {
+        ws();
+        if (static_cast<size_t>(end - cur) >= word.size() && std::string_view(cur, word.size()) == word) {
+            cur += word.size();
+            return true;
+        }
+        return false;
+    }
+
+    static void push_utf8(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out.push_back(static_cast<char>(cp));
+        } else if (cp < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+    bool hex4(uint32_t& out) {
+        if (end - cur < 4) return false;
+        out = 0;
+        for (int i = 0; i < 4; ++i) {
+            const char c = *cur++;
+            out <<= 4;
+            if (c >= '0' && c <= '9') out |= static_cast<uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f') out |= static_cast<uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') out |= static_cast<uint32_t>(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+    Result<Unit, DeError> string(std::string& out) {
+        if (!eat('"')) return Err(error("expected string"));
+        out.clear();
+        for (;;) {
+            const char* run = cur;
+            while (cur < end && *cur != '"' && *cur != '\\' && static_cast<unsigned char>(*cur) >= 0x20) ++cur;
+            // Escapes are ASCII, so no valid sequence spans two runs.
+            uint8_t err_len = 0;
+            const auto* bytes = reinterpret_cast<const uint8_t*>(run);
+            const size_t bad = rs_detail::utf8_scalar(bytes, static_cast<size_t>(cur - run), 0, err_len);
+            if (bad != static_cast<size_t>(cur - run)) {
+                cur = run + bad;
+                return Err(error("invalid utf-8"));
+            }
+            out.append(run, cur);
+            if (cur >= end) return Err(error("unterminated string"));
+            if (static_cast<unsigned char>(*cur) < 0x20) return Err(error("control character in string"));
+            if (*cur++ == '"') return Ok();
+            if (cur >= end) return Err(error("unterminated string"));
+            const char esc = *cur++;
+            switch (esc) {
+                case '"': out.push_back('"'); break;
+                case '\\': out.push_back('\\'); break;
+                case '/': out.push_back('/'); break;
+                case 'b': out.push_back('\b'); break;
+                case 'f': out.push_back('\f'); break;
+                case 'n': out.push_back('\n'); break;
+                case 'r': out.push_back('\r'); break;
+                case 't': out.push_back('\t'); break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!hex4(cp)) return Err(error("invalid \\u escape"));
+                    if (cp >= 0xD800 && cp <= 0xDBFF) {
+                        uint32_t lo;
+                        if (end - cur < 2 || cur[0] != '\\' || cur[1] != 'u') return Err(error("unpaired surrogate"));
+                        cur += 2;
+                        if (!hex4(lo) || lo < 0xDC00 || lo > 0xDFFF) return Err(error("unpaired surrogate"));
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                        return Err(error("unpaired surrogate"));
+                    }
+                    push_utf8(out, cp);
+                    break;
+                }
+                default: return Err(error("invalid escape"));
+            }
+        }
+    }
+    template<typename N>
+    Result<Unit, DeError> number(N& out) {
+        ws();
+        const char* first = cur;
+        while (cur < end && ((*cur >= '0' && *cur <= '9') || *cur == '-' || *cur == '+' ||
+                             *cur == '.' || *cur == 'e' || *cur == 'E')) ++cur;
+        // from_chars alone would accept forms JSON forbids, such as "012".
+        if (!rs_detail::json_number_ok(std::string_view(first, static_cast<size_t>(cur - first)))) {
+            cur = first;
+            return Err(error("invalid number"));
+        }
+        const auto res = std::from_chars(first, cur, out);
+        if (res.ec != std::errc{} || res.ptr != cur) {
+            cur = first;
+            return Err(error(res.ec == std::errc::result_out_of_range ? "number out of range" : "invalid number"));
+        }
+        return Ok();
+    }
+    // Skips one value of any type (unknown object keys).
+    Result<Unit, DeError> skip(int depth = 0) {
+        if (depth > 256) return Err(error("nesting too deep"));
+        ws();
+        if (cur >= end) return Err(error("unexpected end of input"));
+        if (*cur == '"') {
+            std::string scratch;
+            return string(scratch);
+        }
+        if (*cur == '{' || *cur == '[') {
+            const char close = *cur == '{' ? '}' : ']';
+            ++cur;
+            if (eat(close)) return Ok();
+            do {
+                if (close == '}') {
+                    std::string key;
+                    auto k = string(key);
+                    if (k.is_err()) return k;
+                    if (!eat(':')) return Err(error("expected ':'"));
+                }
+                auto r = skip(depth + 1);
+                if (r.is_err()) return r;
+            } while (eat(','));
+            if (!eat(close)) return Err(error("expected ',' or closing bracket"));
+            return Ok();
+        }
+        if (literal("true") || literal("false") || literal("null")) return Ok();
+        double scratch;
+        return number(scratch);
+    }
+};
+
+template<typename T>
+Result<Unit, DeError> read(In& in, T& v) {
+    using namespace rs_detail;
+    if constexpr (has_serde<T>) {
+        typename Serde<T>::Repr repr{};
+        auto res = read(in, repr);
+        if (res.is_err()) return res;
+        auto conv = Serde<T>::from_repr(std::move(repr));
+        if (conv.is_err()) return Err(in.error(conv.unwrap_err().msg.c_str()));
+        v = std::move(conv.unwrap());
+        return Ok();
+    } else if constexpr (std::is_same_v<T, bool>) {
+        if (in.literal("true")) { v = true; return Ok(); }
+        if (in.literal("false")) { v = false; return Ok(); }
+        return Err(in.error("expected bool"));
+    } else if constexpr (std::is_arithmetic_v<T>) {
+        if constexpr (std::is_floating_point_v<T>) {
+            if (in.literal("null")) { v = std::numeric_limits<T>::quiet_NaN(); return Ok(); }
+        }
+        return in.number(v);
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        return in.string(v);
+    } else if constexpr (is_vector<T>::value || is_std_array<T>::value) {
+        if (!in.eat('[')) return Err(in.error("expected array"));
+        size_t n = 0;
+        if constexpr (is_vector<T>::value) v.clear();
+        if (!in.eat(']')) {
+            do {
+                if constexpr (is_vector<T>::value) {
+                    v.emplace_back();
+                } else if (n >= v.size()) {
+                    return Err(in.error("too many array elements"));
+                }
+                auto res = read(in, v[n++]);
+                if (res.is_err()) return res;
+            } while (in.eat(','));
+            if (!in.eat(']')) return Err(in.error("expected ',' or ']'"));
+        }
+        if constexpr (is_std_array<T>::value) {
+            if (n != v.size()) return Err(in.error("too few array elements"));
+        }
+        return Ok();
+    } else if constexpr (is_option<T>::value) {
+        if (in.literal("null")) { v = T(); return Ok(); }
+        std::remove_cvref_t<decltype(v.unwrap())> inner_value{};
+        auto res = read(in, inner_value);
+        if (res.is_err()) return res;
+        v = T(std::move(inner_value));
+        return Ok();
+    } else if constexpr (has_names<T>) {
+        static_assert(name_count<T>() == field_count<T>(), "rs_field_names must list every field");
+        constexpr size_t n = field_count<T>();
+        if (!in.eat('{')) return Err(in.error("expected object"));
+        bool seen[n + 1] = {};
+        auto fields = fields_of(v);
+        std::string key;
+        if (!in.eat('}')) {
+            do {
+                auto k = in.string(key);
+                if (k.is_err()) return k;
+                if (!in.eat(':')) return Err(in.error("expected ':'"));
+                Result<Unit, DeError> res = Ok();
+                bool matched = false;
+                [&]<size_t... I>(std::index_sequence<I...>) {
+                    ((!matched && field_name<T>(I) == key
+                          ? (void)(matched = true, seen[I] = true, res = read(in, std::get<I>(fields)))
+                          : void()), ...);
+                }(std::make_index_sequence<n>{});
+                if (!matched) res = in.skip();
+                if (res.is_err()) return res;
+            } while (in.eat(','));
+            if (!in.eat('}')) return Err(in.error("expected ',' or '}'"));
+        }
+        Result<Unit, DeError> missing = Ok();
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            ((missing.is_ok() && !seen[I] &&
+                      !is_option<std::remove_cvref_t<std::tuple_element_t<I, decltype(fields)>>>::value
+                  ? (void)(missing = Err(in.error("missing field"))) : void()), ...);
+        }(std::make_index_sequence<n>{});
+        return missing;
+    } else {
+        if (!in.eat('[')) return Err(in.error("expected array"));
+        Result<Unit, DeError> res = Ok();
+        size_t i = 0;
+        std::apply([&](auto&... f) {
+            ((res.is_ok() ? (void)(res = (i++ && !in.eat(',')) ? Result<Unit, DeError>(Err(in.error("expected ','")))
+                                                               : read(in, f))
+                          : void()), ...);
+        }, fields_of(v));
+        if (res.is_err()) return res;
+        if (!in.eat(']')) return Err(in.error("expected ']'"));
+        return Ok();
+    }
+}
+
+} // namespace detail
+
+template<Serialize T>
+std::string to_string(const T& v) {
+    std::string out;
+    detail::write(out, v);
+    return out;
+}
+
+template<Deserialize T>
+Result<T, DeError> from_str(std::string_view text) {
+    detail::In in{text.data(), text.data(), text.data() + text.size()};
+    T v{};
+    auto res = detail::read(in, v);
+    if (res.is_err()) return Err(std::move(res.unwrap_err()));
+    in.ws();
+    if (in.cur != in.end) return Err(in.error("trailing characters"));
+    return Ok(std::move(v));
+}
+
+} // namespace json
+
+#endif // ENABLE_RS_SERDE
+
+// ==========================================
+// 8. Numerics
+// ==========================================
+// Requires: ENABLE_RS_NUM (+ ENABLE_RS_ERROR)
+//
+// The integer aliases are plain builtins, so overflow is silent (unsigned) or
+// undefined (signed). Rust's explicit overflow policies as free functions:
+// - `checked_add(a, b)`     -> Option<T>, None on overflow.
+// - `overflowing_add(a, b)` -> std::pair<T, bool>, wrapped result + flag.
+// - `wrapping_add(a, b)`    -> T, two's-complement wrap.
+// - `saturating_add(a, b)`  -> T, clamped to the type's range.
+// The same families exist for sub and mul; checked_div/checked_rem/
+// checked_neg and wrapping_neg cover the remaining overflow cases. All map to
+// `__builtin_*_overflow` (one flag test after the arithmetic instruction).
+// The overflowing_/wrapping_/saturating_ families are constexpr.
+//
+// `Wrapping<T>` and `Saturating<T>` carry the policy in the type, so ordinary
+// `+ - *` follow it.
+//
+// Slice reductions:
+// - `checked_sum(xs)`    -> Option<T>, None if the exact sum does not fit T.
+// - `saturating_sum(xs)` -> T, the exact sum clamped to T's range.
+// - `wrapping_sum(xs)`   -> T.
+// These look at the exact mathematical sum, so an intermediate overflow that
+// later cancels out is not an error (unlike folding with checked_add). 64-bit
+// sums keep a per-lane carry count next to each accumulator (AVX2 when the CPU
+// has it) and widen to 128 bits only once, at the end.
+//
+// Example:
+//   let total = checked_sum(cents);                 // Vec<i64> or Slice<i64>
+//   if (total.is_none()) return Err(BillingError::Overflow);
+//   u8 level = saturating_add(u8{250}, u8{10});   // 255
+//   Wrapping<u32> h{2166136261u};
+//   for (u8 b : key) h = (h ^ Wrapping<u32>{b}) * Wrapping<u32>{16777619u};
+#ifdef ENABLE_RS_NUM
+
+namespace rs_detail {
+
+// Integer types other than bool and character types.
+template<typename T>
+concept rs_int = std::is_integral_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char> &&
+                 !std::is_same_v<T, char8_t> && !std::is_same_v<T, char16_t> && !std::is_same_v<T, char32_t> &&
+                 !std::is_same_v<T, wchar_t>;
+
+} // namespace rs_detail
+
+// --- overflowing / wrapping / checked / saturating ---
+template<rs_detail::rs_int T>
+constexpr std::pair<T, bool> overflowing_add(T a, T b) {
+    T r{};
+    const bool o = __builtin_add_overflow(a, b, &r);
+    return {r, o};
+}
+template<rs_detail::rs_int T>
+constexpr std::pair<T, bool> overflowing_sub(T a, T b) {
+    T r{};
+    const bool o = __builtin_sub_overflow(a, b, &r);
+    return {r, o};
+}
+template<rs_detail::rs_int T>
+constexpr std::pair<T, bool> overflowing_mul(T a, T b) {
+    T r{};
+    const bool o = __builtin_mul_overflow(a, b, &r);
+    return {r, o};
+}
+
+template<rs_detail::rs_int T>
+constexpr T wrapping_add(T a, T b) { return overflowing_add(a, b).first; }
+template<rs_detail::rs_int T>
+constexpr T wrapping_sub(T a, T b) { return overflowing_sub(a, b).first; }
+template<rs_detail::rs_int T>
+constexpr T wrapping_mul(T a, T b) { return overflowing_mul(a, b).first; }
+template<rs_detail::rs_int T>
+constexpr T wrapping_neg(T a) { return overflowing_sub(T{0}, a).first; }
+
+template<rs_detail::rs_int T>
+inline Option<T> checked_add(T a, T b) {
+    const auto [r, o] = overflowing_add(a, b);
+    if (o) return None();
+    return Some(r);
+}
+template<rs_detail::rs_int T>
+inline Option<T> checked_sub(T a, T b) {
+    const auto [r, o] = overflowing_sub(a, b);
+    if (o) return None();
+    return Some(r);
+}
+template<rs_detail::rs_int T>
+inline Option<T> checked_mul(T a, T b) {
+    const auto [r, o] = overflowing_mul(a, b);
+    if (o) return None();
+    return Some(r);
+}
+// None on division by zero and on MIN / -1.
+template<rs_detail::rs_int T>
+inline Option<T> checked_div(T a, T b) {
+    if (b == 0) return None();
+    if constexpr (std::is_signed_v<T>) {
+        if (a == std::numeric_limits<T>::min() && b == T(-1)) return None();
+    }
+    return Some(static_cast<T>(a / b));
+}
+template<rs_detail::rs_int T>
+inline Option<T> checked_rem(T a, T b) {
+    if (b == 0) return None();
+    if constexpr (std::is_signed_v<T>) {
+        if (a == std::numeric_limits<T>::min() && b == T(-1)) return None();
+    }
+    return Some(static_cast<T>(a % b));
+}
+template<rs_detail::rs_int T>
+inline Option<T> checked_neg(T a) {
+    const auto [r, o] = overflowing_sub(T{0}, a);
+    if (o) return None();
+    return Some(r);
+}
+
+template<rs_detail::rs_int T>
+constexpr T saturating_add(T a, T b) {
+    const auto [r, o] = overflowing_add(a, b);
+    if (!o) return r;
+    if constexpr (std::is_signed_v<T>) {
+        if (b < 0) return std::numeric_limits<T>::min();
+    }
+    return std::numeric_limits<T>::max();
+}
+template<rs_detail::rs_int T>
+constexpr T saturating_sub(T a, T b) {
+    const auto [r, o] = overflowing_sub(a, b);
+    if (!o) return r;
+    if constexpr (std::is_signed_v<T>) {
+        if (b < 0) return std::numeric_limits<T>::max();
+    }
+    return std::numeric_limits<T>::min();
+}
+template<rs_detail::rs_int T>
+constexpr T saturating_mul(T a, T b) {
+    const auto [r, o] = overflowing_mul(a, b);
+    if (!o) return r;
+    if constexpr (std::is_signed_v<T>) {
+        if ((a < 0) != (b < 0)) return std::numeric_limits<T>::min();
+    }
+    return std::numeric_limits<T>::max();
+}
+
+// --- Wrapping<T> / Saturating<T> ---
+// Value wrappers whose arithmetic operators use one overflow policy, like
+// std::num::Wrapping and std::num::Saturating. The raw value is `.value`.
+#define RS_NUM_POLICY_TYPE(Name, add, sub, mul) \
+    template<rs_detail::rs_int T> \
+    struct Name { \
+        T value{}; \
+        constexpr Name() = default; \
+        constexpr explicit Name(T v) : value(v) {} \
+        friend constexpr Name operator+(Name a, Name b) { return Name(add(a.value, b.value)); } \
+        friend constexpr Name operator-(Name a, Name b) { return Name(sub(a.value, b.value)); } \
+        friend constexpr Name operator*(Name a, Name b) { return Name(mul(a.value, b.value)); } \
+        constexpr Name& operator+=(Name o) { return *this = *this + o; } \
+        constexpr Name& operator-=(Name o) { return *this = *this - o; } \
+        constexpr Name& operator*=(Name o) { return *this = *this * o; } \
+        friend constexpr bool operator==(Name a, Name b) { return a.value == b.value; } \
+        friend constexpr auto operator<=>(Name a, Name b) { return a.value <=> b.value; } \
+        friend std::ostream& operator<<(std::ostream& os, Name a) { return os << +a.value; } \
+    };
+RS_NUM_POLICY_TYPE(Wrapping, wrapping_add, wrapping_sub, wrapping_mul)
+RS_NUM_POLICY_TYPE(Saturating, saturating_add, saturating_sub, saturating_mul)
+#undef RS_NUM_POLICY_TYPE
+
+// Bitwise operators never overflow; they only make sense for Wrapping (hashes,
+// checksums).
+template<typename T>
+constexpr Wrapping<T> operator^(Wrapping<T> a, Wrapping<T> b) { return Wrapping<T>(static_cast<T>(a.value ^ b.value)); }
+template<typename T>
+constexpr Wrapping<T> operator&(Wrapping<T> a, Wrapping<T> b) { return Wrapping<T>(static_cast<T>(a.value & b.value)); }
+template<typename T>
+constexpr Wrapping<T> operator|(Wrapping<T> a, Wrapping<T> b) { return Wrapping<T>(static_cast<T>(a.value | b.value)); }
+
+// --- checked_sum / saturating_sum / wrapping_sum ---
+namespace rs_detail {
+
+// Exact sum of a slice as the 128-bit value `carries * 2^64 + low`.
+struct WideSum {
+    uint64_t low;
+    int64_t carries; // signed count of 2^64 wraps of `low`
+
+    // Adds a value sign- or zero-extended to 128 bits.
+    void add(uint64_t x, bool negative) {
+        const uint64_t s = low + x;
+        carries += static_cast<int64_t>(s < low) - static_cast<int64_t>(negative);
+        low = s;
+    }
+};
+
+template<typename T>
+inline WideSum wide_sum_scalar(const T* p, size_t n) {
+    WideSum out{0, 0};
+    if constexpr (sizeof(T) < 8) {
+        // Narrow types: plain 64-bit accumulation (vectorizes well) in chunks
+        // short enough that the accumulator cannot wrap.
+        using W = std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t>;
+        constexpr size_t chunk = size_t{1} << 31;
+        for (size_t base = 0; base < n; base += chunk) {
+            const size_t end = std::min(n, base + chunk);
+            W acc = 0;
+            for (size_t i = base; i < end; ++i) acc += p[i];
+            out.add(static_cast<uint64_t>(acc), acc < 0);
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) out.add(static_cast<uint64_t>(p[i]), p[i] < 0);
+    }
+    return out;
+}
+
+#ifdef RS_X86_SIMD
+// Lanes of (low, carry) accumulators. Signed inputs are handled as
+// sign-extended 128-bit values: a negative x adds 2^64 - |x| to low and -1 to
+// the carry count.
+template<bool Signed>
+RS_TARGET_AVX2 inline WideSum wide_sum64_avx2(const uint64_t* p, size_t n) {
+    const __m256i bias = _mm256_set1_epi64x(static_cast<int64_t>(0x8000000000000000ull));
+    const __m256i zero = _mm256_setzero_si256();
+    // Two independent accumulator sets hide the add -> compare latency.
+    __m256i low[2] = {zero, zero}, carry[2] = {zero, zero};
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        for (int u = 0; u < 2; ++u) {
+            const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 4 * u));
+            const __m256i s = _mm256_add_epi64(low[u], x);
+            // s < low (unsigned) <=> wrapped; the compare is signed, hence the bias.
+            const __m256i wrapped = _mm256_cmpgt_epi64(_mm256_xor_si256(low[u], bias), _mm256_xor_si256(s, bias));
+            carry[u] = _mm256_sub_epi64(carry[u], wrapped); // wrapped lanes are -1
+            if constexpr (Signed) carry[u] = _mm256_add_epi64(carry[u], _mm256_cmpgt_epi64(zero, x));
+            low[u] = s;
+        }
+    }
+    alignas(32) uint64_t lows[8];
+    alignas(32) int64_t carries[8];
+    for (int u = 0; u < 2; ++u) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lows + 4 * u), low[u]);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(carries + 4 * u), carry[u]);
+    }
+    WideSum out{0, 0};
+    for (size_t j = 0; j < 8; ++j) {
+        out.add(lows[j], false);
+        out.carries += carries[j];
+    }
+    for (; i < n; ++i) out.add(p[i], Signed && static_cast<int64_t>(p[i]) < 0);
+    return out;
+}
+#endif
+
+template<typename T>
+inline WideSum wide_sum(std::span<const T> xs) {
+#ifdef RS_X86_SIMD
+    if constexpr (sizeof(T) == 8) {
+        using Kernel = WideSum (*)(const uint64_t*, size_t);
+        static const Kernel kernel = best_kernel<Kernel>(nullptr, nullptr, &wide_sum64_avx2<std::is_signed_v<T>>, nullptr);
+        if (kernel) return kernel(reinterpret_cast<const uint64_t*>(xs.data()), xs.size());
+    }
+#endif
+    return wide_sum_scalar(xs.data(), xs.size());
+}
+
+// Where the exact sum lies relative to T's range: -1 below, 0 inside, 1 above.
+template<typename T>
+inline int wide_sum_order(const WideSum& w) {
+    if constexpr (std::is_signed_v<T>) {
+        // Fits in int64 iff carries is the sign extension of low.
+        const int64_t low = static_cast<int64_t>(w.low);
+        if (w.carries != (low < 0 ? -1 : 0)) return w.carries < 0 ? -1 : 1;
+        if (low < std::numeric_limits<T>::min()) return -1;
+        if (low > std::numeric_limits<T>::max()) return 1;
+        return 0;
+    } else {
+        if (w.carries < 0) return -1;
+        if (w.carries > 0 || w.low > std::numeric_limits<T>::max()) return 1;
+        return 0;
+    }
+}
+
+} // namespace rs_detail
+
+// Accept any contiguous range of integers: Slice<T>, Vec<T>, std::array.
+template<typename C, typename T = std::ranges::range_value_t<const C&>>
+    requires std::ranges::contiguous_range<const C&> && rs_detail::rs_int<T>
+inline Option<T> checked_sum(const C& xs) {
+    const auto w = rs_detail::wide_sum(std::span<const T>(xs));
+    if (rs_detail::wide_sum_order<T>(w) != 0) return None();
+    return Some(static_cast<T>(w.low));
+}
+template<typename C, typename T = std::ranges::range_value_t<const C&>>
+    requires std::ranges::contiguous_range<const C&> && rs_detail::rs_int<T>
+inline T saturating_sum(const C& xs) {
+    const auto w = rs_detail::wide_sum(std::span<const T>(xs));
+    switch (rs_detail::wide_sum_order<T>(w)) {
+        case -1: return std::numeric_limits<T>::min();
+        case 1: return std::numeric_limits<T>::max();
+        default: return static_cast<T>(w.low);
+    }
+}
+template<typename C, typename T = std::ranges::range_value_t<const C&>>
+    requires std::ranges::contiguous_range<const C&> && rs_detail::rs_int<T>
+inline T wrapping_sum(const C& xs) {
+    return static_cast<T>(rs_detail::wide_sum(std::span<const T>(xs)).low);
+}
+
+// --- try_from / try_into ---
+// Checked narrowing between integer types, and from floats to integers.
+// - `try_from<To>(x)` -> Result<To, TryFromIntError>. The test is one range
+//   compare (none at all when To holds every From value).
+// - `try_into(x)` converts implicitly to any Result<To, TryFromIntError>, so
+//   the target comes from the declaration, like `x.try_into()` in Rust.
+// - Floats truncate toward zero like a cast; NaN, infinities and truncated
+//   values outside To's range are errors.
+// - `try_from_slice<To>(xs)` -> Result<Vec<To>, TryFromIntError> checks the
+//   whole slice with a SIMD min/max pass first, then narrows in one
+//   unchecked SIMD pass. On failure the error carries the first failing index.
+//
+// Example:
+//   let port = try_from<u16>(config_value);          // i64 -> u16
+//   Result<u8, TryFromIntError> level = try_into(raw);
+//   let ids = try_from_slice<u32>(Slice<i64>(wide)); // Vec<u32>
+class TryFromIntError {
+    Option<size_t> at;
+public:
+    TryFromIntError() = default;
+    explicit TryFromIntError(size_t index) : at(Some(index)) {}
+
+    // Index of the first failing element for slice conversions.
+    Option<size_t> index() const { return at; }
+    std::string to_string() const {
+        std::string msg = "out of range integral type conversion attempted";
+        if (at.is_some()) msg += " at index " + std::to_string(*at);
+        return msg;
+    }
+    friend std::ostream& operator<<(std::ostream& os, const TryFromIntError& e) { return os << e.to_string(); }
+};
+
+namespace rs_detail {
+
+template<typename T>
+concept rs_num_source = rs_int<T> || std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+// Whether `x` converts to To without loss (after truncation for floats).
+template<typename To, typename From>
+constexpr bool fits(From x) {
+    if constexpr (std::is_floating_point_v<From>) {
+        // [min, 2^digits) is exact in binary floating point; NaN fails both.
+        constexpr From lo = static_cast<From>(std::numeric_limits<To>::min());
+        constexpr From hi = static_cast<From>(std::numeric_limits<To>::max() / 2 + 1) * 2;
+        const From t = x < 0 ? -__builtin_floor(-x) : __builtin_floor(x);
+        return t >= lo && t < hi;
+    } else if constexpr (std::in_range<To>(std::numeric_limits<From>::min()) &&
+                         std::in_range<To>(std::numeric_limits<From>::max())) {
+        return true;
+    } else {
+        return std::in_range<To>(x);
+    }
+}
+
+template<typename T>
+struct MinMax {
+    T lo, hi;
+    bool nan; // floats only
+};
+
+// Min, max and NaN presence over n > 0 elements, two W-byte vectors per step
+// with GCC vector extensions (two accumulators hide the compare/blend
+// latency). Each kernel body is instantiated once per target: W = 64 for
+// AVX-512, W = 32 for AVX2 and W = 16 for the generic SSE2 copy.
+template<size_t W, typename T>
+__attribute__((always_inline)) inline MinMax<T> minmax_body(const T* p, size_t n) {
+    typedef T V __attribute__((vector_size(W)));
+    constexpr size_t lanes = W / sizeof(T);
+    MinMax<T> out{p[0], p[0], false};
+    size_t i = 0;
+    if (n >= 2 * lanes) {
+        V lo[2], hi[2];
+        std::memcpy(&lo[0], p, sizeof(V));
+        lo[1] = hi[0] = hi[1] = lo[0];
+        auto nan = V{} != V{}; // all-false mask
+        for (; i + 2 * lanes <= n; i += 2 * lanes) {
+            for (size_t u = 0; u < 2; ++u) {
+                V x;
+                std::memcpy(&x, p + i + u * lanes, sizeof(V));
+                lo[u] = x < lo[u] ? x : lo[u];
+                hi[u] = x > hi[u] ? x : hi[u];
+                if constexpr (std::is_floating_point_v<T>) nan |= x != x;
+            }
+        }
+        for (size_t j = 0; j < lanes; ++j) {
+            out.lo = std::min({out.lo, lo[0][j], lo[1][j]});
+            out.hi = std::max({out.hi, hi[0][j], hi[1][j]});
+            if constexpr (std::is_floating_point_v<T>) out.nan |= nan[j] != 0;
+        }
+    }
+    for (; i < n; ++i) {
+        out.lo = std::min(out.lo, p[i]);
+        out.hi = std::max(out.hi, p[i]);
+        if constexpr (std::is_floating_point_v<T>) out.nan |= p[i] != p[i];
+    }
+    return out;
+}
+
+// dst[i] = To(src[i]) for values already known to fit.
+template<size_t W, typename To, typename From>
+__attribute__((always_inline)) inline void narrow_body(const From* src, To* dst, size_t n) {
+    typedef From VF __attribute__((vector_size(W)));
+    constexpr size_t lanes = W / sizeof(From);
+    typedef To VT __attribute__((vector_size(lanes * sizeof(To))));
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        VF x;
+        std::memcpy(&x, src + i, sizeof(VF));
+        const VT y = __builtin_convertvector(x, VT);
+        std::memcpy(dst + i, &y, sizeof(VT));
+    }
+    for (; i < n; ++i) dst[i] = static_cast<To>(src[i]);
+}
+
+template<typename T>
+inline MinMax<T> minmax_generic(const T* p, size_t n) { return minmax_body<16>(p, n); }
+template<typename To, typename From>
+inline void narrow_generic(const From* src, To* dst, size_t n) { narrow_body<16>(src, dst, n); }
+
+#ifdef RS_X86_SIMD
+template<typename T>
+RS_TARGET_AVX2 inline MinMax<T> minmax_avx2(const T* p, size_t n) { return minmax_body<32>(p, n); }
+template<typename To, typename From>
+RS_TARGET_AVX2 inline void narrow_avx2(const From* src, To* dst, size_t n) { narrow_body<32>(src, dst, n); }
+template<typename T>
+RS_TARGET_AVX512 inline MinMax<T> minmax_avx512(const T* p, size_t n) { return minmax_body<64>(p, n); }
+template<typename To, typename From>
+RS_TARGET_AVX512 inline void narrow_avx512(const From* src, To* dst, size_t n) { narrow_body<64>(src, dst, n); }
+#endif
+
+template<typename T>
+inline MinMax<T> minmax(const T* p, size_t n) {
+    using Kernel = MinMax<T> (*)(const T*, size_t);
+    static const Kernel kernel = best_kernel<Kernel>(&minmax_generic<T>, nullptr, RS_X86_KERNEL(&minmax_avx2<T>),
+                                                     RS_X86_KERNEL(&minmax_avx512<T>));
+    return kernel(p, n);
+}
+
+template<typename To, typename From>
+inline void narrow(const From* src, To* dst, size_t n) {
+    using Kernel = void (*)(const From*, To*, size_t);
+    static const Kernel kernel = best_kernel<Kernel>(&narrow_generic<To, From>, nullptr,
+                                                     RS_X86_KERNEL((&narrow_avx2<To, From>)),
+                                                     RS_X86_KERNEL((&narrow_avx512<To, From>)));
+    kernel(src, dst, n);
+}
+
+} // namespace rs_detail
+
+template<rs_detail::rs_int To, rs_detail::rs_num_source From>
+inline Result<To, TryFromIntError> try_from(From x) {
+    if (!rs_detail::fits<To>(x)) return Err(TryFromIntError());
+    return Ok(static_cast<To>(x));
+}
+
+template<rs_detail::rs_num_source From>
+struct TryInto {
+    From value;
+    template<rs_detail::rs_int To>
+    operator Result<To, TryFromIntError>() const { return try_from<To>(value); }
+};
+template<rs_detail::rs_num_source From>
+inline TryInto<From> try_into(From x) { return TryInto<From>{x}; }
+
+template<rs_detail::rs_int To, typename C, typename From = std::ranges::range_value_t<const C&>>
+    requires std::ranges::contiguous_range<const C&> && rs_detail::rs_num_source<From>
+inline Result<std::vector<To>, TryFromIntError> try_from_slice(const C& xs) {
+    const std::span<const From> src(xs);
+    if (!src.empty()) {
+        const auto mm = rs_detail::minmax(src.data(), src.size());
+        if (mm.nan || !rs_detail::fits<To>(mm.lo) || !rs_detail::fits<To>(mm.hi)) {
+            size_t i = 0;
+            while (rs_detail::fits<To>(src[i])) ++i;
+            return Err(TryFromIntError(i));
+        }
+    }
+    std::vector<To> out(src.size());
+    rs_detail::narrow(src.data(), out.data(), src.size());
+    return Ok(std::move(out));
+}
+
+#endif // ENABLE_RS_NUM
+
+// ==========================================
+// 9. Slices (sorting, searching, editing)
+// ==========================================
+// Requires: ENABLE_RS_SLICE (+ ENABLE_RS_ERROR)
+//
+// Rust's slice algorithms as free functions over any random-access range
+// (Vec<T>, std::array, std::span<T>). Comparators are C++ "less" predicates,
+// not Ordering-returning closures.
+//
+// Sorting:
+// - `sort_unstable(xs)` / `sort_unstable_by(xs, less)` /
+//   `sort_unstable_by_key(xs, key)`: pattern-defeating quicksort. Sorted,
+//   reversed and few-unique inputs take linear or near-linear time, and the
+//   worst case is O(n log n) through a heapsort fallback. Arithmetic keys
+//   use a branchless block partition (BlockQuicksort), so mispredictions do
+//   not scale with n.
+// - `radix_sort(xs)` / `radix_sort_by_key(xs, key)`: stable LSD radix sort on
+//   integer or float keys, one byte per pass. Histograms for every pass come
+//   from a single read, and passes where all keys share a byte are skipped.
+//   Floats order as -inf < ... < -0.0 < +0.0 < ... < +inf, with NaNs at the
+//   ends by sign.
+// - `sort_by_cached_key(xs, key)`: calls `key` once per element, then sorts
+//   (key, index) pairs and applies the permutation in place.
+// - `par_sort(xs)` / `par_sort_by(xs, less)`: stable parallel merge sort.
+//   Both halves of each split, and both halves of each merge, run on their
+//   own std::thread down to a depth set by hardware_concurrency.
+//
+// Searching and editing:
+// - `binary_search(xs, x)` -> Result<usize, usize>: Ok(index) of a match or
+//   Err(insertion point). `partition_point(xs, pred)` returns the first index
+//   where pred is false. Both halve the range without branching on data.
+// - `retain(v, keep)`, `retain_mut`, `dedup`, `dedup_by_key`, `dedup_by` edit
+//   a Vec in one compaction pass.
+//
+// SIMD kernels (namespace simd), over contiguous ranges of arithmetic types:
+// - `simd::sum`, `simd::dot`, `simd::min`/`max` -> Option<T>,
+//   `simd::argmin`/`argmax` -> Option<usize>, and `simd::map(xs, f)` run
+//   explicit vector loops with runtime AVX2 dispatch instead of relying on
+//   the autovectorizer. Float sums and dot products add in a different order
+//   from a sequential loop, so the last bits can differ.
+//
+// Example:
+//   Vec<u32> ids = load_ids();
+//   radix_sort(ids);
+//   sort_unstable_by_key(users, [](const User& u) { return u.age; });
+//   sort_by_cached_key(paths, [](const String& p) { return normalize(p); });
+//   binary_search(ids, 42u).match(
+//       Case(i){ return ids[i]; },
+//       Case(at){ ids.insert(ids.begin() + at, 42u); return 42u; });
+#ifdef ENABLE_RS_SLICE
+
+namespace rs_detail {
+
+// --- pdqsort ---
+// After Orson Peters' pattern-defeating quicksort (zlib license).
+namespace pdq {
+
+constexpr ptrdiff_t insertion_sort_threshold = 24;
+constexpr ptrdiff_t ninther_threshold = 128;
+constexpr size_t partial_insertion_sort_limit = 8;
+constexpr size_t block_size = 64;
+
+template<typename It, typename Cmp>
+inline void insertion_sort(It begin, It end, Cmp& comp) {
+    if (begin == end) return;
+    for (It cur = begin + 1; cur != end; ++cur) {
+        It sift = cur;
+        It sift_1 = cur - 1;
+        if (comp(*sift, *sift_1)) {
+            auto tmp = std::move(*sift);
+            do {
+                *sift-- = std::move(*sift_1);
+            } while (sift != begin && comp(tmp, *--sift_1));
+            *sift = std::move(tmp);
+        }
+    }
+}
+
+// Requires an element before `begin` that is not greater than any in range.
+template<typename It, typename Cmp>
+inline void unguarded_insertion_sort(It begin, It end, Cmp& comp) {
+    if (begin == end) return;
+    for (It cur = begin + 1; cur != end; ++cur) {
+        It sift = cur;
+        It sift_1 = cur - 1;
+        if (comp(*sift, *sift_1)) {
+            auto tmp = std::move(*sift);
+            do {
+                *sift-- = std::move(*sift_1);
+            } while (comp(tmp, *--sift_1));
+            *sift = std::move(tmp);
+        }
+    }
+}
+
+// Insertion sort that gives up after a few moves; true if it finished.
+template<typename It, typename Cmp>
+inline bool partial_insertion_sort(It begin, It end, Cmp& comp) {
+    if (begin == end) return true;
+    size_t moves = 0;
+    for (It cur = begin + 1; cur != end; ++cur) {
+        It sift = cur;
+        It sift_1 = cur - 1;
+        if (comp(*sift, *sift_1)) {
+            auto tmp = std::move(*sift);
+            do {
+                *sift-- = std::move(*sift_1);
+            } while (sift != begin && comp(tmp, *--sift_1));
+            *sift = std::move(tmp);
+            moves += static_cast<size_t>(cur - sift);
+        }
+        if (moves > partial_insertion_sort_limit) return false;
+    }
+    return true;
+}
+
+template<typename It, typename Cmp>
+inline void sort2(It a, It b, Cmp& comp) {
+    if (comp(*b, *a)) std::iter_swap(a, b);
+}
+template<typename It, typename Cmp>
+inline void sort3(It a, It b, It c, Cmp& comp) {
+    sort2(a, b, comp);
+    sort2(b, c, comp);
+    sort2(a, b, comp);
+}
+
+template<typename It>
+inline void swap_offsets(It first, It last, const unsigned char* offsets_l, const unsigned char* offsets_r,
+                         size_t num, bool use_swaps) {
+    if (use_swaps) {
+        // Equal counts on both sides: a cyclic permutation would not be valid.
+        for (size_t i = 0; i < num; ++i) std::iter_swap(first + offsets_l[i], last - offsets_r[i]);
+    } else if (num > 0) {
+        It l = first + offsets_l[0];
+        It r = last - offsets_r[0];
+        auto tmp = std::move(*l);
+        *l = std::move(*r);
+        for (size_t i = 1; i < num; ++i) {
+            l = first + offsets_l[i];
+            *r = std::move(*l);
+            r = last - offsets_r[i];
+            *l = std::move(*r);
+        }
+        *r = std::move(tmp);
+    }
+}
+
+// Partitions [begin, end) around *begin into [< pivot] pivot [>= pivot].
+// Returns the pivot position and whether the range was already partitioned.
+// Comparison results are written into offset buffers instead of branched on.
+template<typename It, typename Cmp>
+inline std::pair<It, bool> partition_right_branchless(It begin, It end, Cmp& comp) {
+    auto pivot = std::move(*begin);
+    It first = begin;
+    It last = end;
+    while (comp(*++first, pivot)) {}
+    if (first - 1 == begin) {
+        while (first < last && !comp(*--last, pivot)) {}
+    } else {
+        while (!comp(*--last, pivot)) {}
+    }
+    const bool already_partitioned = first >= last;
+    if (!already_partitioned) {
+        std::iter_swap(first, last);
+        ++first;
+        alignas(64) unsigned char offsets_l[block_size];
+        alignas(64) unsigned char offsets_r[block_size];
+        It offsets_l_base = first;
+        It offsets_r_base = last;
+        size_t num_l = 0, num_r = 0, start_l = 0, start_r = 0;
+        while (first < last) {
+            const size_t num_unknown = static_cast<size_t>(last - first);
+            const size_t left_split = num_l == 0 ? (num_r == 0 ? num_unknown / 2 : num_unknown) : 0;
+            const size_t right_split = num_r == 0 ? (num_unknown - left_split) : 0;
+            const size_t left_n = std::min(left_split, block_size);
+            const size_t right_n = std::min(right_split, block_size);
+            for (size_t i = 0; i < left_n; ++i) {
+                offsets_l[num_l] = static_cast<unsigned char>(i);
+                num_l += !comp(*first, pivot);
+                ++first;
+            }
+            for (size_t i = 0; i < right_n; ++i) {
+                offsets_r[num_r] = static_cast<unsigned char>(i + 1);
+                num_r += comp(*--last, pivot);
+            }
+            const size_t num = std::min(num_l, num_r);
+            swap_offsets(offsets_l_base, offsets_r_base, offsets_l + start_l, offsets_r + start_r, num,
+                         num_l == num_r);
+            num_l -= num;
+            num_r -= num;
+            start_l += num;
+            start_r += num;
+            if (num_l == 0) {
+                start_l = 0;
+                offsets_l_base = first;
+            }
+            if (num_r == 0) {
+                start_r = 0;
+                offsets_r_base = last;
+            }
+        }
+        // One side still has misplaced elements; move them across the middle.
+        if (num_l) {
+            while (num_l--) std::iter_swap(offsets_l_base + offsets_l[start_l + num_l], --last);
+            first = last;
+        }
+        if (num_r) {
+            while (num_r--) {
+                std::iter_swap(offsets_r_base - offsets_r[start_r + num_r], first);
+                ++first;
+            }
+            last = first;
+        }
+    }
+    It pivot_pos = first - 1;
+    *begin = std::move(*pivot_pos);
+    *pivot_pos = std::move(pivot);
+    return {pivot_pos, already_partitioned};
+}
+
+template<typename It, typename Cmp>
+inline std::pair<It, bool> partition_right(It begin, It end, Cmp& comp) {
+    auto pivot = std::move(*begin);
+    It first = begin;
+    It last = end;
+    while (comp(*++first, pivot)) {}
+    if (first - 1 == begin) {
+        while (first < last && !comp(*--last, pivot)) {}
+    } else {
+        while (!comp(*--last, pivot)) {}
+    }
+    const bool already_partitioned = first >= last;
+    while (first < last) {
+        std::iter_swap(first, last);
+        while (comp(*++first, pivot)) {}
+        while (!comp(*--last, pivot)) {}
+    }
+    It pivot_pos = first - 1;
+    *begin = std::move(*pivot_pos);
+    *pivot_pos = std::move(pivot);
+    return {pivot_pos, already_partitioned};
+}
+
+// Puts elements equal to the pivot on the left; used when the pivot equals
+// the element before the range, so the whole run of equal keys is done.
+template<typename It, typename Cmp>
+inline It partition_left(It begin, It end, Cmp& comp) {
+    auto pivot = std::move(*begin);
+    It first = begin;
+    It last = end;
+    while (comp(pivot, *--last)) {}
+    if (last + 1 == end) {
+        while (first < last && !comp(pivot, *++first)) {}
+    } else {
+        while (!comp(pivot, *++first)) {}
+    }
+    while (first < last) {
+        std::iter_swap(first, last);
+        while (comp(pivot, *--last)) {}
+        while (!comp(pivot, *++first)) {}
+    }
+    It pivot_pos = last;
+    *begin = std::move(*pivot_pos);
+    *pivot_pos = std::move(pivot);
+    return pivot_pos;
+}
+
+template<bool Branchless, typename It, typename Cmp>
+inline void sort_loop(It begin, It end, Cmp& comp, int bad_allowed, bool leftmost = true) {
+    for (;;) {
+        const ptrdiff_t size = end - begin;
+        if (size < insertion_sort_threshold) {
+            if (leftmost) insertion_sort(begin, end, comp);
+            else unguarded_insertion_sort(begin, end, comp);
+            return;
+        }
+
+        // Median of 3, or pseudomedian of 9 for large ranges.
+        const ptrdiff_t s2 = size / 2;
+        if (size > ninther_threshold) {
+            sort3(begin, begin + s2, end - 1, comp);
+            sort3(begin + 1, begin + (s2 - 1), end - 2, comp);
+            sort3(begin + 2, begin + (s2 + 1), end - 3, comp);
+            sort3(begin + (s2 - 1), begin + s2, begin + (s2 + 1), comp);
+            std::iter_swap(begin, begin + s2);
+        } else {
+            sort3(begin + s2, begin, end - 1, comp);
+        }
+
+        // Pivot equal to the predecessor: this run of equal keys is final.
+        if (!leftmost && !comp(*(begin - 1), *begin)) {
+            begin = partition_left(begin, end, comp) + 1;
+            continue;
+        }
+
+        const auto [pivot_pos, already_partitioned] =
+            Branchless ? partition_right_branchless(begin, end, comp) : partition_right(begin, end, comp);
+        const ptrdiff_t l_size = pivot_pos - begin;
+        const ptrdiff_t r_size = end - (pivot_pos + 1);
+
+        if (l_size < size / 8 || r_size < size / 8) {
+            // Bad partition: fall back to heapsort after log2(n) of them,
+            // otherwise shuffle a few elements to break the pattern.
+            if (--bad_allowed == 0) {
+                std::make_heap(begin, end, comp);
+                std::sort_heap(begin, end, comp);
+                return;
+            }
+            if (l_size >= insertion_sort_threshold) {
+                std::iter_swap(begin, begin + l_size / 4);
+                std::iter_swap(pivot_pos - 1, pivot_pos - l_size / 4);
+                if (l_size > ninther_threshold) {
+                    std::iter_swap(begin + 1, begin + (l_size / 4 + 1));
+                    std::iter_swap(begin + 2, begin + (l_size / 4 + 2));
+                    std::iter_swap(pivot_pos - 2, pivot_pos - (l_size / 4 + 1));
+                    std::iter_swap(pivot_pos - 3, pivot_pos - (l_size / 4 + 2));
+                }
+            }
+            if (r_size >= insertion_sort_threshold) {
+                std::iter_swap(pivot_pos + 1, pivot_pos + (1 + r_size / 4));
+                std::iter_swap(end - 1, end - r_size / 4);
+                if (r_size > ninther_threshold) {
+                    std::iter_swap(pivot_pos + 2, pivot_pos + (2 + r_size / 4));
+                    std::iter_swap(pivot_pos + 3, pivot_pos + (3 + r_size / 4));
+                    std::iter_swap(end - 2, end - (1 + r_size / 4));
+                    std::iter_swap(end - 3, end - (2 + r_size / 4));
+                }
+            }
+        } else if (already_partitioned && partial_insertion_sort(begin, pivot_pos, comp) &&
+                   partial_insertion_sort(pivot_pos + 1, end, comp)) {
+            // Likely sorted input: both sides finished cheaply.
+            return;
+        }
+
+        // Recurse into the left part, loop on the right.
+        sort_loop<Branchless>(begin, pivot_pos, comp, bad_allowed, leftmost);
+        begin = pivot_pos + 1;
+        leftmost = false;
+    }
+}
+
+template<bool Branchless, typename It, typename Cmp>
+inline void sort(It begin, It end, Cmp comp) {
+    if (end - begin < 2) return;
+    sort_loop<Branchless>(begin, end, comp, std::bit_width(static_cast<size_t>(end - begin)));
+}
+
+} // namespace pdq
+
+// Branchless partitioning only pays off when a comparison is a cheap
+// arithmetic compare.
+template<typename T, typename Cmp>
+inline constexpr bool cheap_compare = std::is_arithmetic_v<T> &&
+    (std::is_same_v<Cmp, std::less<>> || std::is_same_v<Cmp, std::less<T>> ||
+     std::is_same_v<Cmp, std::greater<>> || std::is_same_v<Cmp, std::greater<T>>);
+
+// --- radix sort ---
+// Maps a key to an unsigned integer with the same ordering.
+template<typename K>
+inline auto radix_key(K k) {
+    if constexpr (std::is_floating_point_v<K>) {
+        using U = std::conditional_t<sizeof(K) == 4, uint32_t, uint64_t>;
+        static_assert(sizeof(K) == sizeof(U), "radix keys support float and double");
+        const U bits = std::bit_cast<U>(k);
+        constexpr U sign = U{1} << (sizeof(U) * 8 - 1);
+        return (bits & sign) ? static_cast<U>(~bits) : static_cast<U>(bits | sign);
+    } else if constexpr (std::is_signed_v<K>) {
+        using U = std::make_unsigned_t<K>;
+        return static_cast<U>(static_cast<U>(k) ^ (U{1} << (sizeof(U) * 8 - 1)));
+    } else {
+        return static_cast<std::make_unsigned_t<K>>(k);
+    }
+}
+
+template<typename T, typename KeyFn>
+inline void radix_sort(T* data, size_t n, KeyFn& key) {
+    using U = decltype(radix_key(key(*data)));
+    constexpr size_t passes = sizeof(U);
+    if (n < 64) {
+        std::stable_sort(data, data + n, [&](const T& a, const T& b) { return radix_key(key(a)) < radix_key(key(b)); });
+        return;
+    }
+    // All histograms in one read.
+    size_t counts[passes][256] = {};
+    for (size_t i = 0; i < n; ++i) {
+        const U k = radix_key(key(data[i]));
+        for (size_t p = 0; p < passes; ++p) ++counts[p][(k >> (8 * p)) & 0xFF];
+    }
+    std::vector<T> buf(n);
+    T* src = data;
+    T* dst = buf.data();
+    const U first = radix_key(key(data[0]));
+    for (size_t p = 0; p < passes; ++p) {
+        auto& count = counts[p];
+        if (count[(first >> (8 * p)) & 0xFF] == n) continue; // every key shares this byte
+        size_t offset = 0;
+        for (size_t& c : count) offset += std::exchange(c, offset);
+        for (size_t i = 0; i < n; ++i) {
+            const size_t digit = (radix_key(key(src[i])) >> (8 * p)) & 0xFF;
+            dst[count[digit]++] = std::move(src[i]);
+        }
+        std::swap(src, dst);
+    }
+    if (src != data) std::move(src, src + n, data);
+}
+
+// --- parallel merge sort ---
+template<typename It, typename Out, typename Cmp>
+inline void par_merge(It a0, It a1, It b0, It b1, Out out, Cmp& comp, int depth) {
+    constexpr ptrdiff_t serial = 1 << 14;
+    if (depth <= 0 || (a1 - a0) + (b1 - b0) < serial) {
+        std::merge(std::make_move_iterator(a0), std::make_move_iterator(a1), std::make_move_iterator(b0),
+                   std::make_move_iterator(b1), out, comp);
+        return;
+    }
+    // Split the longer run at its middle and the other at the matching
+    // bound, keeping equal elements of the left run first (stability).
+    It am, bm;
+    if (a1 - a0 >= b1 - b0) {
+        am = a0 + (a1 - a0) / 2;
+        bm = std::lower_bound(b0, b1, *am, comp);
+    } else {
+        bm = b0 + (b1 - b0) / 2;
+        am = std::upper_bound(a0, a1, *bm, comp);
+    }
+    const Out out_mid = out + ((am - a0) + (bm - b0));
+    std::thread left([&] { par_merge(a0, am, b0, bm, out, comp, depth - 1); });
+    par_merge(am, a1, bm, b1, out_mid, comp, depth - 1);
+    left.join();
+}
+
+// Sorts [first, last) using buf (same length) as scratch.
+template<typename It, typename Buf, typename Cmp>
+inline void par_merge_sort(It first, It last, Buf buf, Cmp& comp, int depth) {
+    constexpr ptrdiff_t serial = 1 << 14;
+    const ptrdiff_t n = last - first;
+    if (depth <= 0 || n < serial) {
+        std::stable_sort(first, last, comp);
+        return;
+    }
+    const It mid = first + n / 2;
+    std::thread left([&] { par_merge_sort(first, mid, buf, comp, depth - 1); });
+    par_merge_sort(mid, last, buf + n / 2, comp, depth - 1);
+    left.join();
+    par_merge(first, mid, mid, last, buf, comp, depth);
+    std::move(buf, buf + n, first);
+}
+
+inline int par_depth() {
+    const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    return static_cast<int>(std::bit_width(threads - 1)); // ceil(log2(threads))
+}
+
+} // namespace rs_detail
+
+// --- sort_unstable / sort_unstable_by / sort_unstable_by_key ---
+template<std::ranges::random_access_range R, typename Less>
+inline void sort_unstable_by(R&& xs, Less less) {
+    using T = std::ranges::range_value_t<R>;
+    constexpr bool branchless = rs_detail::cheap_compare<T, Less>;
+    rs_detail::pdq::sort<branchless>(std::ranges::begin(xs), std::ranges::end(xs), less);
+}
+template<std::ranges::random_access_range R>
+inline void sort_unstable(R&& xs) {
+    sort_unstable_by(xs, std::less<>());
+}
+// `key` should be cheap (a field access); see sort_by_cached_key otherwise.
+template<std::ranges::random_access_range R, typename KeyFn>
+inline void sort_unstable_by_key(R&& xs, KeyFn key) {
+    using K = std::decay_t<std::invoke_result_t<KeyFn&, std::ranges::range_reference_t<R>>>;
+    auto less = [&key](const auto& a, const auto& b) { return key(a) < key(b); };
+    rs_detail::pdq::sort<std::is_arithmetic_v<K>>(std::ranges::begin(xs), std::ranges::end(xs), less);
+}
+
+// --- radix_sort / radix_sort_by_key ---
+template<std::ranges::contiguous_range R>
+    requires std::is_arithmetic_v<std::ranges::range_value_t<R>>
+inline void radix_sort(R&& xs) {
+    auto identity = [](auto v) { return v; };
+    rs_detail::radix_sort(std::ranges::data(xs), std::ranges::size(xs), identity);
+}
+// Stable. `key` must return an integer or float and is called about
+// (1 + byte passes) times per element, so keep it cheap.
+template<std::ranges::contiguous_range R, typename KeyFn>
+inline void radix_sort_by_key(R&& xs, KeyFn key) {
+    using T = std::ranges::range_value_t<R>;
+    using K = std::decay_t<std::invoke_result_t<KeyFn&, const T&>>;
+    static_assert(std::is_arithmetic_v<K>, "radix_sort_by_key needs an integer or float key");
+    static_assert(std::is_default_constructible_v<T>, "radix_sort_by_key needs a default-constructible element type");
+    rs_detail::radix_sort(std::ranges::data(xs), std::ranges::size(xs), key);
+}
+
+// --- sort_by_cached_key ---
+// Stable: equal keys keep their relative order.
+template<std::ranges::random_access_range R, typename KeyFn>
+inline void sort_by_cached_key(R&& xs, KeyFn key) {
+    using K = std::decay_t<std::invoke_result_t<KeyFn&, std::ranges::range_reference_t<R>>>;
+    auto first = std::ranges::begin(xs);
+    const size_t n = static_cast<size_t>(std::ranges::size(xs));
+    if (n < 2) return;
+    std::vector<std::pair<K, size_t>> keyed;
+    keyed.reserve(n);
+    for (size_t i = 0; i < n; ++i) keyed.emplace_back(key(first[i]), i);
+    sort_unstable(keyed); // index breaks ties, so this is stable
+    // Apply the permutation with swaps: position i takes the element that
+    // was at keyed[i].second, following earlier swaps to where it moved.
+    for (size_t i = 0; i < n; ++i) {
+        size_t idx = keyed[i].second;
+        while (idx < i) idx = keyed[idx].second;
+        keyed[i].second = idx;
+        std::iter_swap(first + i, first + idx);
+    }
+}
+
+// --- par_sort / par_sort_by ---
+template<std::ranges::random_access_range R, typename Less>
+inline void par_sort_by(R&& xs, Less less) {
+    using T = std::ranges::range_value_t<R>;
+    static_assert(std::is_default_constructible_v<T>, "par_sort needs a default-constructible element type");
+    const auto n = std::ranges::size(xs);
+    if (n < 2) return;
+    std::vector<T> buf(n);
+    rs_detail::par_merge_sort(std::ranges::begin(xs), std::ranges::end(xs), buf.begin(), less, rs_detail::par_depth());
+}
+template<std::ranges::random_access_range R>
+inline void par_sort(R&& xs) {
+    par_sort_by(xs, std::less<>());
+}
+
+// --- binary_search / partition_point ---
+// Rust's contract: Ok(index) of a matching element (any one, if several
+// match) or Err(index) where the value would be inserted to keep order.
+// The loop has no data-dependent branch: each step halves the range with a
+// conditional move, and large ranges prefetch both possible next probes.
+//   binary_search(xs, x)                  -> Result<usize, usize>
+//   binary_search_by(xs, f)               f(elem) -> ordering of elem vs target (e.g. elem <=> t)
+//   binary_search_by_key(xs, key, f)      compares f(elem) with key
+//   partition_point(xs, pred)             first index where pred is false
+namespace rs_detail {
+
+// Index of the first element for which `before(elem)` is false, assuming
+// xs is partitioned (all trues first).
+template<typename It, typename Pred>
+inline size_t branchless_lower_bound(It first, size_t len, Pred& before) {
+    It base = first;
+    while (len > 1) {
+        const size_t half = len / 2;
+        if (len >= 64) {
+            __builtin_prefetch(std::addressof(base[half / 2]));
+            __builtin_prefetch(std::addressof(base[half + half / 2]));
+        }
+        base = before(base[half]) ? base + half : base;
+        len -= half;
+    }
+    return static_cast<size_t>(base - first) + (len == 1 && before(*base));
+}
+
+} // namespace rs_detail
+
+template<std::ranges::random_access_range R, typename F>
+inline Result<size_t, size_t> binary_search_by(const R& xs, F f) {
+    auto first = std::ranges::begin(xs);
+    const size_t n = static_cast<size_t>(std::ranges::size(xs));
+    auto before = [&f](const auto& e) { return f(e) < 0; };
+    const size_t i = rs_detail::branchless_lower_bound(first, n, before);
+    if (i < n && f(first[i]) == 0) return Ok(i);
+    return Err(i);
+}
+// Only needs operator< on the element type.
+template<std::ranges::random_access_range R, typename T>
+inline Result<size_t, size_t> binary_search(const R& xs, const T& x) {
+    auto first = std::ranges::begin(xs);
+    const size_t n = static_cast<size_t>(std::ranges::size(xs));
+    auto before = [&x](const auto& e) { return e < x; };
+    const size_t i = rs_detail::branchless_lower_bound(first, n, before);
+    if (i < n && !(x < first[i])) return Ok(i);
+    return Err(i);
+}
+template<std::ranges::random_access_range R, typename K, typename KeyFn>
+inline Result<size_t, size_t> binary_search_by_key(const R& xs, const K& key, KeyFn f) {
+    auto first = std::ranges::begin(xs);
+    const size_t n = static_cast<size_t>(std::ranges::size(xs));
+    auto before = [&](const auto& e) { return f(e) < key; };
+    const size_t i = rs_detail::branchless_lower_bound(first, n, before);
+    if (i < n && !(key < f(first[i]))) return Ok(i);
+    return Err(i);
+}
+
+template<std::ranges::random_access_range R, typename Pred>
+inline size_t partition_point(const R& xs, Pred pred) {
+    return rs_detail::branchless_lower_bound(std::ranges::begin(xs), static_cast<size_t>(std::ranges::size(xs)), pred);
+}
+
+// --- retain / retain_mut / dedup ---
+// Single-pass compaction: each kept element is moved at most once, the
+// predicate runs exactly once per element in order, and the tail is erased
+// in one call.
+//   retain(v, keep)              keep(const T&) -> bool
+//   retain_mut(v, keep)          keep(T&) -> bool, may edit kept elements
+//   dedup(v)                     drops consecutive equal elements
+//   dedup_by_key(v, key)         ... with equal key(elem)
+//   dedup_by(v, same)            same(const T& cur, const T& prev_kept) -> bool
+template<typename T, typename A, typename Pred>
+inline void retain_mut(std::vector<T, A>& v, Pred keep) {
+    const size_t n = v.size();
+    size_t w = 0;
+    for (size_t r = 0; r < n; ++r) {
+        if (keep(v[r])) {
+            if (w != r) v[w] = std::move(v[r]);
+            ++w;
+        }
+    }
+    v.erase(v.begin() + static_cast<ptrdiff_t>(w), v.end());
+}
+template<typename T, typename A, typename Pred>
+inline void retain(std::vector<T, A>& v, Pred keep) {
+    retain_mut(v, [&keep](const T& x) { return keep(x); });
+}
+
+template<typename T, typename A, typename Same>
+inline void dedup_by(std::vector<T, A>& v, Same same) {
+    const size_t n = v.size();
+    if (n < 2) return;
+    size_t w = 1;
+    for (size_t r = 1; r < n; ++r) {
+        if (!same(std::as_const(v[r]), std::as_const(v[w - 1]))) {
+            if (w != r) v[w] = std::move(v[r]);
+            ++w;
+        }
+    }
+    v.erase(v.begin() + static_cast<ptrdiff_t>(w), v.end());
+}
+template<typename T, typename A, typename KeyFn>
+inline void dedup_by_key(std::vector<T, A>& v, KeyFn key) {
+    dedup_by(v, [&key](const T& a, const T& b) { return key(a) == key(b); });
+}
+template<typename T, typename A>
+inline void dedup(std::vector<T, A>& v) {
+    dedup_by(v, [](const T& a, const T& b) { return a == b; });
+}
+
+// --- SIMD reductions and elementwise map ---
+// Explicit kernels (GCC vector extensions), compiled for AVX-512, AVX2 and the
+// baseline target and picked at runtime by cpu::level(), so results do not
+// depend on the autovectorizer. Float sums and dot products use as many
+// partial sums as the chosen tier has lanes, so their last bits can differ
+// between tiers. Elements are any arithmetic type; inputs are any contiguous
+// range (Vec<T>, Slice<T>, std::array).
+//   simd::sum(xs)            -> T; integers wrap, floats use 4 vector accumulators
+//   simd::dot(xs, ys)        -> T; panics if the lengths differ
+//   simd::min(xs) / max(xs)  -> Option<T>; None when empty, NaNs skipped
+//   simd::argmin / argmax    -> Option<usize>; first index of the extremum
+//   simd::map(xs, f)         -> Vec<T>; f is called on 16-byte batches
+//   simd::map_into(xs, out, f)  same, into `out` (which may alias xs)
+namespace rs_detail {
+
+template<typename T>
+concept simd_elem = std::is_arithmetic_v<T> && !std::is_same_v<T, bool>;
+
+// Integer lanes compute in the unsigned type so that overflow wraps.
+template<typename T>
+using simd_lane_t = typename std::conditional_t<std::is_integral_v<T>, std::make_unsigned<T>, std::type_identity<T>>::type;
+
+// Identity for min (Max = false) or max: NaN comparisons are false, so NaNs
+// never replace it.
+template<typename T, bool Max>
+constexpr T extremum_identity() {
+    if constexpr (std::is_floating_point_v<T>)
+        return Max ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::infinity();
+    else
+        return Max ? std::numeric_limits<T>::min() : std::numeric_limits<T>::max();
+}
+
+template<size_t W, typename T>
+__attribute__((always_inline)) inline T sum_body(const T* p, size_t n) {
+    using L = simd_lane_t<T>;
+    typedef L V __attribute__((vector_size(W)));
+    constexpr size_t lanes = W / sizeof(T);
+    V a0{}, a1{}, a2{}, a3{};
+    size_t i = 0;
+    for (; i + 4 * lanes <= n; i += 4 * lanes) {
+        V x0, x1, x2, x3;
+        std::memcpy(&x0, p + i, sizeof(V));
+        std::memcpy(&x1, p + i + lanes, sizeof(V));
+        std::memcpy(&x2, p + i + 2 * lanes, sizeof(V));
+        std::memcpy(&x3, p + i + 3 * lanes, sizeof(V));
+        a0 += x0;
+        a1 += x1;
+        a2 += x2;
+        a3 += x3;
+    }
+    for (; i + lanes <= n; i += lanes) {
+        V x;
+        std::memcpy(&x, p + i, sizeof(V));
+        a0 += x;
+    }
+    a0 = (a0 + a1) + (a2 + a3);
+    L s = 0;
+    for (size_t j = 0; j < lanes; ++j) s += a0[j];
+    for (; i < n; ++i) s += static_cast<L>(p[i]);
+    return static_cast<T>(s);
+}
+
+template<size_t W, typename T>
+__attribute__((always_inline)) inline T dot_body(const T* p, const T* q, size_t n) {
+    using L = simd_lane_t<T>;
+    typedef L V __attribute__((vector_size(W)));
+    constexpr size_t lanes = W / sizeof(T);
+    V a0{}, a1{}, a2{}, a3{};
+    size_t i = 0;
+    for (; i + 4 * lanes <= n; i += 4 * lanes) {
+        V x0, x1, x2, x3, y0, y1, y2, y3;
+        std::memcpy(&x0, p + i, sizeof(V));
+        std::memcpy(&x1, p + i + lanes, sizeof(V));
+        std::memcpy(&x2, p + i + 2 * lanes, sizeof(V));
+        std::memcpy(&x3, p + i + 3 * lanes, sizeof(V));
+        std::memcpy(&y0, q + i, sizeof(V));
+        std::memcpy(&y1, q + i + lanes, sizeof(V));
+        std::memcpy(&y2, q + i + 2 * lanes, sizeof(V));
+        std::memcpy(&y3, q + i + 3 * lanes, sizeof(V));
+        a0 += x0 * y0;
+        a1 += x1 * y1;
+        a2 += x2 * y2;
+        a3 += x3 * y3;
+    }
+    for (; i + lanes <= n; i += lanes) {
+        V x, y;
+        std::memcpy(&x, p + i, sizeof(V));
+        std::memcpy(&y, q + i, sizeof(V));
+        a0 += x * y;
+    }
+    a0 = (a0 + a1) + (a2 + a3);
+    L s = 0;
+    for (size_t j = 0; j < lanes; ++j) s += a0[j];
+    for (; i < n; ++i) s += static_cast<L>(p[i]) * static_cast<L>(q[i]);
+    return static_cast<T>(s);
+}
+
+// Min (Max = false) or max of p[0..n), skipping NaNs. Returns the identity
+// when every element is NaN.
+template<size_t W, typename T, bool Max>
+__attribute__((always_inline)) inline T extremum_body(const T* p, size_t n) {
+    typedef T V __attribute__((vector_size(W)));
+    constexpr size_t lanes = W / sizeof(T);
+    constexpr T init = extremum_identity<T, Max>();
+    T r = init;
+    size_t i = 0;
+    if (n >= lanes) {
+        V a = V{} + init, b = a;
+        for (; i + 2 * lanes <= n; i += 2 * lanes) {
+            V x0, x1;
+            std::memcpy(&x0, p + i, sizeof(V));
+            std::memcpy(&x1, p + i + lanes, sizeof(V));
+            if constexpr (Max) {
+                a = x0 > a ? x0 : a;
+                b = x1 > b ? x1 : b;
+            } else {
+                a = x0 < a ? x0 : a;
+                b = x1 < b ? x1 : b;
+            }
+        }
+        for (; i + lanes <= n; i += lanes) {
+            V x;
+            std::memcpy(&x, p + i, sizeof(V));
+            if constexpr (Max) a = x > a ? x : a;
+            else a = x < a ? x : a;
+        }
+        if constexpr (Max) a = b > a ? b : a;
+        else a = b < a ? b : a;
+        for (size_t j = 0; j < lanes; ++j) r = (Max ? a[j] > r : a[j] < r) ? a[j] : r;
+    }
+    for (; i < n; ++i) r = (Max ? p[i] > r : p[i] < r) ? p[i] : r;
+    return r;
+}
+
+// Index of the first element equal to `value`, or n.
+template<size_t W, typename T>
+__attribute__((always_inline)) inline size_t find_body(const T* p, size_t n, T value) {
+    typedef T V __attribute__((vector_size(W)));
+    constexpr size_t lanes = W / sizeof(T);
+    const V target = V{} + value;
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        V x;
+        std::memcpy(&x, p + i, sizeof(V));
+        const auto eq = x == target;
+        uint64_t m[W / 8];
+        std::memcpy(m, &eq, W);
+        uint64_t any = 0;
+        for (size_t j = 0; j < W / 8; ++j) any |= m[j];
+        if (any != 0) break;
+    }
+    for (; i < n; ++i)
+        if (p[i] == value) return i;
+    return n;
+}
+
+// dst[i] = f(src[i]), with f applied to 16-byte batches. Batches stay at
+// 16 bytes because f is a user function: a 32-byte vector argument would
+// change its calling convention between the AVX2 and baseline kernels.
+template<typename T, typename F>
+__attribute__((always_inline)) inline void map_body(const T* src, T* dst, size_t n, F& f) {
+    typedef T V __attribute__((vector_size(16)));
+    constexpr size_t lanes = 16 / sizeof(T);
+    size_t i = 0;
+    for (; i + 2 * lanes <= n; i += 2 * lanes) {
+        V x0, x1;
+        std::memcpy(&x0, src + i, sizeof(V));
+        std::memcpy(&x1, src + i + lanes, sizeof(V));
+        const V y0 = f(x0), y1 = f(x1);
+        std::memcpy(dst + i, &y0, sizeof(V));
+        std::memcpy(dst + i + lanes, &y1, sizeof(V));
+    }
+    for (; i < n; ++i) dst[i] = static_cast<T>(f(src[i]));
+}
+
+template<typename T>
+inline T sum_generic(const T* p, size_t n) { return sum_body<16>(p, n); }
+template<typename T>
+inline T dot_generic(const T* p, const T* q, size_t n) { return dot_body<16>(p, q, n); }
+template<typename T, bool Max>
+inline T extremum_generic(const T* p, size_t n) { return extremum_body<16, T, Max>(p, n); }
+template<typename T>
+inline size_t find_generic(const T* p, size_t n, T value) { return find_body<16>(p, n, value); }
+template<typename T, typename F>
+inline void map_generic(const T* src, T* dst, size_t n, F& f) { map_body(src, dst, n, f); }
+
+#ifdef RS_X86_SIMD
+template<typename T>
+RS_TARGET_AVX2 inline T sum_avx2(const T* p, size_t n) { return sum_body<32>(p, n); }
+template<typename T>
+RS_TARGET_AVX2 inline T dot_avx2(const T* p, const T* q, size_t n) { return dot_body<32>(p, q, n); }
+template<typename T, bool Max>
+RS_TARGET_AVX2 inline T extremum_avx2(const T* p, size_t n) { return extremum_body<32, T, Max>(p, n); }
+template<typename T>
+RS_TARGET_AVX2 inline size_t find_avx2(const T* p, size_t n, T value) { return find_body<32>(p, n, value); }
+template<typename T>
+RS_TARGET_AVX512 inline T sum_avx512(const T* p, size_t n) { return sum_body<64>(p, n); }
+template<typename T>
+RS_TARGET_AVX512 inline T dot_avx512(const T* p, const T* q, size_t n) { return dot_body<64>(p, q, n); }
+template<typename T, bool Max>
+RS_TARGET_AVX512 inline T extremum_avx512(const T* p, size_t n) { return extremum_body<64, T, Max>(p, n); }
+template<typename T>
+RS_TARGET_AVX512 inline size_t find_avx512(const T* p, size_t n, T value) { return find_body<64>(p, n, value); }
+template<typename T, typename F>
+RS_TARGET_AVX2 inline void map_avx2(const T* src, T* dst, size_t n, F& f) { map_body(src, dst, n, f); }
+#endif
+
+template<typename T>
+inline T simd_sum(const T* p, size_t n) {
+    using Kernel = T (*)(const T*, size_t);
+    static const Kernel kernel =
+        best_kernel<Kernel>(&sum_generic<T>, nullptr, RS_X86_KERNEL(&sum_avx2<T>), RS_X86_KERNEL(&sum_avx512<T>));
+    return kernel(p, n);
+}
+
+template<typename T>
+inline T simd_dot(const T* p, const T* q, size_t n) {
+    using Kernel = T (*)(const T*, const T*, size_t);
+    static const Kernel kernel =
+        best_kernel<Kernel>(&dot_generic<T>, nullptr, RS_X86_KERNEL(&dot_avx2<T>), RS_X86_KERNEL(&dot_avx512<T>));
+    return kernel(p, q, n);
+}
+
+// n > 0. Floats: NaNs are skipped; if every element is NaN, returns p[0].
+template<typename T, bool Max>
+inline T simd_extremum(const T* p, size_t n) {
+    using Kernel = T (*)(const T*, size_t);
+    static const Kernel kernel = best_kernel<Kernel>(&extremum_generic<T, Max>, nullptr,
+                                                     RS_X86_KERNEL((&extremum_avx2<T, Max>)),
+                                                     RS_X86_KERNEL((&extremum_avx512<T, Max>)));
+    const T r = kernel(p, n);
+    if constexpr (std::is_floating_point_v<T>) {
+        if (r == extremum_identity<T, Max>()) {
+            for (size_t i = 0; i < n; ++i)
+                if (p[i] == p[i]) return r;
+            return p[0];
+        }
+    }
+    return r;
+}
+
+template<typename T>
+inline size_t simd_find(const T* p, size_t n, T value) {
+    using Kernel = size_t (*)(const T*, size_t, T);
+    static const Kernel kernel =
+        best_kernel<Kernel>(&find_generic<T>, nullptr, RS_X86_KERNEL(&find_avx2<T>), RS_X86_KERNEL(&find_avx512<T>));
+    return kernel(p, n, value);
+}
+
+template<typename T, bool Max>
+inline Option<size_t> simd_arg_extremum(const T* p, size_t n) {
+    if (n == 0) return None();
+    const T r = simd_extremum<T, Max>(p, n);
+    if (r != r) return Some(size_t{0});
+    return Some(simd_find(p, n, r));
+}
+
+template<typename T, typename F>
+inline void simd_map(const T* src, T* dst, size_t n, F& f) {
+    using Kernel = void (*)(const T*, T*, size_t, F&);
+    static const Kernel kernel =
+        best_kernel<Kernel>(&map_generic<T, F>, nullptr, RS_X86_KERNEL((&map_avx2<T, F>)), nullptr);
+    kernel(src, dst, n, f);
+}
+
+} // namespace rs_detail
+
+namespace simd {
+
+template<typename C, typename T = std::ranges::range_value_t<const C&>>
+    requires std::ranges::contiguous_range<const C&> && rs_detail::simd_elem<T>
+inline T sum(const C& xs) {
+    const std::span<const T> s(xs);
+    return rs_detail::simd_sum(s.data(), s.size());
+}
+
+template<typename C, typename D, typename T = std::ranges::range_value_t<const C&>>
+    requires std::ranges::contiguous_range<const C&> && std::ranges::contiguous_range<const D&> &&
+             std::is_same_v<T, std::ranges::range_value_t<const D&>> && rs_detail::simd_elem<T>
+inline T dot(const C& xs, const D& ys) {
+    const std::span<const T> a(xs), b(ys);
+    if (a.size() != b.size()) rs_panic("simd::dot: slices have different lengths");
+    return rs_detail::simd_dot(a.data(), b.data(), a.size());
+}
+
+template<typename C, typename T = std::ranges::range_value_t<const C&>>
+    requires std::ranges::contiguous_range<const C&> && rs_detail::simd_elem<T>
+inline Option<T> min(const C& xs) {
+    const std::span<const T> s(xs);
+    if (s.empty()) return None();
+    return Some(rs_detail::simd_extremum<T, false>(s.data(), s.size()));
+}
+
+template<typename C, typename T = std::ranges::range_value_t<const C&>>
+    requires std::ranges::contiguous_range<const C&> && rs_detail::simd_elem<T>
+inline Option<T> max(const C& xs) {
+    const std::span<const T> s(xs);
+    if (s.empty()) return None();
+    return Some(rs_detail::simd_extremum<T, true>(s.data(), s.size()));
+}
+
+template<typename C, typename T = std::ranges::range_value_t<const C&>>
+    requires std::ranges::contiguous_range<const C&> && rs_detail::simd_elem<T>
+inline Option<size_t> argmin(const C& xs) {
+    const std::span<const T> s(xs);
+    return rs_detail::simd_arg_extremum<T, false>(s.data(), s.size());
+}
+
+template<typename C, typename T = std::ranges::range_value_t<const C&>>
+    requires std::ranges::contiguous_range<const C&> && rs_detail::simd_elem<T>
+inline Option<size_t> argmax(const C& xs) {
+    const std::span<const T> s(xs);
+    return rs_detail::simd_arg_extremum<T, true>(s.data(), s.size());
+}
+
+template<typename C, typename F, typename T = std::ranges::range_value_t<const C&>>
+    requires std::ranges::contiguous_range<const C&> && rs_detail::simd_elem<T>
+inline void map_into(const C& xs, std::span<T> out, F f) {
+    const std::span<const T> s(xs);
+    if (s.size() != out.size()) rs_panic("simd::map_into: output length differs from input");
+    rs_detail::simd_map(s.data(), out.data(), s.size(), f);
+}
+
+template<typename C, typename F, typename T = std::ranges::range_value_t<const C&>>
+    requires std::ranges::contiguous_range<const C&> && rs_detail::simd_elem<T>
+inline std::vector<T> map(const C& xs, F f) {
+    const std::span<const T> s(xs);
+    std::vector<T> out(s.size());
+    rs_detail::simd_map(s.data(), out.data(), s.size(), f);
+    return out;
+}
+
+} // namespace simd
+
+#endif // ENABLE_RS_SLICE
+
+// ==========================================
+// 10. Cells (one-time initialization, interior mutability)
+// ==========================================
+// Requires: ENABLE_RS_CELL (+ ENABLE_RS_ERROR)
+//
+// - `OnceCell<T>`: a slot written at most once and then read from any thread,
+//   like Rust's OnceLock. Readers pay one acquire load once the value is set.
+//   - `get()` -> Option<const T&>: None until initialized.
+//   - `get_or_init(f)`: the first caller runs `f`. Concurrent callers sleep on
+//     the state word (a futex on Linux, via std::atomic::wait) until `f`
+//     returns, then share its value.
+//   - `get_or_try_init(f)` with `f() -> Result<T, E>` -> Result<const T&, E>:
+//     an Err is returned to its caller and the cell stays empty, so the next
+//     caller retries instead of seeing a cached failure. A throwing `f`
+//     behaves the same way.
+//   - `set(value)` -> Result<Unit, T>: Err(value) if the cell was already set.
+// - `LazyLock<T>`: a value computed by its init function on first access.
+//   `*lazy` and `lazy->` force it.
+//
+// Both have constexpr constructors, so a namespace-scope object is
+// constant-initialized: no guard variable and no static-init order issues.
+// A function-local static also skips the guard only when the type is
+// trivially destructible (T and the init callable); otherwise the compiler
+// guards the atexit registration of its destructor.
+//
+// - `Cell<T>` and `RefCell<T>`: single-threaded interior mutability. RefCell
+//   tracks borrows and panics on aliasing bugs in debug builds; with NDEBUG
+//   (or RS_REFCELL_CHECKED=0) the tracking compiles out entirely.
+//
+// Example:
+//   static LazyLock<Vec<u32>> CRC_TABLE([] { return build_crc_table(); });
+//   u32 crc = (*CRC_TABLE)[byte];
+//
+//   OnceCell<Config> config;
+//   let cfg = config.get_or_try_init([] { return Config::load("app.toml"); });
+//   if (!cfg) return Err(cfg.unwrap_err()); // next call tries to load again
+//
+//   RefCell<Vec<Event>> log;
+//   log.borrow_mut()->push_back(ev);
+//   for (const auto& e : *log.borrow()) print(e);
+#ifdef ENABLE_RS_CELL
+
+namespace rs_detail {
+
+template<typename R>
+struct result_traits;
+template<typename T, typename E>
+struct result_traits<Result<T, E>> {
+    using value_type = T;
+    using error_type = E;
+};
+
+} // namespace rs_detail
+
+template<typename T>
+class OnceCell {
+    enum : uint32_t { Empty, Running, Ready };
+    std::atomic<uint32_t> state{Empty};
+    union {
+        unsigned char unset; // active member until the value is constructed
+        T value;
+    };
+
+    // Claims the right to initialize. Returns false once another thread has
+    // set the value; sleeps while another initializer is running.
+    bool claim() {
+        uint32_t s = state.load(std::memory_order_acquire);
+        for (;;) {
+            if (s == Ready) return false;
+            if (s == Empty) {
+                if (state.compare_exchange_weak(s, Running, std::memory_order_acquire)) return true;
+                continue;
+            }
+            state.wait(Running, std::memory_order_acquire);
+            s = state.load(std::memory_order_acquire);
+        }
+    }
+    void finish(uint32_t to) {
+        state.store(to, std::memory_order_release);
+        state.notify_all();
+    }
+    // Reopens the cell if the initializer exits without publishing (Err or
+    // exception), waking waiters so one of them can retry.
+    struct Abandon {
+        OnceCell* cell;
+        ~Abandon() { if (cell) cell->finish(Empty); }
+    };
+
+    template<typename F>
+    __attribute__((noinline)) const T& init_slow(F& f) {
+        if (claim()) {
+            Abandon guard{this};
+            ::new (static_cast<void*>(std::addressof(value))) T(f());
+            guard.cell = nullptr;
+            finish(Ready);
+        }
+        return value;
+    }
+
+public:
+    constexpr OnceCell() noexcept : unset(0) {}
+    OnceCell(const OnceCell&) = delete;
+    OnceCell& operator=(const OnceCell&) = delete;
+    // Trivial for trivially destructible T, so a function-local static
+    // needs neither a guard variable nor an atexit registration.
+    ~OnceCell() requires std::is_trivially_destructible_v<T> = default;
+    ~OnceCell() {
+        if (state.load(std::memory_order_relaxed) == Ready) value.~T();
+    }
+
+    bool is_initialized() const { return state.load(std::memory_order_acquire) == Ready; }
+
+    Option<const T&> get() const {
+        if (is_initialized()) return Option<const T&>(value);
+        return None();
+    }
+
+    template<typename F>
+    const T& get_or_init(F&& f) {
+        if (is_initialized()) [[likely]] return value;
+        return init_slow(f);
+    }
+
+    template<typename F, typename R = std::invoke_result_t<F&>,
+             typename E = typename rs_detail::result_traits<R>::error_type>
+    Result<const T&, E> get_or_try_init(F&& f) {
+        if (is_initialized()) [[likely]] return Result<const T&, E>(value);
+        if (claim()) {
+            Abandon guard{this};
+            R r = f();
+            if (r.is_err()) return Err(std::move(r.unwrap_err()));
+            ::new (static_cast<void*>(std::addressof(value))) T(std::move(r.unwrap()));
+            guard.cell = nullptr;
+            finish(Ready);
+        }
+        return Result<const T&, E>(value);
+    }
+
+    Result<Unit, T> set(T v) {
+        if (!claim()) return Err(std::move(v));
+        Abandon guard{this};
+        ::new (static_cast<void*>(std::addressof(value))) T(std::move(v));
+        guard.cell = nullptr;
+        finish(Ready);
+        return Ok();
+    }
+};
+
+template<typename T, typename F = T (*)()>
+class LazyLock {
+    mutable OnceCell<T> cell;
+    mutable F init;
+public:
+    constexpr explicit LazyLock(F f) : init(std::move(f)) {}
+    LazyLock(const LazyLock&) = delete;
+    LazyLock& operator=(const LazyLock&) = delete;
+
+    // Runs the initializer on first use; later calls are one acquire load.
+    const T& force() const { return cell.get_or_init(init); }
+    const T& operator*() const { return force(); }
+    const T* operator->() const { return &force(); }
+    bool is_initialized() const { return cell.is_initialized(); }
+};
+template<typename F>
+LazyLock(F) -> LazyLock<std::invoke_result_t<F&>, F>;
+
+// --- Cell / RefCell ---
+// Single-threaded interior mutability: both mutate through a const reference.
+// - `Cell<T>`: get (copy out), set, replace, take. Never hands out references,
+//   so it needs no tracking at all.
+// - `RefCell<T>`: `borrow()` -> Ref<T>, `borrow_mut()` -> RefMut<T>, which
+//   panic on a conflicting borrow; `try_borrow()` / `try_borrow_mut()` return
+//   Result<Ref<T>, BorrowError> / Result<RefMut<T>, BorrowError> instead.
+//
+// Borrow tracking is on when RS_REFCELL_CHECKED is 1, which is the default
+// unless NDEBUG is defined. With it off, RefCell<T> has the size of T, Ref and
+// RefMut are a bare pointer, borrow() compiles to taking an address, and the
+// try_ functions always succeed. Use the same setting in every translation
+// unit: it changes the layout of RefCell.
+#ifndef RS_REFCELL_CHECKED
+#ifdef NDEBUG
+#define RS_REFCELL_CHECKED 0
+#else
+#define RS_REFCELL_CHECKED 1
+#endif
+#endif
+
+template<typename T>
+class Cell {
+    mutable T value;
+public:
+    constexpr Cell() requires std::is_default_constructible_v<T> : value() {}
+    constexpr explicit Cell(T v) : value(std::move(v)) {}
+    Cell(const Cell& o) : value(o.get()) {}
+    Cell& operator=(const Cell& o) { set(o.get()); return *this; }
+
+    T get() const { return value; }
+    void set(T v) const { value = std::move(v); }
+    T replace(T v) const { return std::exchange(value, std::move(v)); }
+    T take() const { return replace(T()); }
+    void swap(const Cell& o) const { std::swap(value, o.value); }
+    // A unique reference to the cell rules out other users, so no copy.
+    T& get_mut() { return value; }
+};
+
+class BorrowError {
+    bool mut_;
+public:
+    explicit BorrowError(bool exclusive) : mut_(exclusive) {}
+    // True when a mutable borrow was refused.
+    bool is_mut() const { return mut_; }
+    std::string to_string() const { return mut_ ? "already borrowed" : "already mutably borrowed"; }
+    friend std::ostream& operator<<(std::ostream& os, const BorrowError& e) { return os << e.to_string(); }
+};
+
+template<typename T> class RefCell;
+
+namespace rs_detail {
+// > 0: number of shared borrows; -1: one mutable borrow.
+using BorrowCount = intptr_t;
+} // namespace rs_detail
+
+template<typename T>
+class Ref {
+    const T* ptr;
+#if RS_REFCELL_CHECKED
+    rs_detail::BorrowCount* count;
+    Ref(const T* p, rs_detail::BorrowCount* c) : ptr(p), count(c) { ++*count; }
+#else
+    explicit Ref(const T* p) : ptr(p) {}
+#endif
+    friend class RefCell<T>;
+public:
+#if RS_REFCELL_CHECKED
+    Ref(const Ref& o) : ptr(o.ptr), count(o.count) { ++*count; }
+    ~Ref() { --*count; }
+    Ref& operator=(const Ref&) = delete;
+#endif
+    const T& operator*() const { return *ptr; }
+    const T* operator->() const { return ptr; }
+    const T& get() const { return *ptr; }
+};
+
+template<typename T>
+class RefMut {
+    T* ptr;
+#if RS_REFCELL_CHECKED
+    rs_detail::BorrowCount* count;
+    RefMut(T* p, rs_detail::BorrowCount* c) : ptr(p), count(c) { *count = -1; }
+#else
+    explicit RefMut(T* p) : ptr(p) {}
+#endif
+    friend class RefCell<T>;
+public:
+    RefMut(const RefMut&) = delete;
+    RefMut& operator=(const RefMut&) = delete;
+#if RS_REFCELL_CHECKED
+    RefMut(RefMut&& o) noexcept : ptr(o.ptr), count(std::exchange(o.count, nullptr)) {}
+    ~RefMut() { if (count) *count = 0; }
+#else
+    RefMut(RefMut&&) noexcept = default;
+#endif
+    T& operator*() const { return *ptr; }
+    T* operator->() const { return ptr; }
+    T& get() const { return *ptr; }
+};
+
+template<typename T>
+class RefCell {
+    mutable T value;
+#if RS_REFCELL_CHECKED
+    mutable rs_detail::BorrowCount count = 0;
+    Ref<T> make_ref() const { return Ref<T>(&value, &count); }
+    RefMut<T> make_mut() const { return RefMut<T>(&value, &count); }
+#else
+    Ref<T> make_ref() const { return Ref<T>(&value); }
+    RefMut<T> make_mut() const { return RefMut<T>(&value); }
+#endif
+public:
+    constexpr RefCell() requires std::is_default_constructible_v<T> : value() {}
+    constexpr explicit RefCell(T v) : value(std::move(v)) {}
+    RefCell(const RefCell& o) : value(*o.borrow()) {}
+    RefCell& operator=(const RefCell& o) { replace(*o.borrow()); return *this; }
+
+    Ref<T> borrow() const {
+#if RS_REFCELL_CHECKED
+        if (count < 0) rs_panic("already mutably borrowed: BorrowError");
+#endif
+        return make_ref();
+    }
+    RefMut<T> borrow_mut() const {
+#if RS_REFCELL_CHECKED
+        if (count != 0) rs_panic("already borrowed: BorrowMutError");
+#endif
+        return make_mut();
+    }
+    Result<Ref<T>, BorrowError> try_borrow() const {
+#if RS_REFCELL_CHECKED
+        if (count < 0) return Err(BorrowError(false));
+#endif
+        return Ok(make_ref());
+    }
+    Result<RefMut<T>, BorrowError> try_borrow_mut() const {
+#if RS_REFCELL_CHECKED
+        if (count != 0) return Err(BorrowError(true));
+#endif
+        return Ok(make_mut());
+    }
+
+    // Panics (when checked) if the value is borrowed.
+    T replace(T v) const { return std::exchange(*borrow_mut(), std::move(v)); }
+    // A unique reference to the cell rules out live borrows.
+    T& get_mut() { return value; }
+};
+
+#endif // ENABLE_RS_CELL
+
+// ==========================================
+// 11. Concurrency (scoped threads, thread pool)
+// ==========================================
+// Requires: ENABLE_RS_SYNC (+ ENABLE_RS_ERROR)
+//
+// - `thread_scope(f)`: calls `f(scope)`, where `scope.spawn(g)` starts a thread
+//   running `g()`. Every thread spawned in the scope is joined before
+//   thread_scope returns, so workers may borrow locals (Rust's
+//   std::thread::scope). If a thread that was never joined explicitly
+//   panicked or threw, thread_scope panics after joining the rest.
+// - `ThreadPool pool(n)`: n long-lived workers (default: one per hardware
+//   thread) sharing one FIFO queue. Idle workers sleep on a condition
+//   variable; they do not spin. `pool.spawn(g)` queues `g()`. The destructor
+//   runs every queued job, then joins the workers.
+// - `join()` on either handle -> Result<T, JoinError> (Result<Unit, JoinError>
+//   for void jobs). A worker's rs_panic (failed unwrap/expect, panic()) or
+//   uncaught exception ends that job and comes back as the JoinError instead
+//   of aborting the process.
+// - A pool job that blocks on another job of the same pool can deadlock once
+//   every worker is waiting; spawn such dependencies on a scope instead.
+//
+// Example:
+//   Vec<u64> totals(4);
+//   thread_scope([&](auto& s) {
+//       for (usize t = 0; t < 4; ++t)
+//           s.spawn([&, t] { totals[t] = sum_chunk(data, t); });
+//   });
+//
+//   ThreadPool pool(8);
+//   auto h = pool.spawn([] { return parse(load()); });
+//   h.join().match(Case(v) { use(v); }, Case(e) { log(e); });
+#ifdef ENABLE_RS_SYNC
+
+class JoinError {
+    std::string msg;
+    bool panicked;
+    std::exception_ptr error;
+public:
+    JoinError(std::string m, bool panic, std::exception_ptr e)
+        : msg(std::move(m)), panicked(panic), error(std::move(e)) {}
+
+    // True for rs_panic (unwrap, expect, panic); false for other exceptions.
+    bool is_panic() const { return panicked; }
+    const std::string& message() const { return msg; }
+    // The caught exception, for std::rethrow_exception.
+    std::exception_ptr payload() const { return error; }
+    std::string to_string() const { return (panicked ? "thread panicked: " : "thread threw: ") + msg; }
+    friend std::ostream& operator<<(std::ostream& os, const JoinError& e) { return os << e.to_string(); }
+};
+
+namespace rs_detail {
+
+template<typename T>
+using join_value_t = std::conditional_t<std::is_void_v<T>, Unit, T>;
+template<typename F>
+using join_result_t = Result<join_value_t<std::invoke_result_t<F&>>, JoinError>;
+
+// Runs f on a worker thread, turning panics and exceptions into JoinError.
+template<typename F>
+join_result_t<F> run_joinable(F& f) {
+    using T = std::invoke_result_t<F&>;
+    const bool outer = panic_unwinds;
+    panic_unwinds = true;
+    struct Restore {
+        bool v;
+        ~Restore() { panic_unwinds = v; }
+    } restore{outer};
+    auto call = [&]() -> join_result_t<F> {
+        if constexpr (std::is_void_v<T>) {
+            f();
+            return Ok();
+        } else {
+            return Ok(f());
+        }
+    };
+#ifdef __cpp_exceptions
+    try {
+        return call();
+    } catch (const PanicPayload& p) {
+        return Err(JoinError(p.msg, true, std::current_exception()));
+    } catch (const std::exception& e) {
+        return Err(JoinError(e.what(), false, std::current_exception()));
+    } catch (...) {
+        return Err(JoinError("unknown exception", false, std::current_exception()));
+    }
+#else
+    return call();
+#endif
+}
+
+// Result slot shared by a job and its handle. `done` flips once the result is
+// written; join() sleeps on it with atomic wait (a futex on Linux).
+template<typename R>
+struct JoinState {
+    std::atomic<uint32_t> done{0};
+    union { R value; };
+
+    JoinState() {}
+    JoinState(const JoinState&) = delete;
+    ~JoinState() {
+        if (done.load(std::memory_order_relaxed)) value.~R();
+    }
+
+    // Runs f and stores its result in place.
+    template<typename F>
+    void run(F& f) {
+        ::new (static_cast<void*>(std::addressof(value))) R(run_joinable(f));
+        done.store(1, std::memory_order_release);
+        done.notify_all();
+    }
+    bool finished() const { return done.load(std::memory_order_acquire) != 0; }
+    R& wait() {
+        while (done.load(std::memory_order_acquire) == 0) done.wait(0, std::memory_order_acquire);
+        return value;
+    }
+};
+
+} // namespace rs_detail
+
+template<typename T>
+class JoinHandle {
+    using R = Result<rs_detail::join_value_t<T>, JoinError>;
+    std::shared_ptr<rs_detail::JoinState<R>> state;
+    friend class ThreadPool;
+    explicit JoinHandle(std::shared_ptr<rs_detail::JoinState<R>> s) : state(std::move(s)) {}
+public:
+    bool is_finished() const { return state && state->finished(); }
+    // Blocks until the job ends. Dropping a handle without joining detaches it.
+    R join() {
+        if (!state) rs_panic("JoinHandle::join called twice");
+        auto s = std::move(state);
+        return std::move(s->wait());
+    }
+};
+
+class ThreadPool {
+    struct Job {
+        virtual ~Job() = default;
+        virtual void run() = 0;
+    };
+    template<typename F>
+    struct JobFor : Job {
+        F f;
+        std::shared_ptr<rs_detail::JoinState<rs_detail::join_result_t<F>>> state;
+        JobFor(F g, decltype(state) s) : f(std::move(g)), state(std::move(s)) {}
+        void run() override { state->run(f); }
+    };
+
+    std::mutex mu;
+    std::condition_variable ready;
+    std::deque<std::unique_ptr<Job>> queue;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    void work() {
+        for (;;) {
+            std::unique_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mu);
+                ready.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+            job->run();
+        }
+    }
+
+public:
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency()) {
+        workers.reserve(std::max<size_t>(threads, 1));
+        for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) workers.emplace_back([this] { work(); });
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto& w : workers) w.join();
+    }
+
+    size_t size() const { return workers.size(); }
+
+    template<typename F>
+    JoinHandle<std::invoke_result_t<std::decay_t<F>&>> spawn(F&& f) {
+        using Fn = std::decay_t<F>;
+        auto state = std::make_shared<rs_detail::JoinState<rs_detail::join_result_t<Fn>>>();
+        auto job = std::make_unique<JobFor<Fn>>(std::forward<F>(f), state);
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            queue.push_back(std::move(job));
+        }
+        ready.notify_one();
+        return JoinHandle<std::invoke_result_t<Fn&>>(std::move(state));
+    }
+};
+
+class Scope;
+
+template<typename T>
+class ScopedJoinHandle {
+    using R = Result<rs_detail::join_value_t<T>, JoinError>;
+    struct Slot;
+    Slot* slot;
+    friend class Scope;
+    explicit ScopedJoinHandle(Slot* s) : slot(s) {}
+public:
+    bool is_finished() const;
+    R join();
+};
+
+class Scope {
+    struct SlotBase {
+        std::thread thread;
+        std::atomic<bool> joined{false}; // claimed by join() or join_all()
+        virtual ~SlotBase() = default;
+        virtual bool failed() const = 0;
+    };
+    template<typename R>
+    struct SlotFor : SlotBase {
+        rs_detail::JoinState<R> state;
+        bool failed() const override { return state.finished() && state.value.is_err(); }
+    };
+    template<typename T>
+    friend class ScopedJoinHandle;
+
+    std::mutex mu; // spawn may be called from scoped threads
+    std::vector<std::unique_ptr<SlotBase>> slots;
+
+    // Joins every thread; true if one that nobody joined failed. A slot whose
+    // std::thread constructor threw holds no thread and is skipped.
+    bool join_all() {
+        bool unjoined_failure = false;
+        for (size_t i = 0;; ++i) {
+            SlotBase* s;
+            {
+                std::lock_guard<std::mutex> lock(mu);
+                if (i == slots.size()) break;
+                s = slots[i].get();
+            }
+            if (s->joined.exchange(true) || !s->thread.joinable()) continue;
+            s->thread.join();
+            unjoined_failure |= s->failed();
+        }
+        return unjoined_failure;
+    }
+
+    Scope() = default;
+    template<typename F>
+    friend auto thread_scope(F&& f);
+
+public:
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    ~Scope() { join_all(); }
+
+    template<typename F>
+    ScopedJoinHandle<std::invoke_result_t<std::decay_t<F>&>> spawn(F&& f) {
+        using T = std::invoke_result_t<std::decay_t<F>&>;
+        using Slot = typename ScopedJoinHandle<T>::Slot;
+        auto owned = std::make_unique<Slot>();
+        Slot* slot = owned.get();
+        // The thread is started under `mu`, so join_all (which finds slots
+        // under `mu`) never sees one whose thread is still being assigned.
+        std::lock_guard<std::mutex> lock(mu);
+        slots.push_back(std::move(owned));
+        slot->thread = std::thread([slot, g = std::forward<F>(f)]() mutable {
+            slot->state.run(g);
+        });
+        return ScopedJoinHandle<T>(slot);
+    }
+};
+
+template<typename T>
+struct ScopedJoinHandle<T>::Slot : Scope::SlotFor<R> {};
+
+template<typename T>
+bool ScopedJoinHandle<T>::is_finished() const {
+    return slot->state.finished();
+}
+template<typename T>
+typename ScopedJoinHandle<T>::R ScopedJoinHandle<T>::join() {
+    if (slot->joined.exchange(true)) rs_panic("ScopedJoinHandle::join called twice");
+    slot->thread.join();
+    return std::move(slot->state.value);
+}
+
+template<typename F>
+auto thread_scope(F&& f) {
+    Scope scope;
+    if constexpr (std::is_void_v<std::invoke_result_t<F&, Scope&>>) {
+        f(scope);
+        if (scope.join_all()) rs_panic("a scoped thread failed");
+    } else {
+        auto out = f(scope);
+        if (scope.join_all()) rs_panic("a scoped thread failed");
+        return out;
+    }
+}
+
+// --- Mutex, Condvar, Semaphore, Latch, Barrier ---
+// Blocking primitives that each fit in one or a few 32-bit words. Waiting
+// threads sleep in the kernel on the word itself (futex on Linux; elsewhere
+// std::atomic::wait, with timed waits polling at up to 1ms).
+// - `Mutex<T>`: owns its data; `lock()` -> MutexGuard<T> (`*g`, `g->`),
+//   `try_lock()` -> Option<MutexGuard<T>>. Spins briefly, then sleeps. No
+//   poisoning: a panic that unwinds through a guard just unlocks it.
+// - `RwLock<T>`: `read()` -> RwLockReadGuard<T> (const access, shared),
+//   `write()` -> RwLockWriteGuard<T>, `try_read()` / `try_write()` -> Option.
+//   A waiting writer holds back new readers, so writers are not starved.
+// - `Condvar`: `wait(guard)`, `wait_while(guard, pred)`,
+//   `wait_timeout(guard, d)` / `wait_timeout_while(guard, d, pred)` ->
+//   WaitTimeoutResult (`timed_out()`), `notify_one()`, `notify_all()`. The
+//   guard is released while sleeping and held again on return. Notifying
+//   with no waiters makes no system call.
+// - `Semaphore(n)`: `acquire()`, `try_acquire()`, `try_acquire_for(d)` -> bool,
+//   `release(k = 1)`.
+// - `Latch(n)`: one-shot; `count_down(k = 1)`, `wait()`, `try_wait()`,
+//   `arrive_and_wait()`.
+// - `Barrier(n)`: reusable; `wait()` -> BarrierWaitResult, where exactly one
+//   thread per round gets `is_leader() == true`.
+//
+// Example:
+//   Mutex<Vec<Job>> queue;
+//   Condvar ready;
+//   { auto q = queue.lock(); q->push_back(job); }
+//   ready.notify_one();
+//   ...
+//   auto q = queue.lock();
+//   let r = ready.wait_timeout_while(q, std::chrono::milliseconds(50),
+//                                    [](auto& v) { return v.empty(); });
+//   if (r.timed_out()) return None();
+
+namespace rs_detail {
+
+// Sleeps while `word == expected`. May return spuriously.
+inline void futex_wait(std::atomic<uint32_t>& word, uint32_t expected) {
+#ifdef RS_LINUX_FUTEX
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+    word.wait(expected, std::memory_order_relaxed);
+#endif
+}
+
+// As futex_wait, but gives up at `deadline`. Returns false once it has passed.
+inline bool futex_wait_until(std::atomic<uint32_t>& word, uint32_t expected,
+                             std::chrono::steady_clock::time_point deadline) {
+    auto left = deadline - std::chrono::steady_clock::now();
+    if (left <= left.zero()) return false;
+#ifdef RS_LINUX_FUTEX
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+    timespec ts{static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000)};
+    long r = syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, &ts, nullptr, 0);
+    return !(r == -1 && errno == ETIMEDOUT);
+#else
+    // std::atomic::wait has no timeout; poll with a growing sleep instead.
+    auto nap = std::chrono::microseconds(1);
+    while (word.load(std::memory_order_relaxed) == expected) {
+        left = deadline - std::chrono::steady_clock::now();
+        if (left <= left.zero()) return false;
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(nap, left));
+        nap = std::min(nap * 2, std::chrono::microseconds(1000));
+    }
+    return true;
+#endif
+}
+
+// True if a sleeper was woken; always false where that is unknown.
+inline bool futex_wake_one(std::atomic<uint32_t>& word) {
+#ifdef RS_LINUX_FUTEX
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0) > 0;
+#else
+    word.notify_one();
+    return false;
+#endif
+}
+inline void futex_wake_all(std::atomic<uint32_t>& word) {
+#ifdef RS_LINUX_FUTEX
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#else
+    word.notify_all();
+#endif
+}
+
+inline void spin_pause() {
+#ifdef RS_X86_SIMD
+    _mm_pause();
+#endif
+}
+
+template<typename Rep, typename Period>
+std::chrono::steady_clock::time_point deadline_after(std::chrono::duration<Rep, Period> d) {
+    using Secs = std::chrono::duration<double>;
+    auto now = std::chrono::steady_clock::now();
+    // Saturate instead of overflowing for "wait forever" durations.
+    if (Secs(d) >= Secs(std::chrono::steady_clock::time_point::max() - now))
+        return std::chrono::steady_clock::time_point::max();
+    return now + std::chrono::ceil<std::chrono::steady_clock::duration>(d);
+}
+
+// The lock word behind Mutex<T>: 0 unlocked, 1 locked, 2 locked with
+// (possible) sleepers, so unlock only makes a syscall when someone waits.
+class RawMutex {
+    std::atomic<uint32_t> state{0};
+
+    __attribute__((noinline)) void lock_contended() {
+        uint32_t s = spin();
+        if (s == 0 && state.compare_exchange_strong(s, 1, std::memory_order_acquire)) return;
+        while (state.exchange(2, std::memory_order_acquire) != 0) {
+            futex_wait(state, 2);
+            spin();
+        }
+    }
+    // Waits a little for a holder that is about to unlock, without sleeping.
+    uint32_t spin() {
+        uint32_t s = state.load(std::memory_order_relaxed);
+        for (int i = 0; i < 100 && s == 1; ++i) {
+            spin_pause();
+            s = state.load(std::memory_order_relaxed);
+        }
+        return s;
+    }
+
+public:
+    bool try_lock() {
+        uint32_t s = 0;
+        return state.compare_exchange_strong(s, 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+    void lock() {
+        if (!try_lock()) [[unlikely]] lock_contended();
+    }
+    void unlock() {
+        if (state.exchange(0, std::memory_order_release) == 2) [[unlikely]] futex_wake_one(state);
+    }
+};
+
+} // namespace rs_detail
+
+template<typename T> class Mutex;
+class Condvar;
+
+template<typename T>
+class MutexGuard {
+    Mutex<T>* m;
+    explicit MutexGuard(Mutex<T>* mu) : m(mu) {}
+    friend class Mutex<T>;
+    friend class Condvar;
+public:
+    MutexGuard(const MutexGuard&) = delete;
+    MutexGuard& operator=(const MutexGuard&) = delete;
+    MutexGuard(MutexGuard&& o) noexcept : m(std::exchange(o.m, nullptr)) {}
+    ~MutexGuard() { if (m) m->raw.unlock(); }
+
+    T& operator*() const { return m->data; }
+    T* operator->() const { return &m->data; }
+};
+
+template<typename T>
+class Mutex {
+    rs_detail::RawMutex raw;
+    T data;
+    friend class MutexGuard<T>;
+    friend class Condvar;
+public:
+    constexpr Mutex() requires std::is_default_constructible_v<T> : data() {}
+    constexpr explicit Mutex(T v) : data(std::move(v)) {}
+    Mutex(const Mutex&) = delete;
+    Mutex& operator=(const Mutex&) = delete;
+
+    MutexGuard<T> lock() {
+        raw.lock();
+        return MutexGuard<T>(this);
+    }
+    Option<MutexGuard<T>> try_lock() {
+        if (!raw.try_lock()) return None();
+        return Option<MutexGuard<T>>(MutexGuard<T>(this));
+    }
+    // A unique reference to the mutex rules out other lockers.
+    T& get_mut() { return data; }
+};
+
+namespace rs_detail {
+
+// Reader-writer lock word, after Rust's futex RwLock. The low 30 bits count
+// readers (all ones: write-locked); bit 30 flags sleeping readers, bit 31
+// sleeping writers. Writers sleep on a separate `writer_notify` counter. New
+// readers queue behind a waiting writer, so writers are not starved.
+class RawRwLock {
+    static constexpr uint32_t read_locked = 1;
+    static constexpr uint32_t mask = (1u << 30) - 1;
+    static constexpr uint32_t write_locked = mask;
+    static constexpr uint32_t max_readers = mask - 1;
+    static constexpr uint32_t readers_waiting = 1u << 30;
+    static constexpr uint32_t writers_waiting = 1u << 31;
+
+    std::atomic<uint32_t> state{0};
+    std::atomic<uint32_t> writer_notify{0};
+
+    static bool is_unlocked(uint32_t s) { return (s & mask) == 0; }
+    static bool is_read_lockable(uint32_t s) {
+        return (s & mask) < max_readers && !(s & readers_waiting) && !(s & writers_waiting);
+    }
+
+    template<typename Done>
+    uint32_t spin(Done done) {
+        uint32_t s = state.load(std::memory_order_relaxed);
+        for (int i = 0; i < 100 && !done(s); ++i) {
+            spin_pause();
+            s = state.load(std::memory_order_relaxed);
+        }
+        return s;
+    }
+    // Stop spinning once the lock is free or someone already sleeps on it.
+    uint32_t spin_read() {
+        return spin([](uint32_t s) { return !((s & mask) == write_locked) || (s & (readers_waiting | writers_waiting)); });
+    }
+    uint32_t spin_write() {
+        return spin([](uint32_t s) { return is_unlocked(s) || (s & writers_waiting); });
+    }
+
+    __attribute__((noinline)) void read_contended() {
+        uint32_t s = spin_read();
+        for (;;) {
+            if (is_read_lockable(s)) {
+                if (state.compare_exchange_weak(s, s + read_locked, std::memory_order_acquire, std::memory_order_relaxed)) return;
+                continue;
+            }
+            if ((s & mask) == max_readers) rs_panic("RwLock: too many readers");
+            if (!(s & readers_waiting)) {
+                if (!state.compare_exchange_weak(s, s | readers_waiting, std::memory_order_relaxed)) continue;
+            }
+            futex_wait(state, s | readers_waiting);
+            s = spin_read();
+        }
+    }
+
+    __attribute__((noinline)) void write_contended() {
+        uint32_t s = spin_write();
+        uint32_t other_writers = 0;
+        for (;;) {
+            if (is_unlocked(s)) {
+                if (state.compare_exchange_weak(s, s | write_locked | other_writers, std::memory_order_acquire, std::memory_order_relaxed)) return;
+                continue;
+            }
+            if (!(s & writers_waiting)) {
+                if (!state.compare_exchange_weak(s, s | writers_waiting, std::memory_order_relaxed)) continue;
+            }
+            // We may not be the only sleeping writer, so keep the flag set
+            // when we take the lock.
+            other_writers = writers_waiting;
+            const uint32_t seq = writer_notify.load(std::memory_order_acquire);
+            s = state.load(std::memory_order_relaxed);
+            if (is_unlocked(s) || !(s & writers_waiting)) continue;
+            futex_wait(writer_notify, seq);
+            s = spin_write();
+        }
+    }
+
+    bool wake_writer() {
+        writer_notify.fetch_add(1, std::memory_order_release);
+        return futex_wake_one(writer_notify);
+    }
+    // Called with the lock free but a waiting flag set: wake one writer, or
+    // all readers if no writer was waiting.
+    void wake_writer_or_readers(uint32_t s) {
+        if (s == writers_waiting) {
+            if (state.compare_exchange_strong(s, 0, std::memory_order_relaxed)) {
+                wake_writer();
+                return;
+            }
+        }
+        if (s == (readers_waiting | writers_waiting)) {
+            if (state.compare_exchange_strong(s, readers_waiting, std::memory_order_relaxed)) {
+                if (wake_writer()) return;
+                s = readers_waiting;
+            }
+        }
+        if (s == readers_waiting && state.compare_exchange_strong(s, 0, std::memory_order_relaxed))
+            futex_wake_all(state);
+    }
+
+public:
+    bool try_read() {
+        uint32_t s = state.load(std::memory_order_relaxed);
+        while (is_read_lockable(s)) {
+            if (state.compare_exchange_weak(s, s + read_locked, std::memory_order_acquire, std::memory_order_relaxed)) return true;
+        }
+        return false;
+    }
+    void read() {
+        uint32_t s = state.load(std::memory_order_relaxed);
+        if (!is_read_lockable(s) ||
+            !state.compare_exchange_weak(s, s + read_locked, std::memory_order_acquire, std::memory_order_relaxed)) [[unlikely]]
+            read_contended();
+    }
+    void read_unlock() {
+        const uint32_t s = state.fetch_sub(read_locked, std::memory_order_release) - read_locked;
+        // Sleeping readers only wait behind a writer, so a writer must be
+        // waiting too; the last reader out wakes it.
+        if (is_unlocked(s) && (s & writers_waiting)) [[unlikely]] wake_writer_or_readers(s);
+    }
+
+    bool try_write() {
+        uint32_t s = state.load(std::memory_order_relaxed);
+        while (is_unlocked(s)) {
+            if (state.compare_exchange_weak(s, s + write_locked, std::memory_order_acquire, std::memory_order_relaxed)) return true;
+        }
+        return false;
+    }
+    void write() {
+        uint32_t s = 0;
+        if (!state.compare_exchange_strong(s, write_locked, std::memory_order_acquire, std::memory_order_relaxed)) [[unlikely]]
+            write_contended();
+    }
+    void write_unlock() {
+        const uint32_t s = state.fetch_sub(write_locked, std::memory_order_release) - write_locked;
+        if (s & (readers_waiting | writers_waiting)) [[unlikely]] wake_writer_or_readers(s);
+    }
+};
+
+} // namespace rs_detail
+
+template<typename T> class RwLock;
+
+template<typename T>
+class RwLockReadGuard {
+    RwLock<T>* l;
+    explicit RwLockReadGuard(RwLock<T>* lock) : l(lock) {}
+    friend class RwLock<T>;
+public:
+    RwLockReadGuard(const RwLockReadGuard&) = delete;
+    RwLockReadGuard& operator=(const RwLockReadGuard&) = delete;
+    RwLockReadGuard(RwLockReadGuard&& o) noexcept : l(std::exchange(o.l, nullptr)) {}
+    ~RwLockReadGuard() { if (l) l->raw.read_unlock(); }
+
+    const T& operator*() const { return l->data; }
+    const T* operator->() const { return &l->data; }
+};
+
+template<typename T>
+class RwLockWriteGuard {
+    RwLock<T>* l;
+    explicit RwLockWriteGuard(RwLock<T>* lock) : l(lock) {}
+    friend class RwLock<T>;
+public:
+    RwLockWriteGuard(const RwLockWriteGuard&) = delete;
+    RwLockWriteGuard& operator=(const RwLockWriteGuard&) = delete;
+    RwLockWriteGuard(RwLockWriteGuard&& o) noexcept : l(std::exchange(o.l, nullptr)) {}
+    ~RwLockWriteGuard() { if (l) l->raw.write_unlock(); }
+
+    T& operator*() const { return l->data; }
+    T* operator->() const { return &l->data; }
+};
+
+template<typename T>
+class RwLock {
+    rs_detail::RawRwLock raw;
+    T data;
+    friend class RwLockReadGuard<T>;
+    friend class RwLockWriteGuard<T>;
+public:
+    constexpr RwLock() requires std::is_default_constructible_v<T> : data() {}
+    constexpr explicit RwLock(T v) : data(std::move(v)) {}
+    RwLock(const RwLock&) = delete;
+    RwLock& operator=(const RwLock&) = delete;
+
+    RwLockReadGuard<T> read() {
+        raw.read();
+        return RwLockReadGuard<T>(this);
+    }
+    RwLockWriteGuard<T> write() {
+        raw.write();
+        return RwLockWriteGuard<T>(this);
+    }
+    Option<RwLockReadGuard<T>> try_read() {
+        if (!raw.try_read()) return None();
+        return Option<RwLockReadGuard<T>>(RwLockReadGuard<T>(this));
+    }
+    Option<RwLockWriteGuard<T>> try_write() {
+        if (!raw.try_write()) return None();
+        return Option<RwLockWriteGuard<T>>(RwLockWriteGuard<T>(this));
+    }
+    // A unique reference to the lock rules out other users.
+    T& get_mut() { return data; }
+};
+
+class WaitTimeoutResult {
+    bool expired;
+public:
+    explicit WaitTimeoutResult(bool timed_out) : expired(timed_out) {}
+    bool timed_out() const { return expired; }
+};
+
+class Condvar {
+    // Bumped by every notify; a waiter sleeps only while it is unchanged, so
+    // a notify between its unlock and its sleep is not lost.
+    std::atomic<uint32_t> seq{0};
+    std::atomic<uint32_t> sleepers{0};
+
+    template<typename T>
+    bool sleep(MutexGuard<T>& g, const std::chrono::steady_clock::time_point* deadline) {
+        // seq_cst pairs with notify: either it sees us in `sleepers` or we
+        // read its bump of `seq` and do not sleep on the old value.
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        const uint32_t s = seq.load(std::memory_order_seq_cst);
+        g.m->raw.unlock();
+        bool woke = true;
+        if (deadline) woke = rs_detail::futex_wait_until(seq, s, *deadline);
+        else rs_detail::futex_wait(seq, s);
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+        g.m->raw.lock();
+        return woke;
+    }
+
+public:
+    constexpr Condvar() noexcept = default;
+    Condvar(const Condvar&) = delete;
+    Condvar& operator=(const Condvar&) = delete;
+
+    // May wake spuriously; prefer wait_while.
+    template<typename T>
+    void wait(MutexGuard<T>& g) { sleep(g, nullptr); }
+
+    // Waits until `pred(data)` is false.
+    template<typename T, typename P>
+    void wait_while(MutexGuard<T>& g, P pred) {
+        while (pred(*g)) sleep(g, nullptr);
+    }
+
+    template<typename T, typename Rep, typename Period>
+    WaitTimeoutResult wait_timeout(MutexGuard<T>& g, std::chrono::duration<Rep, Period> d) {
+        const auto deadline = rs_detail::deadline_after(d);
+        return WaitTimeoutResult(!sleep(g, &deadline));
+    }
+
+    // timed_out() is true only if `pred` still holds at the deadline.
+    template<typename T, typename Rep, typename Period, typename P>
+    WaitTimeoutResult wait_timeout_while(MutexGuard<T>& g, std::chrono::duration<Rep, Period> d, P pred) {
+        const auto deadline = rs_detail::deadline_after(d);
+        while (pred(*g)) {
+            if (!sleep(g, &deadline)) return WaitTimeoutResult(pred(*g));
+        }
+        return WaitTimeoutResult(false);
+    }
+
+    // No system call when nobody is waiting.
+    void notify_one() {
+        seq.fetch_add(1, std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_seq_cst) != 0) rs_detail::futex_wake_one(seq);
+    }
+    void notify_all() {
+        seq.fetch_add(1, std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_seq_cst) != 0) rs_detail::futex_wake_all(seq);
+    }
+};
+
+class Semaphore {
+    std::atomic<uint32_t> permits;
+    std::atomic<uint32_t> sleepers{0};
+
+    bool take_one() {
+        uint32_t p = permits.load(std::memory_order_relaxed);
+        while (p != 0) {
+            if (permits.compare_exchange_weak(p, p - 1, std::memory_order_acquire, std::memory_order_relaxed)) return true;
+        }
+        return false;
+    }
+    template<typename Wait>
+    bool acquire_slow(Wait wait) {
+        // seq_cst on both sides: either release() sees us in `sleepers` or we
+        // see its permit before sleeping.
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        bool ok = true;
+        while (!take_one()) {
+            if (!wait()) {
+                ok = take_one();
+                break;
+            }
+        }
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+        return ok;
+    }
+
+public:
+    constexpr explicit Semaphore(uint32_t initial) noexcept : permits(initial) {}
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
+
+    uint32_t available() const { return permits.load(std::memory_order_relaxed); }
+    bool try_acquire() { return take_one(); }
+    void acquire() {
+        if (take_one()) [[likely]] return;
+        acquire_slow([&] { rs_detail::futex_wait(permits, 0); return true; });
+    }
+    template<typename Rep, typename Period>
+    bool try_acquire_for(std::chrono::duration<Rep, Period> d) {
+        if (take_one()) return true;
+        const auto deadline = rs_detail::deadline_after(d);
+        return acquire_slow([&] { return rs_detail::futex_wait_until(permits, 0, deadline); });
+    }
+    void release(uint32_t k = 1) {
+        permits.fetch_add(k, std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_seq_cst) == 0) return;
+        if (k == 1) rs_detail::futex_wake_one(permits);
+        else rs_detail::futex_wake_all(permits);
+    }
+};
+
+class Latch {
+    std::atomic<uint32_t> left;
+    std::atomic<uint32_t> sleepers{0};
+public:
+    constexpr explicit Latch(uint32_t count) noexcept : left(count) {}
+    Latch(const Latch&) = delete;
+    Latch& operator=(const Latch&) = delete;
+
+    void count_down(uint32_t k = 1) {
+        const uint32_t before = left.fetch_sub(k, std::memory_order_seq_cst);
+        if (before < k) rs_panic("Latch::count_down below zero");
+        // seq_cst pairs with wait(): either it sees zero or we see it.
+        if (before == k && sleepers.load(std::memory_order_seq_cst) != 0) rs_detail::futex_wake_all(left);
+    }
+    bool try_wait() const { return left.load(std::memory_order_acquire) == 0; }
+    void wait() {
+        if (try_wait()) [[likely]] return;
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        for (uint32_t n; (n = left.load(std::memory_order_seq_cst)) != 0;) rs_detail::futex_wait(left, n);
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+    void arrive_and_wait(uint32_t k = 1) {
+        count_down(k);
+        wait();
+    }
+};
+
+class BarrierWaitResult {
+    bool leader;
+public:
+    explicit BarrierWaitResult(bool is_leader) : leader(is_leader) {}
+    // True for exactly one thread per round: the last to arrive.
+    bool is_leader() const { return leader; }
+};
+
+class Barrier {
+    const uint32_t parties;
+    std::atomic<uint32_t> arrived{0};
+    std::atomic<uint32_t> generation{0};
+    std::atomic<uint32_t> sleepers{0};
+public:
+    explicit Barrier(uint32_t n) : parties(std::max<uint32_t>(n, 1)) {}
+    Barrier(const Barrier&) = delete;
+    Barrier& operator=(const Barrier&) = delete;
+
+    BarrierWaitResult wait() {
+        const uint32_t gen = generation.load(std::memory_order_acquire);
+        if (arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == parties) {
+            // Threads of the next round only arrive after seeing the new
+            // generation, so the reset cannot race with them.
+            arrived.store(0, std::memory_order_relaxed);
+            // seq_cst pairs with the waiters below, as in Latch.
+            generation.fetch_add(1, std::memory_order_seq_cst);
+            if (sleepers.load(std::memory_order_seq_cst) != 0) rs_detail::futex_wake_all(generation);
+            return BarrierWaitResult(true);
+        }
+        if (generation.load(std::memory_order_acquire) != gen) return BarrierWaitResult(false);
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        while (generation.load(std::memory_order_seq_cst) == gen) rs_detail::futex_wait(generation, gen);
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+        return BarrierWaitResult(false);
+    }
+};
+
+// --- ArcSwap ---
+// `ArcSwap<T>` holds an Arc<T> (std::shared_ptr) that readers load far more
+// often than writers replace, e.g. hot-reloaded configuration.
+// - `load()` -> ArcSwap<T>::Guard (`*g`, `g->`): no lock and no write to any
+//   shared cache line. The reader announces the pointer in a slot owned by its
+//   thread and re-checks it; it retries only if a store landed in between.
+// - `store(arc)`, `swap(arc)` -> previous Arc, `rcu(f)` with
+//   `f(const T&) -> T or Arc<T>`: writers take a lock among themselves. Before
+//   dropping the old value, a writer hands each reader still announcing it its
+//   own reference ("paying the debt"), so a guard stays valid for as long as
+//   it lives, across any number of stores.
+// - `load_full()` -> Arc<T>: an owning copy, for keeping the value past the
+//   guard; it takes the writer lock.
+// A guard must be dropped on the thread that loaded it. Each thread can hold 8
+// guards at once cheaply; more fall back to load_full.
+//
+// Example:
+//   static ArcSwap<Config> CONFIG(std::make_shared<Config>());
+//   // request path
+//   let cfg = CONFIG.load();
+//   if (cfg->verbose) log(req);
+//   // reload thread
+//   CONFIG.store(std::make_shared<Config>(Config::load("app.toml").unwrap()));
+
+template<typename T>
+using Arc = std::shared_ptr<T>;
+
+namespace rs_detail {
+
+// A thread's announced pointers. Blocks are never freed: a thread returns its
+// block on exit and the next new thread reuses it.
+struct DebtSlots {
+    static constexpr int count = 8;
+    alignas(64) std::atomic<uintptr_t> slot[count] = {};
+    std::atomic<bool> taken{true};
+    DebtSlots* next = nullptr;
+};
+
+inline std::atomic<DebtSlots*> debt_head{nullptr};
+
+inline DebtSlots* claim_debt_slots() {
+    for (DebtSlots* d = debt_head.load(std::memory_order_acquire); d; d = d->next) {
+        bool free = false;
+        if (!d->taken.load(std::memory_order_relaxed) &&
+            d->taken.compare_exchange_strong(free, true, std::memory_order_acquire)) return d;
+    }
+    auto* d = new DebtSlots;
+    d->next = debt_head.load(std::memory_order_relaxed);
+    while (!debt_head.compare_exchange_weak(d->next, d, std::memory_order_release, std::memory_order_relaxed)) {}
+    return d;
+}
+
+inline DebtSlots& my_debt_slots() {
+    struct Owner {
+        DebtSlots* d = claim_debt_slots();
+        ~Owner() { d->taken.store(false, std::memory_order_release); }
+    };
+    thread_local Owner owner;
+    return *owner.d;
+}
+
+// Clears a slot that announced `p`. If a writer paid the debt meanwhile, the
+// slot holds the reference it handed over; drop it.
+inline void settle_debt(std::atomic<uintptr_t>& slot, const void* p) {
+    uintptr_t seen = reinterpret_cast<uintptr_t>(p);
+    if (slot.compare_exchange_strong(seen, 0, std::memory_order_acq_rel)) return;
+    delete reinterpret_cast<std::shared_ptr<const void>*>(seen);
+    slot.store(0, std::memory_order_relaxed);
+}
+
+// Gives every reader still announcing `owner.get()` a reference of its own.
+inline void pay_debts(const std::shared_ptr<const void>& owner) {
+    const uintptr_t p = reinterpret_cast<uintptr_t>(owner.get());
+    if (p == 0) return;
+    for (DebtSlots* d = debt_head.load(std::memory_order_acquire); d; d = d->next) {
+        for (auto& slot : d->slot) {
+            if (slot.load(std::memory_order_seq_cst) != p) continue;
+            auto* paid = new std::shared_ptr<const void>(owner);
+            uintptr_t seen = p;
+            if (!slot.compare_exchange_strong(seen, reinterpret_cast<uintptr_t>(paid), std::memory_order_acq_rel))
+                delete paid; // the reader let go first
+        }
+    }
+}
+
+} // namespace rs_detail
+
+template<typename T>
+class ArcSwap {
+    std::atomic<T*> cur;
+    mutable rs_detail::RawMutex writer;
+    Arc<T> owned; // guarded by `writer`
+
+    struct WriteLock {
+        rs_detail::RawMutex& m;
+        explicit WriteLock(rs_detail::RawMutex& mu) : m(mu) { m.lock(); }
+        ~WriteLock() { m.unlock(); }
+    };
+    // Caller holds `writer`. The old value is returned so that it is dropped
+    // after unlocking.
+    Arc<T> install(Arc<T> next) {
+        Arc<T> old = std::exchange(owned, std::move(next));
+        cur.store(owned.get(), std::memory_order_seq_cst);
+        rs_detail::pay_debts(old);
+        return old;
+    }
+
+public:
+    class Guard {
+        T* ptr;
+        std::atomic<uintptr_t>* slot; // null when `held` owns the value
+        Arc<T> held;
+        friend class ArcSwap;
+        Guard(T* p, std::atomic<uintptr_t>* s) : ptr(p), slot(s) {}
+        explicit Guard(Arc<T> a) : ptr(a.get()), slot(nullptr), held(std::move(a)) {}
+    public:
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        Guard(Guard&& o) noexcept : ptr(o.ptr), slot(std::exchange(o.slot, nullptr)), held(std::move(o.held)) {}
+        ~Guard() { if (slot) rs_detail::settle_debt(*slot, ptr); }
+
+        const T& operator*() const { return *ptr; }
+        const T* operator->() const { return ptr; }
+        const T* get() const { return ptr; }
+        explicit operator bool() const { return ptr != nullptr; }
+    };
+
+    explicit ArcSwap(Arc<T> v) : cur(v.get()), owned(std::move(v)) {}
+    template<typename... Args>
+    static ArcSwap from_pointee(Args&&... args) { return ArcSwap(std::make_shared<T>(std::forward<Args>(args)...)); }
+    ArcSwap(const ArcSwap&) = delete;
+    ArcSwap& operator=(const ArcSwap&) = delete;
+    // Outstanding guards get their own reference, so they may outlive this.
+    ~ArcSwap() { rs_detail::pay_debts(owned); }
+
+    Guard load() const {
+        auto& mine = rs_detail::my_debt_slots();
+        T* p = cur.load(std::memory_order_acquire);
+        for (auto& slot : mine.slot) {
+            if (slot.load(std::memory_order_relaxed) != 0) continue;
+            for (;;) {
+                if (!p) return Guard(nullptr, nullptr);
+                // seq_cst on both sides: either the writer's scan sees this
+                // slot, or the re-check below sees the writer's new value.
+                slot.store(reinterpret_cast<uintptr_t>(p), std::memory_order_seq_cst);
+                T* now = cur.load(std::memory_order_seq_cst);
+                if (now == p) [[likely]] return Guard(p, &slot);
+                rs_detail::settle_debt(slot, p);
+                p = now;
+            }
+        }
+        return Guard(load_full());
+    }
+
+    Arc<T> load_full() const {
+        WriteLock lock(writer);
+        return owned;
+    }
+
+    void store(Arc<T> v) { swap(std::move(v)); }
+    Arc<T> swap(Arc<T> v) {
+        WriteLock lock(writer);
+        return install(std::move(v));
+    }
+
+    // Replaces the value with `f(current)`. Writers are serialized, so `f`
+    // runs once and sees the latest value.
+    template<typename F>
+    void rcu(F&& f) {
+        Arc<T> old;
+        WriteLock lock(writer);
+        if constexpr (std::is_convertible_v<std::invoke_result_t<F&, const T&>, Arc<T>>)
+            old = install(f(std::as_const(*owned)));
+        else
+            old = install(std::make_shared<T>(f(std::as_const(*owned))));
+    }
+};
+
+// --- Epoch-based reclamation ---
+// Deferred deletion for lock-free structures, after crossbeam-epoch. A thread
+// that reads shared nodes first calls `epoch::pin()`; a node unlinked while
+// any thread may still be reading it is retired instead of deleted, and freed
+// once every thread pinned at the time has unpinned.
+// - `epoch::pin()` -> epoch::Guard. Pins nest and are cheap: one store and one
+//   fence on a cache line owned by the thread.
+// - `guard.defer_destroy(Box<T>)`: delete the node later. `guard.defer(f)`:
+//   run `f()` later, on whichever thread collects it.
+// - `guard.flush()`: hand this thread's pending garbage to the global queue
+//   and try to free what has expired.
+// Garbage goes into a per-thread bag; a full bag (64 items) is sealed with the
+// current epoch and queued globally. The global epoch advances once every
+// pinned thread has seen it, and a bag sealed at epoch e is freed when the
+// global epoch reaches e + 2. Threads flush their bag on exit.
+//
+// Example:
+//   auto g = epoch::pin();
+//   Node* old = head.load(std::memory_order_acquire);
+//   while (old && !head.compare_exchange_weak(old, old->next)) {}
+//   if (old) g.defer_destroy(Box<Node>(old)); // readers of `old` finish first
+
+template<typename T>
+using Box = std::unique_ptr<T>;
+
+namespace epoch {
+
+class Guard;
+
+namespace detail {
+
+struct Deferred {
+    void* p;
+    void (*drop)(void*);
+};
+
+struct SealedBag {
+    uint64_t epoch;
+    std::vector<Deferred> items;
+};
+
+// A thread's published epoch: (epoch << 1) | 1 while pinned, 0 otherwise.
+// Records are reused by later threads and never freed.
+struct alignas(64) Participant {
+    std::atomic<uint64_t> state{0};
+    std::atomic<bool> taken{true};
+    Participant* next = nullptr;
+};
+
+struct Global {
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<Participant*> participants{nullptr};
+    rs_detail::RawMutex mu;
+    std::deque<SealedBag> garbage; // guarded by mu
+};
+
+inline Global& global() {
+    static Global g;
+    return g;
+}
+
+inline void run_all(std::vector<Deferred>& items) {
+    for (auto& d : items) d.drop(d.p);
+    items.clear();
+}
+
+// Advances the global epoch if every pinned thread has observed it.
+// Acquire loads of each state (rather than relaxed loads and one acquire
+// fence) cost the same on x86 and keep the unpin -> free ordering visible to
+// ThreadSanitizer, which does not model fences.
+inline uint64_t try_advance() {
+    Global& g = global();
+    const uint64_t e = g.epoch.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (Participant* p = g.participants.load(std::memory_order_acquire); p; p = p->next) {
+        const uint64_t s = p->state.load(std::memory_order_acquire);
+        if ((s & 1) && (s >> 1) != e) return e;
+    }
+    uint64_t cur = e;
+    g.epoch.compare_exchange_strong(cur, e + 1, std::memory_order_acq_rel, std::memory_order_acquire);
+    return cur == e ? e + 1 : cur;
+}
+
+// Frees every queued bag that no pinned thread can still reach.
+inline void collect() {
+    Global& g = global();
+    const uint64_t now = try_advance();
+    std::vector<SealedBag> expired;
+    g.mu.lock();
+    while (!g.garbage.empty() && g.garbage.front().epoch + 2 <= now) {
+        expired.push_back(std::move(g.garbage.front()));
+        g.garbage.pop_front();
+    }
+    g.mu.unlock();
+    for (auto& bag : expired) run_all(bag.items);
+}
+
+struct Local {
+    static constexpr size_t bag_capacity = 64;
+    static constexpr uint32_t pins_between_collects = 128;
+
+    Participant* rec;
+    uint32_t guards = 0;
+    uint32_t pins = 0;
+    std::vector<Deferred> bag;
+
+    Local() : rec(claim()) { bag.reserve(bag_capacity); }
+    ~Local() {
+        seal();
+        collect();
+        rec->taken.store(false, std::memory_order_release);
+    }
+
+    static Participant* claim() {
+        Global& g = global();
+        for (Participant* p = g.participants.load(std::memory_order_acquire); p; p = p->next) {
+            bool free = false;
+            if (!p->taken.load(std::memory_order_relaxed) &&
+                p->taken.compare_exchange_strong(free, true, std::memory_order_acquire)) return p;
+        }
+        auto* p = new Participant;
+        p->next = g.participants.load(std::memory_order_relaxed);
+        while (!g.participants.compare_exchange_weak(p->next, p, std::memory_order_release, std::memory_order_relaxed)) {}
+        return p;
+    }
+
+    void pin() {
+        if (guards++ != 0) return;
+        const uint64_t e = global().epoch.load(std::memory_order_relaxed);
+        // Release so that a collector seeing this newer pin also sees the
+        // reads this thread made under its previous one.
+        rec->state.store((e << 1) | 1, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (++pins % pins_between_collects == 0) collect();
+    }
+    void unpin() {
+        if (--guards == 0) rec->state.store(0, std::memory_order_release);
+    }
+
+    // Queues the bag globally, stamped with an epoch no older than any of
+    // its items' unlinking.
+    void seal() {
+        if (bag.empty()) return;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        SealedBag sealed{global().epoch.load(std::memory_order_relaxed), std::move(bag)};
+        bag = std::vector<Deferred>();
+        bag.reserve(bag_capacity);
+        Global& g = global();
+        g.mu.lock();
+        g.garbage.push_back(std::move(sealed));
+        g.mu.unlock();
+    }
+    void push(Deferred d) {
+        bag.push_back(d);
+        if (bag.size() >= bag_capacity) {
+            seal();
+            collect();
+        }
+    }
+};
+
+inline Local& local() {
+    thread_local Local l;
+    return l;
+}
+
+} // namespace detail
+
+class Guard {
+    detail::Local* l;
+    explicit Guard(detail::Local* loc) : l(loc) { l->pin(); }
+    friend Guard pin();
+public:
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+    ~Guard() { l->unpin(); }
+
+    template<typename T>
+    void defer_destroy(Box<T> b) const {
+        if (!b) return;
+        l->push({b.release(), [](void* p) { delete static_cast<T*>(p); }});
+    }
+    template<typename F>
+    void defer(F&& f) const {
+        using Fn = std::decay_t<F>;
+        l->push({new Fn(std::forward<F>(f)), [](void* p) {
+            Box<Fn> fun(static_cast<Fn*>(p));
+            (*fun)();
+        }});
+    }
+    void flush() const {
+        l->seal();
+        detail::collect();
+    }
+};
+
+inline Guard pin() { return Guard(&detail::local()); }
+
+inline bool is_pinned() { return detail::local().guards != 0; }
+
+} // namespace epoch
+
+// --- AtomicOption ---
+// `AtomicOption<Box<T>>`: an owning slot for one heap object, handed between
+// threads without a lock. It is a single std::atomic<T*> (the size of one
+// pointer); empty is nullptr, as with Option<Box<T>>.
+// - `take()` -> Option<Box<T>>: empties the slot.
+// - `swap(Option<Box<T>>)` -> Option<Box<T>>: installs the new value, returns
+//   the old one. `store(v)` drops the old one.
+// - `compare_exchange(current, v)` -> Result<Option<Box<T>>, Option<Box<T>>>:
+//   installs `v` only if the slot still holds `current` (compared by address,
+//   nullptr for empty). Ok carries the value it replaced; Err gives `v` back.
+// - `is_some()` / `is_none()`: a snapshot that may be stale by the time it is
+//   used. There is no load(): another thread could take and free the object.
+//
+// Example:
+//   AtomicOption<Box<Snapshot>> latest;
+//   latest.store(Box<Snapshot>(new Snapshot(build()))); // producer
+//   if (auto s = latest.take()) render(**s);             // consumer
+template<typename P>
+class AtomicOption;
+
+template<typename T>
+class AtomicOption<Box<T>> {
+    std::atomic<T*> ptr;
+
+    static Option<Box<T>> wrap(T* p) {
+        if (!p) return None();
+        return Option<Box<T>>(Box<T>(p));
+    }
+    static T* unwrap_raw(Option<Box<T>>& v) { return v.is_some() ? (*v).release() : nullptr; }
+
+public:
+    constexpr AtomicOption() noexcept : ptr(nullptr) {}
+    explicit AtomicOption(Box<T> v) noexcept : ptr(v.release()) {}
+    explicit AtomicOption(Option<Box<T>> v) noexcept : ptr(unwrap_raw(v)) {}
+    AtomicOption(const AtomicOption&) = delete;
+    AtomicOption& operator=(const AtomicOption&) = delete;
+    ~AtomicOption() { delete ptr.load(std::memory_order_acquire); }
+
+    bool is_some() const { return ptr.load(std::memory_order_acquire) != nullptr; }
+    bool is_none() const { return !is_some(); }
+
+    Option<Box<T>> take() {
+        // Cheap check first: an empty slot needs no read-modify-write.
+        if (ptr.load(std::memory_order_relaxed) == nullptr) return None();
+        return wrap(ptr.exchange(nullptr, std::memory_order_acq_rel));
+    }
+    Option<Box<T>> swap(Option<Box<T>> v) {
+        return wrap(ptr.exchange(unwrap_raw(v), std::memory_order_acq_rel));
+    }
+    Option<Box<T>> swap(Box<T> v) { return wrap(ptr.exchange(v.release(), std::memory_order_acq_rel)); }
+    void store(Box<T> v) { swap(std::move(v)); }
+
+    Result<Option<Box<T>>, Option<Box<T>>> compare_exchange(const T* current, Option<Box<T>> v) {
+        T* expected = const_cast<T*>(current);
+        T* desired = v.is_some() ? (*v).get() : nullptr;
+        if (ptr.compare_exchange_strong(expected, desired, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            unwrap_raw(v); // now owned by the slot
+            return Ok(wrap(expected));
+        }
+        return Err(std::move(v));
+    }
+    Result<Option<Box<T>>, Option<Box<T>>> compare_exchange(const T* current, Box<T> v) {
+        return compare_exchange(current, Option<Box<T>>(std::move(v)));
+    }
+
+    // A unique reference to the slot rules out other threads.
+    T* get_mut() { return ptr.load(std::memory_order_relaxed); }
+    Option<Box<T>> into_inner() && { return wrap(ptr.exchange(nullptr, std::memory_order_acquire)); }
+};
+
+// --- ShardedHashMap ---
+// `ShardedHashMap<K, V>`: a concurrent hash map split into independently
+// locked shards, after Rust's dashmap. A key's shard comes from the high bits
+// of its (mixed) hash, so operations on different shards never contend, and
+// each shard sits behind an RwLock so readers of one shard share it.
+// - `get(k)` -> Option<V> (a copy); `get_ref(k)` -> Option<Ref> (`*r`, `r->`),
+//   which holds the shard's read lock until dropped; `get_mut(k)` ->
+//   Option<RefMut> holds the write lock. `contains_key(k)`.
+// - `insert(k, v)` -> Option<V> (the previous value), `remove(k)` -> Option<V>.
+// - `entry(k)` locks the key's shard for writing and returns an Entry:
+//   `or_insert(v)`, `or_insert_with(f)`, `or_default()` -> RefMut;
+//   `and_modify(f)` -> Entry; `is_occupied()`.
+// - `len()`, `is_empty()`, `clear()`, `for_each(f)`, `retain(pred)` visit the
+//   shards one at a time, so they are not a snapshot of the whole map.
+// The shard count (default: 4 per hardware thread, rounded up to a power of
+// two) is fixed at construction. Holding a Ref, RefMut or Entry while calling
+// into the same map can deadlock if the key lands in the same shard.
+//
+// Example:
+//   ShardedHashMap<String, u64> hits;
+//   *hits.entry(path).or_insert(0) += 1;
+//   if (auto n = hits.get("/health")) report(*n);
+
+template<typename K, typename V, typename Hash = std::hash<K>, typename Eq = std::equal_to<K>>
+class ShardedHashMap {
+    using Map = std::unordered_map<K, V, Hash, Eq>;
+    struct alignas(64) Shard {
+        RwLock<Map> map;
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    size_t shard_bits;
+    Hash hasher;
+
+    static size_t default_shards() {
+        const size_t n = std::max<size_t>(std::thread::hardware_concurrency(), 1) * 4;
+        return std::bit_ceil(std::min<size_t>(n, 1024));
+    }
+    RwLock<Map>& shard_for(const K& k) const {
+        // Fibonacci hashing: std::hash is often the identity for integers,
+        // so mix before taking the high bits.
+        const uint64_t h = static_cast<uint64_t>(hasher(k)) * 0x9E3779B97F4A7C15ull;
+        const size_t i = shard_bits == 0 ? 0 : static_cast<size_t>(h >> (64 - shard_bits));
+        return shards[i].map;
+    }
+
+public:
+    class Ref {
+        RwLockReadGuard<Map> guard;
+        const V* v;
+        friend class ShardedHashMap;
+        Ref(RwLockReadGuard<Map> g, const V* val) : guard(std::move(g)), v(val) {}
+    public:
+        const V& operator*() const { return *v; }
+        const V* operator->() const { return v; }
+    };
+
+    class RefMut {
+        RwLockWriteGuard<Map> guard;
+        V* v;
+        friend class ShardedHashMap;
+        RefMut(RwLockWriteGuard<Map> g, V* val) : guard(std::move(g)), v(val) {}
+    public:
+        V& operator*() const { return *v; }
+        V* operator->() const { return v; }
+    };
+
+    class Entry {
+        RwLockWriteGuard<Map> guard;
+        K k;
+        typename Map::iterator it;
+        friend class ShardedHashMap;
+        Entry(RwLockWriteGuard<Map> g, K key) : guard(std::move(g)), k(std::move(key)), it(guard->find(k)) {}
+    public:
+        bool is_occupied() const { return it != guard->end(); }
+        const K& key() const { return k; }
+
+        template<typename F>
+        Entry and_modify(F&& f) && {
+            if (is_occupied()) f(it->second);
+            return std::move(*this);
+        }
+        template<typename F>
+        RefMut or_insert_with(F&& f) && {
+            if (!is_occupied()) it = guard->emplace(std::move(k), f()).first;
+            V* v = &it->second;
+            return RefMut(std::move(guard), v);
+        }
+        RefMut or_insert(V v) && {
+            return std::move(*this).or_insert_with([&] { return std::move(v); });
+        }
+        RefMut or_default() && {
+            return std::move(*this).or_insert_with([] { return V(); });
+        }
+    };
+
+    explicit ShardedHashMap(size_t shard_count = default_shards())
+        : shards(new Shard[std::bit_ceil(std::max<size_t>(shard_count, 1))]),
+          shard_bits(std::countr_zero(std::bit_ceil(std::max<size_t>(shard_count, 1)))) {}
+    ShardedHashMap(const ShardedHashMap&) = delete;
+    ShardedHashMap& operator=(const ShardedHashMap&) = delete;
+
+    size_t shard_count() const { return size_t(1) << shard_bits; }
+
+    Option<V> get(const K& k) const {
+        auto g = shard_for(k).read();
+        auto it = g->find(k);
+        if (it == g->end()) return None();
+        return Option<V>(it->second);
+    }
+    Option<Ref> get_ref(const K& k) const {
+        auto g = shard_for(k).read();
+        auto it = g->find(k);
+        if (it == g->end()) return None();
+        const V* v = &it->second;
+        return Option<Ref>(Ref(std::move(g), v));
+    }
+    Option<RefMut> get_mut(const K& k) {
+        auto g = shard_for(k).write();
+        auto it = g->find(k);
+        if (it == g->end()) return None();
+        V* v = &it->second;
+        return Option<RefMut>(RefMut(std::move(g), v));
+    }
+    bool contains_key(const K& k) const {
+        auto g = shard_for(k).read();
+        return g->find(k) != g->end();
+    }
+
+    Option<V> insert(K k, V v) {
+        auto g = shard_for(k).write();
+        auto [it, inserted] = g->try_emplace(std::move(k), std::move(v));
+        if (inserted) return None();
+        return Option<V>(std::exchange(it->second, std::move(v)));
+    }
+    Option<V> remove(const K& k) {
+        auto g = shard_for(k).write();
+        auto it = g->find(k);
+        if (it == g->end()) return None();
+        Option<V> out(std::move(it->second));
+        g->erase(it);
+        return out;
+    }
+    Entry entry(K k) {
+        auto& shard = shard_for(k);
+        return Entry(shard.write(), std::move(k));
+    }
+
+    size_t len() const {
+        size_t n = 0;
+        for (size_t i = 0; i < shard_count(); ++i) n += shards[i].map.read()->size();
+        return n;
+    }
+    bool is_empty() const { return len() == 0; }
+    void clear() {
+        for (size_t i = 0; i < shard_count(); ++i) shards[i].map.write()->clear();
+    }
+    // f(const K&, const V&) under each shard's read lock in turn.
+    template<typename F>
+    void for_each(F&& f) const {
+        for (size_t i = 0; i < shard_count(); ++i) {
+            auto g = shards[i].map.read();
+            for (const auto& [k, v] : *g) f(k, v);
+        }
+    }
+    // Keeps the entries for which pred(const K&, V&) is true.
+    template<typename P>
+    void retain(P&& pred) {
+        for (size_t i = 0; i < shard_count(); ++i) {
+            auto g = shards[i].map.write();
+            for (auto it = g->begin(); it != g->end();) {
+                if (pred(it->first, it->second)) ++it;
+                else it = g->erase(it);
+            }
+        }
+    }
+};
+
+#endif // ENABLE_RS_SYNC
+
+// ==========================================
+// 12. Performance instrumentation (metrics, timers, tracing, benchmarks)
+// ==========================================
+// Requires: ENABLE_RS_PERF (+ ENABLE_RS_ERROR)
+//
+// Metrics cheap enough for hot paths.
+// - `ShardedCounter`: `add(n)` / `inc()` touch a cache line that is usually
+//   private to the calling thread; `sum()` adds up the slots and `take()`
+//   also zeroes them. Threads are spread round-robin over one slot per
+//   hardware thread, so a shared std::atomic<u64>'s cache-line ping-pong goes
+//   away.
+// - `Histogram`: a lock-free log-linear (HDR-style) histogram of u64 values,
+//   e.g. latencies in ns. Values below 64 are exact; above, each power of two
+//   has 32 buckets, so any reported value is within 1/32 (~3%) of the truth.
+//   `record(v)` is two relaxed fetch_adds (bucket, sum); min/max are only
+//   written when they move.
+// - `snapshot()` -> HistogramSnapshot: plain counts with `count()`, `mean()`,
+//   `min()`, `max()`, `value_at_quantile(q)` -> Option<u64>, and `merge(other)`.
+//   For the hottest paths give each thread its own Histogram and merge their
+//   snapshots when reporting.
+//
+// Example:
+//   static ShardedCounter requests;
+//   static Histogram latency;
+//   requests.inc();
+//   latency.record(elapsed_ns);
+//   let snap = latency.snapshot();
+//   log("p99 = {}ns", snap.value_at_quantile(0.99).unwrap_or(0));
+#ifdef ENABLE_RS_PERF
+
+namespace rs_detail {
+
+// A small per-thread number, handed out round-robin on first use. The
+// thread_local is constant-initialized so reads skip the TLS init guard.
+inline std::atomic<uint32_t> next_thread_ordinal{1};
+inline thread_local uint32_t thread_ordinal_plus1 = 0;
+
+inline uint32_t thread_ordinal() {
+    uint32_t n = thread_ordinal_plus1;
+    if (n == 0) [[unlikely]]
+        thread_ordinal_plus1 = n = next_thread_ordinal.fetch_add(1, std::memory_order_relaxed);
+    return n - 1;
+}
+
+} // namespace rs_detail
+
+class ShardedCounter {
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> n{0};
+    };
+    std::unique_ptr<Slot[]> slots;
+    uint32_t mask;
+
+public:
+    explicit ShardedCounter(size_t shards = std::thread::hardware_concurrency())
+        : slots(new Slot[std::bit_ceil(std::clamp<size_t>(shards, 1, 256))]),
+          mask(static_cast<uint32_t>(std::bit_ceil(std::clamp<size_t>(shards, 1, 256)) - 1)) {}
+    ShardedCounter(const ShardedCounter&) = delete;
+    ShardedCounter& operator=(const ShardedCounter&) = delete;
+
+    void add(uint64_t n) { slots[rs_detail::thread_ordinal() & mask].n.fetch_add(n, std::memory_order_relaxed); }
+    void inc() { add(1); }
+
+    // Not a snapshot: adds racing with the read may or may not be included.
+    uint64_t sum() const {
+        uint64_t total = 0;
+        for (uint32_t i = 0; i <= mask; ++i) total += slots[i].n.load(std::memory_order_relaxed);
+        return total;
+    }
+    // Returns the sum and zeroes the counter; no concurrent add is lost.
+    uint64_t take() {
+        uint64_t total = 0;
+        for (uint32_t i = 0; i <= mask; ++i) total += slots[i].n.exchange(0, std::memory_order_relaxed);
+        return total;
+    }
+};
+
+namespace rs_detail {
+
+// Log-linear bucketing shared by Histogram and HistogramSnapshot: values
+// below 2^(P+1) map to themselves; above, each octave [2^(b-1), 2^b) splits
+// into 2^P equal buckets.
+struct HistogramLayout {
+    static constexpr unsigned precision = 5;
+    static constexpr uint64_t sub = uint64_t(1) << precision;
+    static constexpr size_t linear = size_t(2) << precision;
+    static constexpr size_t buckets = linear + (64 - precision - 1) * sub;
+
+    static size_t index(uint64_t v) {
+        if (v < linear) return static_cast<size_t>(v);
+        const unsigned b = static_cast<unsigned>(std::bit_width(v));
+        const unsigned shift = b - 1 - precision;
+        return linear + (b - precision - 2) * sub + static_cast<size_t>((v >> shift) - sub);
+    }
+    // Smallest and largest value that land in bucket i.
+    static uint64_t lowest(size_t i) {
+        if (i < linear) return i;
+        const size_t octave = (i - linear) / sub;
+        const unsigned shift = static_cast<unsigned>(octave + 1);
+        return (sub + (i - linear) % sub) << shift;
+    }
+    static uint64_t highest(size_t i) {
+        if (i < linear) return i;
+        const unsigned shift = static_cast<unsigned>((i - linear) / sub + 1);
+        return lowest(i) + ((uint64_t(1) << shift) - 1);
+    }
+};
+
+} // namespace rs_detail
+
+class HistogramSnapshot {
+    using Layout = rs_detail::HistogramLayout;
+    std::vector<uint64_t> counts = std::vector<uint64_t>(Layout::buckets);
+    uint64_t total = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = std::numeric_limits<uint64_t>::max();
+    uint64_t max_ = 0;
+    friend class Histogram;
+
+public:
+    HistogramSnapshot() = default;
+
+    uint64_t count() const { return total; }
+    uint64_t sum() const { return sum_; }
+    Option<uint64_t> min() const { return total ? Option<uint64_t>(min_) : Option<uint64_t>(None()); }
+    Option<uint64_t> max() const { return total ? Option<uint64_t>(max_) : Option<uint64_t>(None()); }
+    Option<double> mean() const {
+        if (!total) return None();
+        return Option<double>(static_cast<double>(sum_) / static_cast<double>(total));
+    }
+
+    // The value below which a fraction q (0..1) of recorded values fall,
+    // reported as the top of its bucket (capped at max()). None when empty.
+    Option<uint64_t> value_at_quantile(double q) const {
+        if (!total) return None();
+        q = std::clamp(q, 0.0, 1.0);
+        const double exact = q * static_cast<double>(total);
+        uint64_t rank = static_cast<uint64_t>(exact);
+        if (static_cast<double>(rank) < exact || rank == 0) ++rank;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank) return Option<uint64_t>(std::clamp(Layout::highest(i), min_, max_));
+        }
+        return Option<uint64_t>(max_);
+    }
+
+    // Adds another snapshot's values, e.g. from a per-thread histogram.
+    HistogramSnapshot& merge(const HistogramSnapshot& o) {
+        for (size_t i = 0; i < counts.size(); ++i) counts[i] += o.counts[i];
+        total += o.total;
+        sum_ += o.sum_;
+        min_ = std::min(min_, o.min_);
+        max_ = std::max(max_, o.max_);
+        return *this;
+    }
+
+    // Calls f(low, high, count) for every non-empty bucket, in value order.
+    template<typename F>
+    void for_each_bucket(F&& f) const {
+        for (size_t i = 0; i < counts.size(); ++i)
+            if (counts[i]) f(Layout::lowest(i), Layout::highest(i), counts[i]);
+    }
+};
+
+class Histogram {
+    using Layout = rs_detail::HistogramLayout;
+    std::unique_ptr<std::atomic<uint64_t>[]> counts;
+    alignas(64) std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> min_{std::numeric_limits<uint64_t>::max()};
+    std::atomic<uint64_t> max_{0};
+
+public:
+    Histogram() : counts(new std::atomic<uint64_t>[Layout::buckets]()) {}
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    void record(uint64_t v) { record_n(v, 1); }
+    void record_n(uint64_t v, uint64_t n) {
+        counts[Layout::index(v)].fetch_add(n, std::memory_order_relaxed);
+        sum_.fetch_add(v * n, std::memory_order_relaxed);
+        // Only write when the extreme moves, which soon becomes rare.
+        uint64_t m = max_.load(std::memory_order_relaxed);
+        while (v > m && !max_.compare_exchange_weak(m, v, std::memory_order_relaxed)) {}
+        m = min_.load(std::memory_order_relaxed);
+        while (v < m && !min_.compare_exchange_weak(m, v, std::memory_order_relaxed)) {}
+    }
+
+    // Values recorded during the copy may be missing from some fields (e.g.
+    // counted in a bucket but not yet in sum()); the buckets are authoritative,
+    // so min/max outside the first/last non-empty bucket fall back to its bound.
+    HistogramSnapshot snapshot() const {
+        HistogramSnapshot s;
+        for (size_t i = 0; i < Layout::buckets; ++i) s.counts[i] = counts[i].load(std::memory_order_relaxed);
+        s.total = 0;
+        for (uint64_t c : s.counts) s.total += c;
+        s.sum_ = sum_.load(std::memory_order_relaxed);
+        s.min_ = min_.load(std::memory_order_relaxed);
+        s.max_ = max_.load(std::memory_order_relaxed);
+        if (s.total) {
+            size_t lo = 0, hi = Layout::buckets - 1;
+            while (!s.counts[lo]) ++lo;
+            while (!s.counts[hi]) --hi;
+            if (s.min_ < Layout::lowest(lo) || s.min_ > Layout::highest(lo)) s.min_ = Layout::lowest(lo);
+            if (s.max_ < Layout::lowest(hi) || s.max_ > Layout::highest(hi)) s.max_ = Layout::highest(hi);
+            if (s.min_ > s.max_) { s.min_ = Layout::lowest(lo); s.max_ = Layout::highest(hi); }
+        } else {
+            s.min_ = std::numeric_limits<uint64_t>::max();
+            s.max_ = 0;
+        }
+        return s;
+    }
+    void reset() {
+        for (size_t i = 0; i < Layout::buckets; ++i) counts[i].store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        min_.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+};
+
+// --- Duration / Instant / ScopedTimer ---
+// - `Duration`: a span of u64 nanoseconds (up to ~584 years) with Rust's API:
+//   from_nanos/micros/millis/secs/secs_f64 (saturating), as_nanos/micros/
+//   millis/secs/secs_f64, checked_add/checked_sub/checked_mul ->
+//   Option<Duration>, saturating_sub, arithmetic and comparisons. Converts
+//   implicitly from any std::chrono::duration (negative values become zero);
+//   `to_std()` goes back. `+`, `-` and `*` panic on overflow, as in Rust.
+// - `Instant::now()` reads the x86 time-stamp counter when the CPU reports an
+//   invariant TSC (rdtsc, no vDSO call), otherwise std::chrono::steady_clock.
+//   The TSC is calibrated against steady_clock for ~1 ms on first use (rate
+//   error around 1e-4); call `Instant::calibrate()` at startup to move that
+//   cost out of the hot path.
+//   `Instant::clock_name()` says which source is in use. Build with
+//   RS_USE_TSC=0, or run with RUSTIC_CLOCK=monotonic, to force steady_clock.
+//   `Instant ± Duration` panics when the result leaves the clock's range;
+//   `checked_add`/`checked_sub` return Option<Instant> instead.
+// - `ScopedTimer t(hist)` records the nanoseconds between its construction
+//   and destruction into a Histogram. `stop()` records early and returns the
+//   Duration; `cancel()` records nothing.
+//
+// Example:
+//   static Histogram parse_ns;
+//   {
+//       ScopedTimer t(parse_ns);
+//       parse(buf);
+//   }
+//   let start = Instant::now();
+//   work();
+//   if (start.elapsed() > Duration::from_millis(5)) log("slow");
+#ifndef RS_USE_TSC
+#ifdef RS_X86_SIMD
+#define RS_USE_TSC 1
+#else
+#define RS_USE_TSC 0
+#endif
+#endif
+
+class Duration {
+    uint64_t ns = 0;
+    static constexpr uint64_t scaled(uint64_t n, uint64_t unit) {
+        return n > std::numeric_limits<uint64_t>::max() / unit ? std::numeric_limits<uint64_t>::max() : n * unit;
+    }
+
+public:
+    static const Duration ZERO;
+    static const Duration MAX;
+
+    constexpr Duration() = default;
+    template<typename Rep, typename Period>
+    constexpr Duration(std::chrono::duration<Rep, Period> d)
+        : ns(d <= d.zero() ? 0 : static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count())) {}
+
+    static constexpr Duration from_nanos(uint64_t n) {
+        Duration d;
+        d.ns = n;
+        return d;
+    }
+    static constexpr Duration from_micros(uint64_t n) { return from_nanos(scaled(n, 1000)); }
+    static constexpr Duration from_millis(uint64_t n) { return from_nanos(scaled(n, 1000000)); }
+    static constexpr Duration from_secs(uint64_t n) { return from_nanos(scaled(n, 1000000000)); }
+    static constexpr Duration from_secs_f64(double s) {
+        if (!(s > 0)) return from_nanos(0);
+        if (s >= 18446744073.709551615) return from_nanos(std::numeric_limits<uint64_t>::max());
+        return from_nanos(static_cast<uint64_t>(s * 1e9));
+    }
+
+    constexpr uint64_t as_nanos() const { return ns; }
+    constexpr uint64_t as_micros() const { return ns / 1000; }
+    constexpr uint64_t as_millis() const { return ns / 1000000; }
+    constexpr uint64_t as_secs() const { return ns / 1000000000; }
+    constexpr uint32_t subsec_nanos() const { return static_cast<uint32_t>(ns % 1000000000); }
+    constexpr double as_secs_f64() const { return static_cast<double>(ns) / 1e9; }
+    constexpr bool is_zero() const { return ns == 0; }
+    constexpr std::chrono::nanoseconds to_std() const {
+        return std::chrono::nanoseconds(static_cast<std::chrono::nanoseconds::rep>(
+            std::min<uint64_t>(ns, std::numeric_limits<std::chrono::nanoseconds::rep>::max())));
+    }
+
+    Option<Duration> checked_add(Duration o) const {
+        if (ns > std::numeric_limits<uint64_t>::max() - o.ns) return None();
+        return Option<Duration>(from_nanos(ns + o.ns));
+    }
+    Option<Duration> checked_sub(Duration o) const {
+        if (o.ns > ns) return None();
+        return Option<Duration>(from_nanos(ns - o.ns));
+    }
+    Option<Duration> checked_mul(uint64_t k) const {
+        uint64_t out;
+        if (__builtin_mul_overflow(ns, k, &out)) return None();
+        return Option<Duration>(from_nanos(out));
+    }
+    constexpr Duration saturating_sub(Duration o) const { return from_nanos(o.ns > ns ? 0 : ns - o.ns); }
+
+    Duration operator+(Duration o) const { return checked_add(o).expect("overflow when adding durations"); }
+    Duration operator-(Duration o) const { return checked_sub(o).expect("overflow when subtracting durations"); }
+    Duration operator*(uint64_t k) const { return checked_mul(k).expect("overflow when multiplying duration"); }
+    constexpr Duration operator/(uint64_t k) const { return from_nanos(ns / k); }
+    Duration& operator+=(Duration o) { return *this = *this + o; }
+    Duration& operator-=(Duration o) { return *this = *this - o; }
+    friend constexpr bool operator==(Duration a, Duration b) { return a.ns == b.ns; }
+    friend constexpr auto operator<=>(Duration a, Duration b) { return a.ns <=> b.ns; }
+
+    // Like Rust's Debug output: "250ns", "1.5us", "12.25ms", "3s".
+    std::string to_string() const {
+        static constexpr std::pair<uint64_t, const char*> units[] = {
+            {1000000000, "s"}, {1000000, "ms"}, {1000, "us"}, {1, "ns"}};
+        for (const auto& [scale, name] : units) {
+            if (ns < scale && scale != 1) continue;
+            char buf[32];
+            auto res = std::to_chars(buf, buf + sizeof(buf), static_cast<double>(ns) / static_cast<double>(scale),
+                                     std::chars_format::general, 6);
+            return std::string(buf, res.ptr) + name;
+        }
+        return "0ns";
+    }
+    friend std::ostream& operator<<(std::ostream& os, Duration d) { return os << d.to_string(); }
+};
+inline constexpr Duration Duration::ZERO = Duration::from_nanos(0);
+inline constexpr Duration Duration::MAX = Duration::from_nanos(std::numeric_limits<uint64_t>::max());
+
+namespace rs_detail {
+
+inline uint64_t monotonic_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Ticks read by Instant::now() and their length. Without a usable TSC the
+// ticks are steady_clock nanoseconds.
+struct ClockSource {
+    bool tsc = false;
+    double ns_per_tick = 1.0;
+    double ticks_per_ns = 1.0;
+};
+
+inline ClockSource calibrate_clock() {
+    ClockSource c;
+#if RS_USE_TSC
+    const char* env = std::getenv("RUSTIC_CLOCK");
+    if (!cpu::features().invariant_tsc || (env && std::string_view(env) == "monotonic")) return c;
+    // Pairs a TSC read with the midpoint of the two clock reads around it,
+    // keeping the tightest of a few tries so a preemption cannot skew it.
+    struct Sample {
+        uint64_t ns = 0, tsc = 0;
+    };
+    auto sample = [] {
+        Sample out;
+        uint64_t best = std::numeric_limits<uint64_t>::max();
+        for (int i = 0; i < 5; ++i) {
+            const uint64_t before = monotonic_ns();
+            const uint64_t t = __rdtsc();
+            const uint64_t after = monotonic_ns();
+            if (after - before < best) {
+                best = after - before;
+                out = {before + (after - before) / 2, t};
+            }
+        }
+        return out;
+    };
+    const Sample first = sample();
+    Sample last;
+    do last = sample();
+    while (last.ns - first.ns < 1000000);
+    if (last.tsc <= first.tsc) return c;
+    c.tsc = true;
+    c.ns_per_tick = static_cast<double>(last.ns - first.ns) / static_cast<double>(last.tsc - first.tsc);
+    c.ticks_per_ns = 1.0 / c.ns_per_tick;
+#endif
+    return c;
+}
+
+inline const ClockSource& clock_source() {
+    static const ClockSource c = calibrate_clock();
+    return c;
+}
+
+inline uint64_t clock_ticks() {
+#if RS_USE_TSC
+    if (clock_source().tsc) return __rdtsc();
+#endif
+    return monotonic_ns();
+}
+
+} // namespace rs_detail
+
+class Instant {
+    uint64_t ticks;
+    explicit Instant(uint64_t t) : ticks(t) {}
+
+    static Option<uint64_t> to_ticks(Duration d) {
+        const double t = static_cast<double>(d.as_nanos()) * rs_detail::clock_source().ticks_per_ns + 0.5;
+        if (t >= 18446744073709551616.0) return None(); // 2^64
+        return Option<uint64_t>(static_cast<uint64_t>(t));
+    }
+
+public:
+    static Instant now() { return Instant(rs_detail::clock_ticks()); }
+    // Runs the one-time TSC calibration (~1 ms) if it has not run yet.
+    static void calibrate() { (void)rs_detail::clock_source(); }
+    static const char* clock_name() { return rs_detail::clock_source().tsc ? "tsc" : "monotonic"; }
+
+    // Zero if `earlier` is actually later, as in Rust.
+    Duration duration_since(Instant earlier) const {
+        if (earlier.ticks >= ticks) return Duration::ZERO;
+        return Duration::from_nanos(
+            static_cast<uint64_t>(static_cast<double>(ticks - earlier.ticks) * rs_detail::clock_source().ns_per_tick + 0.5));
+    }
+    Option<Duration> checked_duration_since(Instant earlier) const {
+        if (earlier.ticks > ticks) return None();
+        return Option<Duration>(duration_since(earlier));
+    }
+    Duration elapsed() const { return now().duration_since(*this); }
+
+    // None if the result does not fit the clock's tick range.
+    Option<Instant> checked_add(Duration d) const {
+        const auto dt = to_ticks(d);
+        if (!dt || *dt > std::numeric_limits<uint64_t>::max() - ticks) return None();
+        return Option<Instant>(Instant(ticks + *dt));
+    }
+    Option<Instant> checked_sub(Duration d) const {
+        const auto dt = to_ticks(d);
+        if (!dt || *dt > ticks) return None();
+        return Option<Instant>(Instant(ticks - *dt));
+    }
+    Instant operator+(Duration d) const { return checked_add(d).expect("overflow when adding duration to instant"); }
+    Instant operator-(Duration d) const { return checked_sub(d).expect("overflow when subtracting duration from instant"); }
+    Duration operator-(Instant earlier) const { return duration_since(earlier); }
+    friend bool operator==(Instant a, Instant b) { return a.ticks == b.ticks; }
+    friend auto operator<=>(Instant a, Instant b) { return a.ticks <=> b.ticks; }
+};
+
+class ScopedTimer {
+    Histogram* hist;
+    Instant start;
+
+public:
+    explicit ScopedTimer(Histogram& h) : hist(&h), start(Instant::now()) {}
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+    ~ScopedTimer() {
+        if (hist) hist->record(start.elapsed().as_nanos());
+    }
+
+    Duration stop() {
+        const Duration d = start.elapsed();
+        if (hist) hist->record(d.as_nanos());
+        hist = nullptr;
+        return d;
+    }
+    void cancel() { hist = nullptr; }
+    Duration elapsed() const { return start.elapsed(); }
+};
+
+// --- Tracing spans (rs_span, Chrome trace export) ---
+// - `rs_span("name");` times the rest of the enclosing scope. On scope exit
+//   it appends one event (name, start, end) to the calling thread's ring
+//   buffer: two Instant reads and a few plain stores, no locks and no
+//   allocation after the thread's first span. The name must outlive the
+//   trace (a string literal).
+// - Each thread keeps its newest RS_TRACE_EVENTS events (default 16384,
+//   a power of two); older ones are overwritten. Buffers of exited threads
+//   are kept until `trace::clear()`.
+// - `trace::write_chrome_json(os)` writes every buffered event as Chrome
+//   trace-event JSON ("X" events, microsecond timestamps with ns precision),
+//   for chrome://tracing, Perfetto or speedscope. Safe to call while other
+//   threads are still recording; events overwritten during the copy are
+//   dropped. `trace::set_thread_name(name)` labels the calling thread.
+// - Build with RS_TRACE=0 to compile every rs_span to nothing.
+//
+// Example:
+//   Result<Order, Error> handle(const Request& r) {
+//       rs_span("handle");
+//       auto order = [&] { rs_span("parse"); return parse(r); }();
+//       if (order.is_err()) return order;
+//       rs_span("price");
+//       return price(order.unwrap());
+//   }
+//   std::ofstream out("trace.json");
+//   trace::write_chrome_json(out);
+#ifndef RS_TRACE
+#define RS_TRACE 1
+#endif
+#ifndef RS_TRACE_EVENTS
+#define RS_TRACE_EVENTS 16384
+#endif
+static_assert(std::has_single_bit(static_cast<size_t>(RS_TRACE_EVENTS)), "RS_TRACE_EVENTS must be a power of two");
+
+namespace rs_detail {
+
+// `s` as a quoted JSON string; control characters become \u00XX escapes.
+inline std::string json_quote(std::string_view s) {
+    static constexpr char hex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(s.size() + 2);
+    out += '"';
+    for (char c : s) {
+        const auto u = static_cast<unsigned char>(c);
+        if (u < 0x20) {
+            out += "\\u00";
+            out += hex[u >> 4];
+            out += hex[u & 0xF];
+            continue;
+        }
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    out += '"';
+    return out;
+}
+
+} // namespace rs_detail
+
+namespace trace {
+namespace detail {
+
+// Fields are atomics so the exporter may read a slot the owner is
+// overwriting; the head re-check discards such slots. The release stores
+// make a reader that sees a field of event i also see head >= i, and cost
+// nothing over plain moves on x86.
+struct Event {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<uint64_t> start{0};
+    std::atomic<uint64_t> end{0};
+};
+
+struct ThreadBuffer {
+    static constexpr uint64_t capacity = RS_TRACE_EVENTS;
+    std::unique_ptr<Event[]> events{new Event[capacity]};
+    std::atomic<uint64_t> head{0};  // written only by the owner
+    std::atomic<uint64_t> floor{0}; // events below this were cleared
+    std::atomic<bool> exited{false};
+    uint32_t tid = rs_detail::thread_ordinal();
+    std::string name; // guarded by Registry::mu
+
+    void push(const char* n, uint64_t start, uint64_t end) {
+        const uint64_t i = head.load(std::memory_order_relaxed);
+        Event& e = events[i & (capacity - 1)];
+        e.name.store(n, std::memory_order_release);
+        e.start.store(start, std::memory_order_release);
+        e.end.store(end, std::memory_order_release);
+        head.store(i + 1, std::memory_order_release);
+    }
+};
+
+struct Registry {
+    std::mutex mu;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    const uint64_t epoch = rs_detail::clock_ticks();
+};
+
+inline Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+inline thread_local ThreadBuffer* current = nullptr;
+
+// Marks the thread's buffer as exited when the thread ends.
+struct Owner {
+    std::shared_ptr<ThreadBuffer> buf;
+    ~Owner() {
+        if (buf) buf->exited.store(true, std::memory_order_relaxed);
+    }
+};
+
+__attribute__((noinline)) inline ThreadBuffer* attach() {
+    thread_local Owner owner;
+    owner.buf = std::make_shared<ThreadBuffer>();
+    Registry& r = registry();
+    {
+        std::lock_guard<std::mutex> lock(r.mu);
+        r.buffers.push_back(owner.buf);
+    }
+    return current = owner.buf.get();
+}
+
+inline void record(const char* n, uint64_t start, uint64_t end) {
+    ThreadBuffer* b = current;
+    if (!b) [[unlikely]] b = attach();
+    b->push(n, start, end);
+}
+
+} // namespace detail
+
+class Span {
+    const char* name;
+    uint64_t start;
+
+public:
+    explicit Span(const char* n) : name(n), start(rs_detail::clock_ticks()) {}
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+    ~Span() { detail::record(name, start, rs_detail::clock_ticks()); }
+};
+
+inline void set_thread_name(std::string name) {
+    detail::ThreadBuffer* b = detail::current ? detail::current : detail::attach();
+    std::lock_guard<std::mutex> lock(detail::registry().mu);
+    b->name = std::move(name);
+}
+
+// Drops every buffered event, and the buffers of threads that have exited.
+inline void clear() {
+    detail::Registry& r = detail::registry();
+    std::lock_guard<std::mutex> lock(r.mu);
+    std::erase_if(r.buffers, [](const auto& b) { return b->exited.load(std::memory_order_relaxed); });
+    for (auto& b : r.buffers) b->floor.store(b->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+inline void write_chrome_json(std::ostream& os) {
+    detail::Registry& r = detail::registry();
+    std::lock_guard<std::mutex> lock(r.mu);
+    const double ns_per_tick = rs_detail::clock_source().ns_per_tick;
+    // Spans that began before the registry existed get small negative times.
+    auto us = [&](uint64_t ticks) {
+        return static_cast<double>(static_cast<int64_t>(ticks - r.epoch)) * ns_per_tick / 1000.0;
+    };
+    auto number = [&](double v) {
+        char buf[32];
+        auto res = std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::fixed, 3);
+        os.write(buf, res.ptr - buf);
+    };
+#ifdef RS_POSIX
+    const long pid = static_cast<long>(::getpid());
+#else
+    const long pid = 1;
+#endif
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    struct Copy {
+        const char* name;
+        uint64_t start, end;
+    };
+    std::vector<Copy> copy;
+    for (auto& b : r.buffers) {
+        const uint64_t cap = detail::ThreadBuffer::capacity;
+        const uint64_t hi = b->head.load(std::memory_order_acquire);
+        const uint64_t lo = std::max(b->floor.load(std::memory_order_relaxed), hi > cap ? hi - cap : 0);
+        copy.clear();
+        for (uint64_t i = lo; i < hi; ++i) {
+            const detail::Event& e = b->events[i & (cap - 1)];
+            copy.push_back({e.name.load(std::memory_order_acquire), e.start.load(std::memory_order_acquire),
+                            e.end.load(std::memory_order_acquire)});
+        }
+        // Slots of events below now + 1 - cap may have been reused (the +1
+        // covers a push in progress) while we copied.
+        const uint64_t now = b->head.load(std::memory_order_relaxed) + 1;
+        const uint64_t valid = now > cap ? now - cap : 0;
+        if (!b->name.empty()) {
+            os << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << b->tid
+               << ",\"args\":{\"name\":";
+            os << rs_detail::json_quote(b->name);
+            os << "}}";
+            first = false;
+        }
+        for (uint64_t i = std::max(lo, valid); i < hi; ++i) {
+            const Copy& e = copy[i - lo];
+            os << (first ? "" : ",") << "\n{\"name\":";
+            os << rs_detail::json_quote(e.name);
+            os << ",\"ph\":\"X\",\"ts\":";
+            number(us(e.start));
+            os << ",\"dur\":";
+            number(static_cast<double>(e.end - e.start) * ns_per_tick / 1000.0);
+            os << ",\"pid\":" << pid << ",\"tid\":" << b->tid << "}";
+            first = false;
+        }
+    }
+    os << "\n]}\n";
+}
+
+} // namespace trace
+
+#define RS_SPAN_CAT_(a, b) a##b
+#define RS_SPAN_CAT(a, b) RS_SPAN_CAT_(a, b)
+#if RS_TRACE
+#define rs_span(name) ::trace::Span RS_SPAN_CAT(rs_span_, __LINE__)(name)
+#else
+#define rs_span(name) ((void)0)
+#endif
+
+// --- Benchmarks (bench, black_box) ---
+// - `bench(name, f)` times `f()` and prints a report; it returns a
+//   BenchResult. It warms up by running f in doubling batches for
+//   `warm_up`, picks an iteration count so `samples` batches fill
+//   `measurement`, and times each batch with Instant.
+//   If f returns a value it is passed to do_not_optimize.
+// - The report gives the median, p5 and p95 time per iteration and counts
+//   Tukey outliers: samples beyond 1.5 (mild) or 3 (severe) IQRs from the
+//   quartiles. They are reported, not dropped; the median ignores them.
+// - `black_box(v)` returns v but hides it from the optimizer;
+//   `do_not_optimize(v)` forces v to be computed. Use them on inputs and
+//   results so the benchmarked work is not folded away.
+// - Baselines (need ENABLE_RS_TEXT): with `save_baseline` set (or
+//   RUSTIC_BENCH_SAVE=path), the result's samples are merged into that JSON
+//   file under its name. With `baseline` set (or RUSTIC_BENCH_BASELINE=path),
+//   the run is compared with the saved samples: the report shows the median
+//   change and a Mann-Whitney U test p-value. A change counts as an
+//   improvement or regression when p < 0.05 and it exceeds
+//   `noise_threshold` (2%).
+//
+// Example:
+//   let text = load("big.json");
+//   bench("json/parse", [&] { return json::Document::parse(black_box(text)).is_ok(); });
+//   bench("sort/1k", [&] { auto v = input; sort_unstable(v); return v[0]; },
+//         {.measurement = Duration::from_secs(1)});
+// Run with RUSTIC_BENCH_SAVE=base.json, change the code, then rerun with
+// RUSTIC_BENCH_BASELINE=base.json.
+
+#if defined(__GNUC__)
+template<typename T>
+inline void do_not_optimize(const T& v) {
+    asm volatile("" : : "r,m"(v) : "memory");
+}
+// Small values go through a register so the compiler need not spill them.
+template<typename T>
+inline T black_box(T v) {
+    if constexpr (std::is_trivially_copyable_v<T> && sizeof(T) <= sizeof(void*)) asm volatile("" : "+r"(v) : : "memory");
+    else asm volatile("" : "+m"(v) : : "memory");
+    return v;
+}
+#else
+template<typename T>
+inline void do_not_optimize(const T& v) {
+    static const void* volatile sink; // the pointer itself is volatile
+    sink = &v;
+}
+template<typename T>
+inline T black_box(T v) {
+    do_not_optimize(v);
+    return v;
+}
+#endif
+
+struct BenchConfig {
+    Duration warm_up = Duration::from_millis(100);
+    Duration measurement = Duration::from_millis(500);
+    size_t samples = 50;
+    double noise_threshold = 0.02;
+    std::string baseline = {};      // JSON file to compare with; default $RUSTIC_BENCH_BASELINE
+    std::string save_baseline = {}; // JSON file to merge into; default $RUSTIC_BENCH_SAVE
+    bool quiet = false;             // no report on stdout
+};
+
+struct BenchChange {
+    enum Verdict { Improved, NoChange, Regressed };
+    double ratio;   // new median / baseline median - 1
+    double p_value; // two-sided Mann-Whitney U test
+    Verdict verdict;
+};
+
+namespace rs_detail {
+
+inline std::string bench_number(double v) {
+    char buf[32];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    return std::string(buf, res.ptr);
+}
+
+// "12.34 ns", "1.502 us", ...: four significant digits.
+inline std::string bench_time(double ns) {
+    static constexpr std::pair<double, const char*> units[] = {{1e9, "s"}, {1e6, "ms"}, {1e3, "us"}, {1, "ns"}};
+    for (const auto& [scale, unit] : units) {
+        if (ns < scale && scale != 1) continue;
+        const double v = ns / scale;
+        char buf[32];
+        const int decimals = v >= 100 ? 1 : v >= 10 ? 2 : 3;
+        const auto res = std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::fixed, decimals);
+        return std::string(buf, res.ptr) + " " + unit;
+    }
+    return "0 ns";
+}
+
+// Two-sided p-value of the Mann-Whitney U test (normal approximation, tied
+// values get their average rank).
+inline double mann_whitney_p(const std::vector<double>& a, const std::vector<double>& b) {
+    const size_t n1 = a.size(), n2 = b.size();
+    if (n1 == 0 || n2 == 0) return 1.0;
+    std::vector<std::pair<double, bool>> all;
+    all.reserve(n1 + n2);
+    for (double v : a) all.emplace_back(v, true);
+    for (double v : b) all.emplace_back(v, false);
+    std::sort(all.begin(), all.end(), [](const auto& x, const auto& y) { return x.first < y.first; });
+    double rank_sum_a = 0;
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first) ++j;
+        const double rank = static_cast<double>(i + j + 1) / 2.0; // ranks i+1 .. j
+        for (size_t t = i; t < j; ++t)
+            if (all[t].second) rank_sum_a += rank;
+        i = j;
+    }
+    const double m1 = static_cast<double>(n1), m2 = static_cast<double>(n2);
+    const double u = rank_sum_a - m1 * (m1 + 1) / 2;
+    const double sigma = std::sqrt(m1 * m2 * (m1 + m2 + 1) / 12);
+    if (sigma == 0) return 1.0;
+    const double z = (u - m1 * m2 / 2) / sigma;
+    return std::erfc(std::abs(z) / std::sqrt(2.0));
+}
+
+inline std::string bench_env(const std::string& configured, const char* var) {
+    if (!configured.empty()) return configured;
+    const char* v = std::getenv(var);
+    return v ? std::string(v) : std::string();
+}
+
+} // namespace rs_detail
+
+class BenchResult {
+public:
+    std::string name;
+    uint64_t iters_per_sample = 0;
+    std::vector<double> samples; // ns per iteration, ascending
+    Option<BenchChange> change = None();
+
+    // Linear interpolation between the closest samples; q in [0, 1].
+    double percentile(double q) const {
+        if (samples.empty()) return 0;
+        const double pos = std::clamp(q, 0.0, 1.0) * static_cast<double>(samples.size() - 1);
+        const size_t i = static_cast<size_t>(pos);
+        if (i + 1 >= samples.size()) return samples.back();
+        return samples[i] + (samples[i + 1] - samples[i]) * (pos - static_cast<double>(i));
+    }
+    double median() const { return percentile(0.5); }
+    double min() const { return samples.empty() ? 0 : samples.front(); }
+    double max() const { return samples.empty() ? 0 : samples.back(); }
+    double mean() const {
+        double sum = 0;
+        for (double s : samples) sum += s;
+        return samples.empty() ? 0 : sum / static_cast<double>(samples.size());
+    }
+    double stddev() const {
+        if (samples.size() < 2) return 0;
+        const double m = mean();
+        double sq = 0;
+        for (double s : samples) sq += (s - m) * (s - m);
+        return std::sqrt(sq / static_cast<double>(samples.size() - 1));
+    }
+    // Samples outside the Tukey fences.
+    size_t mild_outliers() const { return outliers(1.5) - outliers(3.0); }
+    size_t severe_outliers() const { return outliers(3.0); }
+
+    std::string to_json() const {
+        std::string out = "{\"median_ns\":" + rs_detail::bench_number(median()) +
+                          ",\"iters_per_sample\":" + std::to_string(iters_per_sample) + ",\"samples_ns\":[";
+        for (size_t i = 0; i < samples.size(); ++i) out += (i ? "," : "") + rs_detail::bench_number(samples[i]);
+        return out + "]}";
+    }
+
+private:
+    size_t outliers(double k) const {
+        const double q1 = percentile(0.25), q3 = percentile(0.75), iqr = q3 - q1;
+        return static_cast<size_t>(std::count_if(samples.begin(), samples.end(),
+                                                 [&](double s) { return s < q1 - k * iqr || s > q3 + k * iqr; }));
+    }
+};
+
+#ifdef ENABLE_RS_TEXT
+namespace rs_detail {
+
+inline Option<std::string> bench_read_file(const std::string& path) {
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return None();
+    std::string text;
+    char buf[4096];
+    for (size_t n; (n = std::fread(buf, 1, sizeof(buf), f)) > 0;) text.append(buf, n);
+    std::fclose(f);
+    return Option<std::string>(std::move(text));
+}
+
+// Saved samples for `name`, if the baseline file has them.
+inline Option<std::vector<double>> bench_load_baseline(const std::string& path, const std::string& name) {
+    auto text = bench_read_file(path);
+    if (!text) return None();
+    auto doc = json::Document::parse(*text);
+    if (doc.is_err()) {
+        std::cerr << "bench: ignoring baseline " << path << ": " << doc.unwrap_err() << "\n";
+        return None();
+    }
+    auto all = doc->root().field("benchmarks");
+    if (!all) return None();
+    auto entry = all->field(name);
+    if (!entry) return None();
+    auto list = entry->field("samples_ns");
+    if (!list) return None();
+    std::vector<double> samples;
+    for (json::Value v : list->elements()) {
+        auto x = v.get<double>();
+        if (x.is_err()) return None();
+        samples.push_back(*x);
+    }
+    return Option<std::vector<double>>(std::move(samples));
+}
+
+// Rewrites `path` with `r` added, or replacing an entry of the same name.
+inline void bench_save_baseline(const std::string& path, const BenchResult& r) {
+    std::string body;
+    auto text = bench_read_file(path);
+    Option<json::Document> doc = None();
+    if (text) {
+        auto parsed = json::Document::parse(*text);
+        if (parsed.is_ok()) doc = Option<json::Document>(std::move(*parsed));
+        else std::cerr << "bench: overwriting unreadable baseline " << path << "\n";
+    }
+    if (doc) {
+        if (auto all = doc->root().field("benchmarks")) {
+            for (const json::Member& m : all->members()) {
+                if (m.key.as_str() == r.name) continue;
+                body += "\n  " + json_quote(m.key.as_str()) + ": " + std::string(m.value.raw()) + ",";
+            }
+        }
+    }
+    body += "\n  " + json_quote(r.name) + ": " + r.to_json();
+    const std::string out = "{\"benchmarks\": {" + body + "\n}}\n";
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f || std::fwrite(out.data(), 1, out.size(), f) != out.size()) {
+        std::cerr << "bench: cannot write baseline " << path << "\n";
+    }
+    if (f) std::fclose(f);
+}
+
+} // namespace rs_detail
+#endif
+
+template<typename F>
+BenchResult bench(std::string name, F&& f, const BenchConfig& cfg = {}) {
+    auto run = [&](uint64_t iters) {
+        const Instant start = Instant::now();
+        for (uint64_t i = 0; i < iters; ++i) {
+            if constexpr (std::is_void_v<std::invoke_result_t<F&>>) f();
+            else do_not_optimize(f());
+        }
+        return start.elapsed();
+    };
+    Instant::calibrate();
+
+    // Warm up in doubling batches; the last batches give the time per call.
+    uint64_t iters = 1, total_iters = 0;
+    Duration total;
+    const Instant warm_start = Instant::now();
+    do {
+        total += run(iters);
+        total_iters += iters;
+        iters *= 2;
+    } while (warm_start.elapsed() < cfg.warm_up);
+    const double per_iter = static_cast<double>(total.as_nanos()) / static_cast<double>(total_iters);
+
+    const size_t n = std::max<size_t>(cfg.samples, 2);
+    BenchResult r;
+    r.name = std::move(name);
+    r.iters_per_sample = std::max<uint64_t>(
+        1, static_cast<uint64_t>(static_cast<double>(cfg.measurement.as_nanos()) / static_cast<double>(n) /
+                                 std::max(per_iter, 1e-3)));
+    r.samples.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        r.samples.push_back(static_cast<double>(run(r.iters_per_sample).as_nanos()) /
+                            static_cast<double>(r.iters_per_sample));
+    }
+    std::sort(r.samples.begin(), r.samples.end());
+
+#ifdef ENABLE_RS_TEXT
+    const std::string baseline = rs_detail::bench_env(cfg.baseline, "RUSTIC_BENCH_BASELINE");
+    if (!baseline.empty()) {
+        if (auto old = rs_detail::bench_load_baseline(baseline, r.name)) {
+            BenchResult prev;
+            prev.samples = std::move(*old);
+            std::sort(prev.samples.begin(), prev.samples.end());
+            BenchChange c;
+            c.ratio = prev.median() > 0 ? r.median() / prev.median() - 1 : 0;
+            c.p_value = rs_detail::mann_whitney_p(r.samples, prev.samples);
+            c.verdict = c.p_value >= 0.05 || std::abs(c.ratio) <= cfg.noise_threshold ? BenchChange::NoChange
+                        : c.ratio < 0                                                   ? BenchChange::Improved
+                                                                                        : BenchChange::Regressed;
+            r.change = Option<BenchChange>(c);
+        }
+    }
+    const std::string save = rs_detail::bench_env(cfg.save_baseline, "RUSTIC_BENCH_SAVE");
+    if (!save.empty()) rs_detail::bench_save_baseline(save, r);
+#endif
+
+    if (!cfg.quiet) {
+        std::string line = r.name;
+        line.resize(std::max<size_t>(line.size() + 1, 24), ' ');
+        line += "median " + rs_detail::bench_time(r.median()) + "  [p5 " + rs_detail::bench_time(r.percentile(0.05)) +
+                ", p95 " + rs_detail::bench_time(r.percentile(0.95)) + "]  " + std::to_string(n) + " x " +
+                std::to_string(r.iters_per_sample) + " iters\n";
+        if (r.change) {
+            const BenchChange& c = *r.change;
+            char buf[64];
+            std::snprintf(buf, sizeof(buf), "%+.2f%% (p = %.3f)", c.ratio * 100, c.p_value);
+            line += std::string(24, ' ') + "change " + buf +
+                    (c.verdict == BenchChange::Improved    ? ": improved\n"
+                     : c.verdict == BenchChange::Regressed ? ": regressed\n"
+                                                           : ": no change\n");
+        }
+        if (const size_t mild = r.mild_outliers(), severe = r.severe_outliers(); mild + severe > 0) {
+            line += std::string(24, ' ') + std::to_string(mild + severe) + " outliers among " + std::to_string(n) +
+                    " samples (" + std::to_string(mild) + " mild, " + std::to_string(severe) + " severe)\n";
+        }
+        std::cout << line << std::flush;
+    }
+    return r;
+}
+
+#endif // ENABLE_RS_PERF
+
 #endif // RUSTIC_H
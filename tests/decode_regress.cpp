@@ -0,0 +1,104 @@
+// Regression checks for the decoders: inputs that once decoded to the wrong
+// value, or aborted the process, instead of returning an error.
+//
+// Usage: decode_regress
+#include "rustic.hpp"
+
+#include <cstdio>
+
+namespace {
+
+usize failures = 0;
+
+void check(bool ok, const char* what) {
+    if (!ok) {
+        ++failures;
+        std::fprintf(stderr, "FAIL %s\n", what);
+    }
+}
+
+struct Empty {};
+
+Vec<u8> le_u64(u64 v) {
+    Vec<u8> out(8);
+    for (usize i = 0; i < 8; ++i) out[i] = static_cast<u8>(v >> (8 * i));
+    return out;
+}
+
+void bincode_limits() {
+    // A bare length prefix for 2^50 zero-byte elements.
+    check(bincode::from_slice<Vec<Empty>>(le_u64(u64{1} << 50)).is_err(), "bincode: Vec<Empty> of 2^50");
+    check(bincode::from_slice<Vec<Empty>>(le_u64(bincode::max_empty_elements)).is_ok(),
+          "bincode: Vec<Empty> at the limit");
+    // The limit is shared by every Vec in one decode.
+    Vec<u8> two = le_u64(2);
+    for (u64 n : {bincode::max_empty_elements, u64{1}}) {
+        const Vec<u8> len = le_u64(n);
+        two.insert(two.end(), len.begin(), len.end());
+    }
+    check(bincode::from_slice<Vec<Vec<Empty>>>(two).is_err(), "bincode: Vec<Vec<Empty>> over the shared limit");
+}
+
+void parse_signs() {
+    check(parse<i32>("+5").is_ok() && *parse<i32>("+5") == 5, "parse: +5");
+    check(parse<i32>("+-5").is_err(), "parse: +-5");
+    check(parse<u32>("+-5").is_err(), "parse: unsigned +-5");
+    check(parse<f64>("+-1.5").is_err(), "parse: +-1.5");
+    check(parse<i32>("+").is_err(), "parse: lone +");
+}
+
+void json_pointer() {
+    const std::string text = R"({"a":[10,11],"":{"0":1}})";
+    auto doc = json::Document::parse(text);
+    check(doc.is_ok(), "pointer: parse");
+    const json::Value root = doc->root();
+    check(root.pointer("/a/1").is_some(), "pointer: /a/1");
+    check(root.pointer("/a/0").is_some(), "pointer: /a/0");
+    check(root.pointer("/a/+1").is_none(), "pointer: /a/+1");
+    check(root.pointer("/a/01").is_none(), "pointer: /a/01");
+    check(root.pointer("/a/-0").is_none(), "pointer: /a/-0");
+    check(root.pointer("/a/").is_none(), "pointer: /a/ (empty token)");
+    check(root.pointer("//0").is_some(), "pointer: //0 (empty key, then member \"0\")");
+}
+
+void json_keys() {
+    // Keys decode() would reject fail the parse instead of reading back as "".
+    for (const std::string text : {std::string(R"({"a\q":1})"), std::string("{\"a\x01\":1}"),
+                                   std::string(R"({"\ud800":1})"), std::string(R"({"\u12":1})")})
+        check(json::Document::parse(text).is_err(), "Document: undecodable key");
+    const std::string text = R"({"a\tb":1,"\ud83d\ude00":2,"plain":3})";
+    auto doc = json::Document::parse(text);
+    check(doc.is_ok(), "Document: escaped keys");
+    if (doc.is_err()) return;
+    std::string keys;
+    for (const auto& m : doc->root().members()) keys += std::string(m.key.as_str()) + "|";
+    check(keys == "a\tb|\xF0\x9F\x98\x80|plain|", "Document: members() keys");
+}
+
+void json_strings() {
+    // from_str and Document::parse must agree on which strings are valid.
+    const std::string inputs[] = {"\"a\x01b\"", "\"\xff\xfe\"", "\"\xe2\x82\"", "\"tab\there\"",
+                                  R"("ok \u00e9 \ud83d\ude00")", "\"caf\xc3\xa9\"", R"("\ud800")"};
+    for (const auto& text : inputs) {
+        const bool serde = json::from_str<std::string>(text).is_ok();
+        const bool doc = json::Document::parse(text).is_ok() && json::Document::parse(text)->root().get_str().is_ok();
+        if (serde != doc) check(false, ("json: from_str and Document disagree on " + text).c_str());
+    }
+    check(json::from_str<std::string>("\"a\x01b\"").is_err(), "from_str: raw control character");
+    check(json::from_str<std::string>("\"\xff\xfe\"").is_err(), "from_str: invalid utf-8");
+    auto bad = json::from_str<std::string>("\"ab\\n\xc3\"");
+    check(bad.is_err() && bad.unwrap_err().offset == 5, "from_str: utf-8 error offset");
+    check(json::from_str<std::string>("\"caf\xc3\xa9\"").is_ok(), "from_str: valid utf-8");
+}
+
+} // namespace
+
+int main() {
+    bincode_limits();
+    parse_signs();
+    json_pointer();
+    json_keys();
+    json_strings();
+    std::printf("decode_regress: %zu failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+// Treiber stack stress test for epoch-based reclamation.
+//
+// Threads push and pop concurrently; popped nodes are retired through
+// epoch::Guard and poisoned by their destructor, so a node freed while another
+// thread still reads it shows up as a poisoned value here, or as a
+// use-after-free under -fsanitize=thread / address. At the end every retired
+// node must have been freed.
+//
+// Usage: epoch_stress [threads] [ops per thread]
+#include "rustic.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+constexpr u64 POISON = 0xdeadbeefdeadbeefull;
+
+std::atomic<u64> allocated{0};
+std::atomic<u64> freed{0};
+
+struct Node {
+    u64 value;
+    Node* next = nullptr;
+
+    explicit Node(u64 v) : value(v) { allocated.fetch_add(1, std::memory_order_relaxed); }
+    ~Node() {
+        value = POISON;
+        freed.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+class Stack {
+    std::atomic<Node*> head{nullptr};
+
+public:
+    ~Stack() {
+        for (Node* n = head.load(); n;) {
+            Node* next = n->next;
+            delete n;
+            n = next;
+        }
+    }
+
+    void push(u64 v) {
+        auto* n = new Node(v);
+        n->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+
+    Option<u64> pop() {
+        auto g = epoch::pin();
+        Node* h = head.load(std::memory_order_acquire);
+        while (h && !head.compare_exchange_weak(h, h->next, std::memory_order_acquire)) {}
+        if (!h) return None();
+        const u64 v = h->value;
+        g.defer_destroy(Box<Node>(h));
+        return Some(v);
+    }
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const usize threads = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4;
+    const u64 ops = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100000;
+
+    Stack stack;
+    std::atomic<u64> pushed_sum{0}, popped_sum{0}, poisoned{0}, deferred_runs{0};
+    thread_scope([&](auto& s) {
+        for (usize t = 0; t < threads; ++t) {
+            s.spawn([&, t] {
+                u64 rng = 0x9e3779b97f4a7c15ull * (t + 1);
+                u64 pushed = 0, popped = 0;
+                for (u64 i = 0; i < ops; ++i) {
+                    rng ^= rng << 13;
+                    rng ^= rng >> 7;
+                    rng ^= rng << 17;
+                    if (rng & 1) {
+                        const u64 v = (rng >> 8) & 0xffff;
+                        stack.push(v);
+                        pushed += v;
+                    } else if (let v = stack.pop()) {
+                        if (*v == POISON) poisoned.fetch_add(1, std::memory_order_relaxed);
+                        else popped += *v;
+                    }
+                    if ((rng & 0xfff) == 0) {
+                        auto g = epoch::pin();
+                        g.defer([&] { deferred_runs.fetch_add(1, std::memory_order_relaxed); });
+                        g.flush();
+                    }
+                }
+                pushed_sum.fetch_add(pushed);
+                popped_sum.fetch_add(popped);
+            });
+        }
+    });
+
+    // Drain what is left; these pops retire through this thread's bag.
+    u64 rest = 0;
+    while (let v = stack.pop()) rest += *v;
+    // Each flush advances the global epoch by at most one step.
+    for (int i = 0; i < 8 && freed.load() < allocated.load(); ++i) epoch::pin().flush();
+
+    bool ok = true;
+    if (poisoned.load()) {
+        std::fprintf(stderr, "read %llu freed nodes\n", static_cast<unsigned long long>(poisoned.load()));
+        ok = false;
+    }
+    if (popped_sum.load() + rest != pushed_sum.load()) {
+        std::fprintf(stderr, "lost values: pushed %llu, popped %llu\n",
+                     static_cast<unsigned long long>(pushed_sum.load()),
+                     static_cast<unsigned long long>(popped_sum.load() + rest));
+        ok = false;
+    }
+    if (freed.load() != allocated.load()) {
+        std::fprintf(stderr, "leaked %llu of %llu nodes\n", static_cast<unsigned long long>(allocated.load() - freed.load()),
+                     static_cast<unsigned long long>(allocated.load()));
+        ok = false;
+    }
+    std::printf("epoch_stress: %zu threads x %llu ops, %llu nodes, %llu deferred calls: %s\n", threads,
+                static_cast<unsigned long long>(ops), static_cast<unsigned long long>(allocated.load()),
+                static_cast<unsigned long long>(deferred_runs.load()), ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+// thread_scope stress test: scoped threads spawn more scoped threads, and
+// their handles are joined by sibling threads, while the scope is already
+// joining.
+//
+// Each round the body spawns `threads` parents, each of which spawns
+// children, plus one joiner per parent that joins the parent's handle. The
+// body then sleeps briefly so the joiners usually claim their parents first;
+// join_all skips claimed slots, so nothing it joined orders it after the
+// parent's spawn calls. Every child must run exactly once and be joined
+// before thread_scope returns; under -fsanitize=thread, a child slot whose
+// thread is published without synchronization shows up as a data race.
+//
+// Usage: scope_stress [threads] [rounds]
+#include "rustic.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+int main(int argc, char** argv) {
+    const u32 threads = argc > 1 ? static_cast<u32>(std::strtoul(argv[1], nullptr, 10)) : 4;
+    const u32 rounds = argc > 2 ? static_cast<u32>(std::strtoul(argv[2], nullptr, 10)) : 200;
+    constexpr u32 CHILDREN = 4;
+
+    for (u32 r = 0; r < rounds; ++r) {
+        std::atomic<u32> ran{0};
+        thread_scope([&](auto& s) {
+            for (u32 t = 0; t < threads; ++t) {
+                auto parent = s.spawn([&] {
+                    for (u32 c = 0; c < CHILDREN; ++c) s.spawn([&] { ran.fetch_add(1, std::memory_order_relaxed); });
+                });
+                s.spawn([parent]() mutable { (void)parent.join(); });
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        });
+        if (ran.load() != threads * CHILDREN) {
+            std::fprintf(stderr, "FAIL round %u: %u of %u children ran\n", r, ran.load(), threads * CHILDREN);
+            return 1;
+        }
+    }
+    std::printf("scope_stress: %u rounds of %u x %u nested spawns\n", rounds, threads, CHILDREN);
+}
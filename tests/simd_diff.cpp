@@ -0,0 +1,243 @@
+// Randomized differential test of the simd:: kernels against scalar loops.
+//
+// For every element type, every length up to a few vector widths (plus some
+// long ones) and every start offset within a 64-byte line, compares sum, dot,
+// min, max, argmin, argmax, map and in-place map_into with a plain loop.
+// Integer results must match exactly (sums and products wrap); float sums and
+// dot products must agree within a rounding bound, since the kernels add in
+// a different order. Float inputs also get NaN and infinity runs for the
+// min/max family.
+//
+// The kernel tier is cpu::level(); run with RUSTIC_CPU_LEVEL=generic, ssse3,
+// avx2 or avx512 to test each one (make -C tests simd does all four).
+//
+// Usage: simd_diff [seed]
+#include "rustic.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+namespace {
+
+struct Rng {
+    u64 s;
+    u64 next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+    // Uniform in [0, 1).
+    f64 unit() { return static_cast<f64>(next() >> 11) * 0x1p-53; }
+};
+
+constexpr usize MAX_OFFSET = 64;
+constexpr usize LONG_LENGTHS[] = {511, 1000, 1024, 4099};
+
+usize failures = 0;
+usize cases = 0;
+
+template<typename T>
+const char* type_name() {
+    if constexpr (std::is_same_v<T, i8>) return "i8";
+    else if constexpr (std::is_same_v<T, u8>) return "u8";
+    else if constexpr (std::is_same_v<T, i16>) return "i16";
+    else if constexpr (std::is_same_v<T, u16>) return "u16";
+    else if constexpr (std::is_same_v<T, i32>) return "i32";
+    else if constexpr (std::is_same_v<T, u32>) return "u32";
+    else if constexpr (std::is_same_v<T, i64>) return "i64";
+    else if constexpr (std::is_same_v<T, u64>) return "u64";
+    else if constexpr (std::is_same_v<T, f32>) return "f32";
+    else return "f64";
+}
+
+template<typename T>
+void fail(const char* op, usize n, usize offset, const String& detail) {
+    if (++failures <= 20)
+        std::fprintf(stderr, "FAIL %s<%s> n=%zu offset=%zu: %s\n", op, type_name<T>(), n, offset, detail.c_str());
+}
+
+template<typename T>
+String show(T v) {
+    if constexpr (std::is_floating_point_v<T>) return std::to_string(static_cast<f64>(v));
+    else if constexpr (std::is_signed_v<T>) return std::to_string(static_cast<i64>(v));
+    else return std::to_string(static_cast<u64>(v));
+}
+
+template<typename T>
+bool same(T a, T b) {
+    if constexpr (std::is_floating_point_v<T>) return a == b || (a != a && b != b);
+    else return a == b;
+}
+
+// Fills p[0..n). Mode 0: ordinary values. Mode 1 (floats): sprinkled NaN and
+// infinities. Mode 2 (floats): all NaN.
+template<typename T>
+void fill(Rng& rng, T* p, usize n, int mode) {
+    for (usize i = 0; i < n; ++i) {
+        if constexpr (std::is_floating_point_v<T>) {
+            p[i] = static_cast<T>((rng.unit() - 0.5) * 2000.0);
+            if (mode == 2) p[i] = std::numeric_limits<T>::quiet_NaN();
+            if (mode == 1) {
+                const u64 r = rng.next() % 16;
+                if (r == 0) p[i] = std::numeric_limits<T>::quiet_NaN();
+                if (r == 1) p[i] = std::numeric_limits<T>::infinity();
+                if (r == 2) p[i] = -std::numeric_limits<T>::infinity();
+            }
+        } else {
+            p[i] = static_cast<T>(rng.next());
+            // Repeated values exercise "first index of the extremum".
+            if (rng.next() % 4 == 0 && i > 0) p[i] = p[rng.next() % i];
+        }
+    }
+}
+
+template<typename T, bool Max>
+T ref_extremum(const T* p, usize n) {
+    bool any = false;
+    T best{};
+    for (usize i = 0; i < n; ++i) {
+        if (p[i] != p[i]) continue;
+        if (!any || (Max ? p[i] > best : p[i] < best)) best = p[i];
+        any = true;
+    }
+    return any ? best : p[0];
+}
+
+template<typename T, bool Max>
+usize ref_arg_extremum(const T* p, usize n) {
+    const T r = ref_extremum<T, Max>(p, n);
+    for (usize i = 0; i < n; ++i)
+        if (p[i] == r) return i;
+    return 0;
+}
+
+template<typename T>
+void check_reductions(const T* a, const T* b, usize n, usize offset) {
+    const std::span<const T> xs(a, n), ys(b, n);
+    using U = std::conditional_t<std::is_integral_v<T>, std::make_unsigned<T>, std::type_identity<T>>::type;
+    ++cases;
+
+    if constexpr (std::is_integral_v<T>) {
+        U s = 0, d = 0;
+        for (usize i = 0; i < n; ++i) {
+            s = static_cast<U>(s + static_cast<U>(a[i]));
+            d = static_cast<U>(d + static_cast<U>(static_cast<u64>(static_cast<U>(a[i])) * static_cast<U>(b[i])));
+        }
+        if (simd::sum(xs) != static_cast<T>(s)) fail<T>("sum", n, offset, show(simd::sum(xs)) + " != " + show(static_cast<T>(s)));
+        if (simd::dot(xs, ys) != static_cast<T>(d)) fail<T>("dot", n, offset, show(simd::dot(xs, ys)) + " != " + show(static_cast<T>(d)));
+    } else {
+        long double s = 0, d = 0, sabs = 0, dabs = 0;
+        for (usize i = 0; i < n; ++i) {
+            s += a[i];
+            sabs += std::fabs(static_cast<long double>(a[i]));
+            d += static_cast<long double>(a[i]) * b[i];
+            dabs += std::fabs(static_cast<long double>(a[i]) * b[i]);
+        }
+        // Any summation order is within (n + 1) * eps * sum|x| of the exact sum.
+        const long double eps = std::numeric_limits<T>::epsilon();
+        const T got_s = simd::sum(xs), got_d = simd::dot(xs, ys);
+        if (std::fabs(got_s - s) > (n + 1) * eps * sabs)
+            fail<T>("sum", n, offset, show(got_s) + " vs " + show(static_cast<f64>(s)));
+        if (std::fabs(got_d - d) > (n + 2) * eps * dabs)
+            fail<T>("dot", n, offset, show(got_d) + " vs " + show(static_cast<f64>(d)));
+    }
+}
+
+template<typename T>
+void check_extrema(const T* a, usize n, usize offset) {
+    const std::span<const T> xs(a, n);
+    ++cases;
+    if (n == 0) {
+        if (simd::min(xs) || simd::max(xs) || simd::argmin(xs) || simd::argmax(xs))
+            fail<T>("min/max", n, offset, "expected None for an empty slice");
+        return;
+    }
+    const T lo = ref_extremum<T, false>(a, n), hi = ref_extremum<T, true>(a, n);
+    if (!same(*simd::min(xs), lo)) fail<T>("min", n, offset, show(*simd::min(xs)) + " != " + show(lo));
+    if (!same(*simd::max(xs), hi)) fail<T>("max", n, offset, show(*simd::max(xs)) + " != " + show(hi));
+    const usize ilo = ref_arg_extremum<T, false>(a, n), ihi = ref_arg_extremum<T, true>(a, n);
+    if (*simd::argmin(xs) != ilo) fail<T>("argmin", n, offset, std::to_string(*simd::argmin(xs)) + " != " + std::to_string(ilo));
+    if (*simd::argmax(xs) != ihi) fail<T>("argmax", n, offset, std::to_string(*simd::argmax(xs)) + " != " + std::to_string(ihi));
+}
+
+template<typename T>
+void check_map(T* a, usize n, usize offset) {
+    const std::span<const T> xs(a, n);
+    ++cases;
+    // x * 2 is exact for floats, so contracting into an FMA cannot change it;
+    // the integer form cannot overflow.
+    const auto f = [](auto x) {
+        if constexpr (std::is_floating_point_v<T>) return x * 2 - 1;
+        else return ~x ^ (x >> 2);
+    };
+    Vec<T> want(n);
+    for (usize i = 0; i < n; ++i) want[i] = static_cast<T>(f(a[i]));
+    const Vec<T> got = simd::map(xs, f);
+    for (usize i = 0; i < n; ++i) {
+        if (!same(got[i], want[i])) {
+            fail<T>("map", n, offset, "element " + std::to_string(i) + ": " + show(got[i]) + " != " + show(want[i]));
+            break;
+        }
+    }
+    simd::map_into(xs, std::span<T>(a, n), f);
+    for (usize i = 0; i < n; ++i) {
+        if (!same(a[i], want[i])) {
+            fail<T>("map_into", n, offset, "element " + std::to_string(i) + ": " + show(a[i]) + " != " + show(want[i]));
+            break;
+        }
+    }
+}
+
+template<typename T>
+void run(Rng& rng) {
+    // Every length up to four AVX-512 vectors, each at every element offset
+    // within a cache line, then a few long slices.
+    const usize short_max = 4 * 64 / sizeof(T) + 3;
+    const usize cap = LONG_LENGTHS[std::size(LONG_LENGTHS) - 1] + MAX_OFFSET;
+    const usize bytes = (cap * sizeof(T) + 63) / 64 * 64; // aligned_alloc wants a multiple
+    auto* a = static_cast<T*>(std::aligned_alloc(64, bytes));
+    auto* b = static_cast<T*>(std::aligned_alloc(64, bytes));
+    auto one = [&](usize n, usize offset) {
+        fill(rng, a + offset, n, 0);
+        fill(rng, b + offset, n, 0);
+        check_reductions(a + offset, b + offset, n, offset);
+        check_extrema(a + offset, n, offset);
+        check_map(a + offset, n, offset);
+        if constexpr (std::is_floating_point_v<T>) {
+            fill(rng, a + offset, n, 1);
+            check_extrema(a + offset, n, offset);
+            fill(rng, a + offset, n, 2);
+            check_extrema(a + offset, n, offset);
+        }
+    };
+    for (usize n = 0; n <= short_max; ++n)
+        for (usize offset = 0; offset < MAX_OFFSET / sizeof(T); ++offset) one(n, offset);
+    for (usize n : LONG_LENGTHS)
+        for (usize offset : {usize{0}, usize{1}, MAX_OFFSET / sizeof(T) - 1}) one(n, offset);
+    std::free(a);
+    std::free(b);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Rng rng{argc > 1 ? std::strtoull(argv[1], nullptr, 10) | 1 : 0x2545f4914f6cdd1dull};
+    run<i8>(rng);
+    run<u8>(rng);
+    run<i16>(rng);
+    run<u16>(rng);
+    run<i32>(rng);
+    run<u32>(rng);
+    run<i64>(rng);
+    run<u64>(rng);
+    run<f32>(rng);
+    run<f64>(rng);
+    const char* asked = std::getenv("RUSTIC_CPU_LEVEL");
+    std::printf("simd_diff [%s%s%s]: %zu cases, %zu failures\n", cpu::level_name(cpu::level()),
+                asked && std::string_view(asked) != cpu::level_name(cpu::level()) ? ", asked for " : "",
+                asked && std::string_view(asked) != cpu::level_name(cpu::level()) ? asked : "", cases, failures);
+    return failures ? 1 : 0;
+}